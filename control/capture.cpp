@@ -0,0 +1,263 @@
+#include "capture.h"
+
+#include <QDateTime>
+#include <QtEndian>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// =============================================================================================================
+
+CaptureWriter::CaptureWriter() :
+    offset(0),
+    needSync(false),
+    frames(0),
+    stop(false)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+bool CaptureWriter::open(const QString& fileName, QString& error)
+{
+    close();
+
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        error = file.errorString();
+        return false;
+    }
+
+    buf.clear();
+    buf.reserve(FLUSH_BYTES * 2);
+    offset   = 0;
+    frames   = 0;
+    stop     = false;
+    this->error.clear();
+
+    char header[HEADER_SIZE] = {};
+    memcpy(header, "ELCP", 4);
+    qToLittleEndian<quint16>(VERSION, (uchar*)header + 4);
+    qToLittleEndian<quint16>(HEADER_SIZE, (uchar*)header + 6);
+    qToLittleEndian<quint32>(BLOCK_SIZE, (uchar*)header + 8);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), (uchar*)header + 12);
+    put(header, sizeof(header));
+    needSync = true;
+
+    writer = std::thread(&CaptureWriter::run, this);
+    return true;
+}
+
+void CaptureWriter::close()
+{
+    if(!writer.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    wake.notify_one();
+    writer.join();
+    file.close();
+}
+
+QString CaptureWriter::getError()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return error;
+}
+
+void CaptureWriter::put(const void* data, int size)
+{
+    buf.append((const char*)data, size);
+    offset += size;
+}
+
+void CaptureWriter::putRecordHeader(uint8_t type, uint8_t flags, uint16_t size)
+{
+    uchar h[RECORD_HEADER_SIZE];
+    h[0] = type;
+    h[1] = flags;
+    qToLittleEndian<quint16>(size, h + 2);
+    put(h, sizeof(h));
+}
+
+void CaptureWriter::putSync(qint64 timestamp)
+{
+    uchar s[24];
+    qToLittleEndian<quint32>(SYNC_MAGIC, s);
+    qToLittleEndian<quint32>((quint32)(offset / BLOCK_SIZE), s + 4);
+    qToLittleEndian<qint64>(timestamp, s + 8);
+    qToLittleEndian<quint64>(frames, s + 16);
+    putRecordHeader(TYPE_SYNC, 0, sizeof(s));
+    put(s, sizeof(s));
+}
+
+bool CaptureWriter::append(const QByteArray& frame, qint64 timestamp, bool tx)
+{
+    int size = RECORD_HEADER_SIZE + 8 + frame.size();
+    bool notify;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!error.isEmpty()) return false;
+
+        int rest = BLOCK_SIZE - (int)(offset % BLOCK_SIZE);
+        if(rest == BLOCK_SIZE) needSync = true; // exactly at the border
+        if(!needSync && size > rest) {
+            // pad till the border
+            if(rest >= RECORD_HEADER_SIZE) {
+                putRecordHeader(TYPE_PADDING, 0, (uint16_t)(rest - RECORD_HEADER_SIZE));
+                rest -= RECORD_HEADER_SIZE;
+            }
+            buf.append(rest, 0);
+            offset += rest;
+            needSync = true;
+        }
+        if(needSync) {
+            putSync(timestamp);
+            needSync = false;
+        }
+
+        uchar ts[8];
+        qToLittleEndian<qint64>(timestamp, ts);
+        putRecordHeader(TYPE_FRAME, tx ? FLAG_TX : 0, (uint16_t)(size - RECORD_HEADER_SIZE));
+        put(ts, sizeof(ts));
+        put(frame.constData(), frame.size());
+        ++frames;
+
+        notify = (buf.size() >= FLUSH_BYTES);
+    }
+    if(notify) wake.notify_one();
+    return true;
+}
+
+void CaptureWriter::run()
+{
+    QByteArray out;
+    out.reserve(FLUSH_BYTES * 2);
+
+    std::unique_lock<std::mutex> guard(lock);
+    for(;;) {
+        wake.wait_for(guard, std::chrono::milliseconds(FLUSH_MS), [this]() { return stop || buf.size() >= FLUSH_BYTES; });
+        bool last = stop;
+        out.swap(buf); // the producer continues in the other buffer
+        guard.unlock();
+
+        bool ok = true;
+        if(!out.isEmpty()) {
+            ok = (file.write(out) == out.size()) && file.flush();
+            out.resize(0);
+        }
+
+        guard.lock();
+        if(!ok) {
+            error = file.errorString();
+            return;
+        }
+        if(last) return;
+    }
+}
+
+// =============================================================================================================
+
+bool CaptureReader::open(const QString& fileName, QString& error)
+{
+    close();
+
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    size = file.size();
+    if(size >= CaptureWriter::HEADER_SIZE)
+        data = file.map(0, size);
+    if(!data
+       || memcmp(data, "ELCP", 4) != 0
+       || qFromLittleEndian<quint16>(data + 4) != CaptureWriter::VERSION
+       || qFromLittleEndian<quint16>(data + 6) != CaptureWriter::HEADER_SIZE
+       || qFromLittleEndian<quint32>(data + 8) != (quint32)CaptureWriter::BLOCK_SIZE) {
+        error = "Not a capture file or an unsupported version";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if(data) file.unmap(const_cast<uchar*>(data));
+    data = nullptr;
+    size = 0;
+    file.close();
+}
+
+int CaptureReader::blockCount() const
+{
+    if(size <= CaptureWriter::HEADER_SIZE) return 0;
+    return (int)((size + CaptureWriter::BLOCK_SIZE - 1) / CaptureWriter::BLOCK_SIZE);
+}
+
+qint64 CaptureReader::blockStart(int block) const
+{
+    return block ? (qint64)block * CaptureWriter::BLOCK_SIZE : CaptureWriter::HEADER_SIZE;
+}
+
+bool CaptureReader::sync(int block, Sync& s) const
+{
+    qint64 p = blockStart(block);
+    if(block < 0 || block >= blockCount() || p + CaptureWriter::RECORD_HEADER_SIZE + 24 > size) return false;
+
+    const uchar* r = data + p;
+    if(r[0] != CaptureWriter::TYPE_SYNC || qFromLittleEndian<quint16>(r + 2) != 24
+       || qFromLittleEndian<quint32>(r + 4) != CaptureWriter::SYNC_MAGIC) return false;
+    s.block     = qFromLittleEndian<quint32>(r + 8);
+    s.timestamp = qFromLittleEndian<qint64>(r + 12);
+    s.frames    = qFromLittleEndian<quint64>(r + 20);
+    return s.block == (quint32)block;
+}
+
+bool CaptureReader::readBlock(int block, QVector<Frame>& frames) const
+{
+    Sync s;
+    if(!sync(block, s)) return false;
+
+    qint64 p = blockStart(block) + CaptureWriter::RECORD_HEADER_SIZE + 24;
+    qint64 end = std::min(size, (qint64)(block + 1) * CaptureWriter::BLOCK_SIZE);
+    while(end - p >= CaptureWriter::RECORD_HEADER_SIZE) {
+        const uchar* r = data + p;
+        uint8_t type = r[0];
+        int payload = qFromLittleEndian<quint16>(r + 2);
+        if(type == CaptureWriter::TYPE_PADDING) break; // the rest of the block
+        p += CaptureWriter::RECORD_HEADER_SIZE;
+        if(type != CaptureWriter::TYPE_FRAME || payload < 8 || p + payload > end) return false;
+
+        Frame f;
+        f.timestamp = qFromLittleEndian<qint64>(r + CaptureWriter::RECORD_HEADER_SIZE);
+        f.tx = (r[1] & CaptureWriter::FLAG_TX) != 0;
+        f.data = QByteArray((const char*)r + CaptureWriter::RECORD_HEADER_SIZE + 8, payload - 8);
+        frames.append(f);
+        p += payload;
+    }
+    return true;
+}
+
+int CaptureReader::findBlock(qint64 timestamp) const
+{
+    // blocks without a Sync record (a crash in the middle of a write) count as not after
+    int lo = 0, hi = blockCount();
+    while(hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        Sync s;
+        if(!sync(mid, s) || s.timestamp <= timestamp)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
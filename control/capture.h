@@ -0,0 +1,108 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+#include <QVector>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+// Append-only binary capture of all frames on the link, little-endian.
+// The file is split into blocks of BLOCK_SIZE bytes. Every block starts with a Sync record (block 0 after
+// the file header), records never cross a block border, the rest of a block is padding. So a reader can
+// mmap the file, jump to any block and binary search by time.
+//
+//   header:  "ELCP", u16 version, u16 header size, u32 block size, i64 created (ms since epoch), 12 bytes reserved
+//   record:  u8 type, u8 flags, u16 payload size, payload
+//     Padding (0)  till the end of the block; if less than a record header is left - just zeros
+//     Sync    (1)  u32 SYNC_MAGIC, u32 block number, i64 timestamp of the next frame, u64 frames before it
+//     Frame   (2)  i64 timestamp (ms since epoch), frame without CRC; flag FLAG_TX - sent by the host
+class CaptureWriter
+{
+public:
+    static const uint16_t VERSION = 1;
+    static const int HEADER_SIZE = 32;
+    static const int RECORD_HEADER_SIZE = 4;
+    static const int BLOCK_SIZE = 64 * 1024;
+    static const uint32_t SYNC_MAGIC = 0x434E5953; // "SYNC"
+
+    static const uint8_t TYPE_PADDING = 0;
+    static const uint8_t TYPE_SYNC    = 1;
+    static const uint8_t TYPE_FRAME   = 2;
+
+    static const uint8_t FLAG_TX = (1 << 0);
+
+    static const int FLUSH_BYTES = 256 * 1024; // the writer thread is woken up
+    static const int FLUSH_MS    = 500;        // at most this much is lost if the program crashes
+
+public:
+    CaptureWriter();
+    ~CaptureWriter();   // flushes and closes
+
+    bool open(const QString& fileName, QString& error);
+    void close();
+    bool isOpen() const { return writer.joinable(); }
+    bool append(const QByteArray& frame, qint64 timestamp, bool tx); // false - write error, see getError()
+    QString getError();
+
+private:
+    void run();
+    void put(const void* data, int size);   // lock held
+    void putRecordHeader(uint8_t type, uint8_t flags, uint16_t size);
+    void putSync(qint64 timestamp);
+
+private:
+    QFile file;              // used by the writer thread only while open
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    QByteArray buf;          // not written yet
+    qint64 offset;           // in the file of the end of buf
+    bool needSync;
+    quint64 frames;
+    bool stop;
+    QString error;
+};
+
+// Reads a capture written by CaptureWriter: the file is mapped, a block is parsed on its own from its Sync record on
+class CaptureReader
+{
+public:
+    struct Sync {
+        quint32 block;
+        qint64 timestamp;        // of the first frame of the block
+        quint64 frames;          // before the block
+    };
+
+    struct Frame {
+        qint64 timestamp;
+        bool tx;
+        QByteArray data;         // without CRC
+    };
+
+public:
+    CaptureReader() : data(nullptr), size(0) {}
+    ~CaptureReader() { close(); }
+
+    bool open(const QString& fileName, QString& error);
+    void close();
+
+    int blockCount() const;
+    bool sync(int block, Sync& s) const;                        // false - no Sync record at the start of the block
+    bool readBlock(int block, QVector<Frame>& frames) const;    // appends, false - corrupted
+    int findBlock(qint64 timestamp) const;                      // the last block not starting after timestamp
+
+private:
+    qint64 blockStart(int block) const;
+
+private:
+    QFile file;
+    const uchar* data;           // mapped file
+    qint64 size;
+};
+
+#endif // CAPTURE_H
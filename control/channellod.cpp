@@ -0,0 +1,162 @@
+#include "channellod.h"
+
+#include <algorithm>
+#include <limits>
+
+// =============================================================================================================
+
+static const double NO_VALUE = std::numeric_limits<double>::quiet_NaN(); // not drawn
+
+static const int CHUNK_LEVEL = 12; // a bucket of SessionWriter::CHUNK_SAMPLES
+static_assert((1 << CHUNK_LEVEL) == SessionWriter::CHUNK_SAMPLES, "a chunk is a bucket of a level");
+
+static double voltage(const Sample& s)
+{
+    return s.u == std::numeric_limits<double>::infinity() ? 0.0 : s.u;
+}
+
+static double current(const Sample& s)
+{
+    return s.i;
+}
+
+static double power(const Sample& s)
+{
+    return ChannelLod::derive(ChannelLod::Channel::Power, voltage(s), s.i);
+}
+
+static double energy(const Sample& s)
+{
+    return s.wh;
+}
+
+static double resistance(const Sample& s)
+{
+    return ChannelLod::derive(ChannelLod::Channel::Resistance, voltage(s), s.i);
+}
+
+// one bucket per chunk, false - the chunks don't line up with the buckets
+static bool seed(SampleLod& lod, SessionColumn column, const QVector<SessionChunk>& chunks)
+{
+    for(int c = 0; c + 1 < chunks.size(); ++c)
+        if(chunks[c].count != (quint32)SessionWriter::CHUNK_SAMPLES) return false;
+
+    int v = (int)column;
+    lod.clear();
+    for(const SessionChunk& s : chunks) {
+        SampleLod::Bucket b = { (float)(s.min[v] / 1000.0), (float)(s.max[v] / 1000.0),
+                                (float)(s.firstValue[v] / 1000.0), (float)(s.lastValue[v] / 1000.0), s.first, s.last };
+        lod.appendBucket(CHUNK_LEVEL, b, s.count);
+    }
+    return true;
+}
+
+// =============================================================================================================
+
+ChannelLod::ChannelLod(SampleStorage& storage) :
+    storage(storage),
+    selected(Channel::Voltage),
+    archived(0)
+{
+    static const SampleLod::Value values[CHANNELS] = { voltage, current, power, energy, resistance };
+    for(int c = 0; c < CHANNELS; ++c)
+        lods.push_back(SampleLod(values[c]));
+    cleared();
+
+    connect(&storage, &SampleStorage::afterClear, this, &ChannelLod::cleared);
+    connect(&storage, &SampleStorage::afterAppend, this, &ChannelLod::added);
+    connect(&storage, &SampleStorage::afterAppendMultiple, this, &ChannelLod::addedMultiple);
+    connect(&storage, &SampleStorage::afterDelete, this, &ChannelLod::deleted);
+    connect(&storage, &SampleStorage::afterOpenSession, this, &ChannelLod::opened);
+}
+
+QString ChannelLod::title(Channel channel)
+{
+    switch(channel) {
+        case Channel::Voltage:    return "Voltage, V";
+        case Channel::Current:    return "Current, A";
+        case Channel::Power:      return "Power, W";
+        case Channel::Energy:     return "Energy, W⋅h";
+        case Channel::Resistance: return "Resistance, Ω";
+    }
+    return QString();
+}
+
+double ChannelLod::derive(Channel channel, double u, double i)
+{
+    if(channel == Channel::Power) return u * i;
+    return i > 0.0 ? u / i : NO_VALUE; // resistance
+}
+
+void ChannelLod::select(Channel channel)
+{
+    if(channel == selected) return;
+    if(selected != Channel::Voltage) lods[(int)selected].clear();
+    selected = channel;
+    if(selected != Channel::Voltage) build(selected);
+}
+
+void ChannelLod::build(Channel channel)
+{
+    SampleLod& lod = lods[(int)channel];
+    SessionColumn column = (channel == Channel::Voltage ? SessionColumn::U
+                            : channel == Channel::Current ? SessionColumn::I : SessionColumn::Wh);
+    bool summarized = (channel == Channel::Voltage || channel == Channel::Current || channel == Channel::Energy);
+
+    size_t from = 0; // the first stored sample not in the level of detail yet
+    if(summarized && removed < archived && seed(lod, column, archive)) {
+        lod.del(removed);
+        from = archived - removed;
+    }
+    else {
+        lod.clear(removed);
+    }
+
+    // sequentially, the cold samples are decoded a chunk at a time
+    for(size_t i = from, n = storage.size(); i < n; ++i)
+        lod.append(storage.sample(i));
+}
+
+void ChannelLod::cleared()
+{
+    begin = 0;
+    appended = 0;
+    removed = 0;
+    archive.clear();
+    archived = 0;
+    for(SampleLod& lod : lods)
+        lod.clear();
+}
+
+void ChannelLod::added(const Sample& sample)
+{
+    if(!begin) begin = sample.timestamp;
+    ++appended;
+    lods[(int)Channel::Voltage].append(sample);
+    if(selected != Channel::Voltage) lods[(int)selected].append(sample);
+}
+
+void ChannelLod::addedMultiple(const QVector<Sample> &list)
+{
+    for(auto i = list.begin(), e = list.end(); i != e; ++i)
+        added(*i);
+}
+
+void ChannelLod::deleted(size_t n)
+{
+    removed = std::min(removed + n, appended);
+    lods[(int)Channel::Voltage].del(n);
+    if(selected != Channel::Voltage) lods[(int)selected].del(n);
+}
+
+void ChannelLod::opened(const QVector<SessionChunk>& chunks)
+{
+    archive = chunks;
+    for(const SessionChunk& s : chunks)
+        archived += s.count;
+    if(!begin && !chunks.isEmpty()) begin = chunks.front().first;
+    appended += archived;
+
+    build(Channel::Voltage);
+    if(selected != Channel::Voltage) build(selected);
+}
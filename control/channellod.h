@@ -0,0 +1,61 @@
+#ifndef CHANNELLOD_H
+#define CHANNELLOD_H
+
+#include "samplestorage.h"
+#include "samplelod.h"
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+// The levels of detail of the channels of the storage, one per channel for all the curves showing it.
+// Voltage is always kept up to date, another channel only while it is selected: its level of detail is
+// built from the stored samples on selection and released when another one is selected.
+// Derived channels (power, resistance) are computed from voltage and current of each sample.
+// The samples of an opened session are taken from the chunk summaries, a bucket per chunk, as far as
+// the channel is in them; the finer levels are left to the curves zoomed in.
+class ChannelLod : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Channel { Voltage, Current, Power, Energy, Resistance };
+
+    static const int CHANNELS = 5;
+
+public:
+    explicit ChannelLod(SampleStorage& storage); // before any sample is stored
+
+    static QString title(Channel channel);   // with the unit
+    static double derive(Channel channel, double u, double i); // power or resistance, NaN - none
+
+    void select(Channel channel);            // Voltage - none besides it
+    Channel getSelected() const { return selected; }
+    const SampleLod& lod(Channel channel) const { return lods[(int)channel]; } // empty if not kept
+    qint64 getBegin() const { return begin; }
+    size_t getRemoved() const { return removed; } // since clear()
+
+public slots:
+    void cleared();
+    void added(const Sample& sample);
+    void addedMultiple(const QVector<Sample> &list);
+    void deleted(size_t n);
+    void opened(const QVector<SessionChunk>& chunks);
+
+private:
+    void build(Channel channel);  // from the summaries of the archive and the stored samples
+
+private:
+    const SampleStorage& storage;
+    std::vector<SampleLod> lods;  // by Channel
+    Channel selected;
+    QVector<SessionChunk> archive; // of the opened session, the samples before all the others
+    size_t archived;
+    qint64 begin;
+    size_t appended;              // since clear()
+    size_t removed;
+};
+
+#endif // CHANNELLOD_H
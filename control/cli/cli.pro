@@ -0,0 +1,56 @@
+#-------------------------------------------------
+#
+# Headless control program, no GUI
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core serialport
+QT       -= gui
+
+TARGET = electronic_load_cli
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    controller.cpp \
+    script.cpp \
+    recorder.cpp \
+    ../sessionmanager.cpp \
+    ../devicesession.cpp \
+    ../commpool.cpp \
+    ../comm.cpp \
+    ../portbackend.cpp \
+    ../capture.cpp \
+    ../decoder.cpp \
+    ../crc.cpp \
+    ../deviceclock.cpp \
+    ../samplestorage.cpp \
+    ../samplespill.cpp \
+    ../sessionfile.cpp \
+    ../logging.cpp
+
+HEADERS  += controller.h \
+    script.h \
+    recorder.h \
+    ../sessionmanager.h \
+    ../devicesession.h \
+    ../commpool.h \
+    ../comm.h \
+    ../portbackend.h \
+    ../capture.h \
+    ../decoder.h \
+    ../crc.h \
+    ../deviceclock.h \
+    ../samplestorage.h \
+    ../samplespill.h \
+    ../sessionfile.h \
+    ../sample.h \
+    ../settings.h \
+    ../logging.h
+
+linux {
+    SOURCES += ../nativeportbackend.cpp
+    HEADERS += ../nativeportbackend.h
+}
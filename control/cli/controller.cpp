@@ -0,0 +1,265 @@
+#include "controller.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+// =============================================================================================================
+
+// V or A to mV or mA within the range of the device, the firmware takes any value as it is
+static bool toSetting(double v, uint16_t min, uint16_t max, const QString& name, uint16_t& out, QString& error)
+{
+    double x = std::round(v * 1000.0);
+    if(!(x >= min && x <= max)) {
+        error = QString("%1 %2 is out of the range of the device: %3..%4")
+            .arg(name).arg(v).arg((double)min / 1000, 0, 'f', 3).arg((double)max / 1000, 0, 'f', 3);
+        return false;
+    }
+    out = (uint16_t)x;
+    return true;
+}
+
+// =============================================================================================================
+
+Controller::Controller(const Options& options_, const QString& port_, DeviceSession* session_, SampleStorage* storage_,
+                       QObject *parent) :
+    QObject(parent),
+    options(options_),
+    port(port_),
+    session(session_),
+    storage(storage_),
+    pos(0),
+    waiting(nullptr),
+    configured(false),
+    done(false),
+    wasRunning(false),
+    settingU(0),
+    settingI(0)
+{
+    connect(session, &DeviceSession::error, this, &Controller::on_error);
+    connect(session, &DeviceSession::stateChanged, this, &Controller::on_stateChanged);
+    connect(session, &DeviceSession::version, this, &Controller::on_version);
+    connect(session, &DeviceSession::settings, this, &Controller::on_settings);
+    connect(session, &DeviceSession::deviceState, this, &Controller::on_deviceState);
+    connect(session, &DeviceSession::lost, [this](quint64 lost, quint64 lostFast) {
+        message(QString("lost: %1, fast: %2").arg(lost).arg(lostFast));
+    } );
+    storage->setEnabled(true);
+
+    stepTimer.setSingleShot(true);
+    connect(&stepTimer, &QTimer::timeout, this, &Controller::runSteps);
+}
+
+void Controller::start()
+{
+    session->setPortBackend(options.native ? Comm::Backend::Native : Comm::Backend::Qt);
+    session->setInterval(options.interval);
+    session->setFastStream(options.fast);
+    session->connectPort(port);
+
+    QTimer::singleShot(CONNECT_TIMEOUT_MS, this, [this]() {
+        if(!configured) on_error("No response from the device");
+    } );
+}
+
+void Controller::report()
+{
+    for(int c = 0; c < 32; ++c) {
+        const DeviceSession::TxStats& s = session->getTxStats((Cmd)c);
+        if(s.count == 0) continue;
+
+        message(QString("tx 0x%1: %2 commands, %3 bytes, delay avg %4 us, max %5 us")
+            .arg(c, 2, 16, QChar('0')).arg(s.count).arg(s.bytes).arg(s.delayUs / (qint64)s.count).arg(s.maxDelayUs));
+    }
+}
+
+void Controller::message(const QString& msg)
+{
+    if(!options.quiet) qDebug().noquote() << port + ":" << msg;
+}
+
+void Controller::finish(int code)
+{
+    if(done) return;
+
+    done = true;
+    stepTimer.stop();
+    waiting = nullptr;
+    emit finished(code);
+}
+
+void Controller::on_error(QString msg)
+{
+    if(done) return;
+
+    qCritical().noquote() << port + ":" << msg;
+    finish(1);
+}
+
+void Controller::on_stateChanged(Comm::State state)
+{
+    if(state == Comm::State::Idle && configured)
+        on_error("Device disconnected");
+}
+
+void Controller::on_version(uint32_t v)
+{
+    message("version: 0x" + QString("%1").arg(v, 8, 16, QChar('0')).toUpper());
+    if(options.fast && v < DEVICE_VERSION_STREAM)
+        message("fast stream is not supported by the device");
+}
+
+void Controller::on_settings(uint16_t u, uint16_t i)
+{
+    settingU = u;
+    settingI = i;
+
+    if(configured) return;
+
+    // the first settings come with the initial config, start when the negotiation queued behind them is done
+    configured = true;
+    message(QString("limits: %1 V, %2 A").arg((double)u / 1000, 0, 'f', 3).arg((double)i / 1000, 0, 'f', 3));
+    if(options.bench > 0)
+        session->call([this]() { runBench(); });
+    else
+        session->call([this]() { runSteps(); });
+}
+
+void Controller::on_deviceState(const CmdStateData& c, const Sample& s)
+{
+    (void)c;
+
+    bool running = session->isRunning();
+    if(running != wasRunning) message(running ? "run" : "stop");
+    wasRunning = running;
+
+    if(!waiting) return;
+
+    bool reached = false;
+    switch(waiting->type) {
+        case Step::Type::WaitRun:
+            reached = running;
+            break;
+
+        case Step::Type::WaitStop:
+            reached = !running;
+            break;
+
+        case Step::Type::Until:
+            {
+                double v = 0;
+                switch(waiting->value) {
+                    case Step::Value::U:  v = s.u;  break;
+                    case Step::Value::I:  v = s.i;  break;
+                    case Step::Value::Ah: v = s.ah; break;
+                    case Step::Value::Wh: v = s.wh; break;
+                }
+                reached = (waiting->less ? v < waiting->limit : v > waiting->limit);
+            }
+            break;
+
+        default:
+            ;
+    }
+
+    if(reached) {
+        waiting = nullptr;
+        runSteps();
+    }
+}
+
+void Controller::runBench()
+{
+    if(done) return;
+
+    // one request at a time, the next one is sent when the response is processed
+    if(benchClock.isValid()) benchTimes.append(benchClock.nsecsElapsed() / 1000);
+    if(benchTimes.size() < options.bench) {
+        benchClock.start();
+        session->request(formCmdData(Cmd::ReadSettings)); // no side effects
+        session->call([this]() { runBench(); });
+        return;
+    }
+
+    std::sort(benchTimes.begin(), benchTimes.end());
+    qint64 sum = 0;
+    for(qint64 t : benchTimes) sum += t;
+    int n = benchTimes.size();
+    qDebug().noquote() << port + ":" << QString("%1 round trips, %2 backend, us: min %3, avg %4, median %5, 99% %6, max %7")
+        .arg(n).arg(options.native ? "native" : "Qt")
+        .arg(benchTimes[0]).arg(sum / n).arg(benchTimes[n / 2]).arg(benchTimes[std::min(n - 1, n * 99 / 100)]).arg(benchTimes[n - 1]);
+    finish(0);
+}
+
+void Controller::runSteps()
+{
+    if(done) return;
+
+    while(pos < options.steps.size()) {
+        const Step& step = options.steps[pos++];
+        if(step.line > 0) message(QString("step at line %1").arg(step.line));
+
+        switch(step.type) {
+            case Step::Type::Set:
+                {
+                    const CmdConfigData& config = session->getConfig();
+                    CmdSettingData d(Cmd::WriteSettings, CmdState::Request);
+                    d.u = settingU;
+                    d.i = settingI;
+                    QString error;
+                    if((step.u >= 0 && !toSetting(step.u, config.uSetMin, config.uSetMax, "voltage", d.u, error))
+                       || (step.i >= 0 && !toSetting(step.i, config.iSetMin, config.iSetMax, "current", d.i, error))) {
+                        on_error(error);
+                        return;
+                    }
+                    session->request(formCmdData(d));
+                    session->request(formCmdData(Cmd::ReadSettings));
+                    session->call([this]() { runSteps(); });
+                }
+                return;
+
+            case Step::Type::Reset:
+                session->request(formCmdData(Cmd::ResetState));
+                session->call([this]() { runSteps(); });
+                return;
+
+            case Step::Type::Wait:
+                stepTimer.start((int)(step.seconds * 1000));
+                return;
+
+            case Step::Type::WaitRun:
+                if(session->isRunning()) break;
+                waiting = &step;
+                return;
+
+            case Step::Type::WaitStop:
+                if(!session->isRunning()) break;
+                waiting = &step;
+                return;
+
+            case Step::Type::Until:
+                waiting = &step;
+                return;
+
+            case Step::Type::Stream:
+                if(step.on && !options.fast) {
+                    message("no output for the fast stream, ignored");
+                    break;
+                }
+                session->setFastStream(step.on);
+                session->call([this]() { runSteps(); });
+                return;
+
+            case Step::Type::Record:
+                storage->setEnabled(step.on);
+                break;
+
+            case Step::Type::Quit:
+                finish(0);
+                return;
+        }
+    }
+
+    if(options.script) finish(0); // otherwise record until the duration is over or interrupted
+}
@@ -0,0 +1,70 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include "script.h"
+#include "../devicesession.h"
+#include "../samplestorage.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// Connects to one device and runs the steps on it
+class Controller : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        int interval;          // ms
+        bool fast;             // fast voltage stream
+        bool script;           // finish after the last step
+        bool quiet;
+        bool native;           // termios port backend
+        int bench;             // request-response round trips to measure instead of the steps, 0 - none
+        QVector<Step> steps;
+    };
+
+    static const int CONNECT_TIMEOUT_MS = 3000;
+
+public:
+    Controller(const Options& options, const QString& port, DeviceSession* session, SampleStorage* storage,
+               QObject *parent = 0);
+
+    void start();
+    void report(); // transmit statistics
+
+signals:
+    void finished(int code);
+
+private slots:
+    void on_error(QString msg);
+    void on_stateChanged(Comm::State state);
+    void on_version(uint32_t v);
+    void on_settings(uint16_t u, uint16_t i);
+    void on_deviceState(const CmdStateData& c, const Sample& s);
+
+private:
+    void runSteps();
+    void runBench();
+    void finish(int code);
+    void message(const QString& msg);
+
+private:
+    Options options;
+    QString port;
+    DeviceSession *session;
+    SampleStorage *storage;
+    QTimer stepTimer;
+    int pos;                   // next step
+    const Step* waiting;       // step waiting for a device state, null - none
+    bool configured;
+    bool done;
+    bool wasRunning;
+    uint16_t settingU;         // mV
+    uint16_t settingI;         // mA
+    QElapsedTimer benchClock;
+    QVector<qint64> benchTimes; // us
+};
+
+#endif // CONTROLLER_H
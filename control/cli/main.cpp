@@ -0,0 +1,183 @@
+#include "controller.h"
+#include "recorder.h"
+#include "../sessionmanager.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QDebug>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+
+// Headless controller and recorder: configures the devices, runs a script of steps on each
+// and writes the samples at full rate into a file or stdout.
+
+static const size_t STORAGE_SAMPLES = 1000;       // only the latest samples are kept, all are written
+static const size_t STORAGE_FAST_SAMPLES = 10000;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+// capture.elcap -> capture_ttyUSB0.elcap for each of several devices
+static QString captureFileName(const QString& fileName, const QString& port, bool several)
+{
+    if(!several) return fileName;
+
+    QFileInfo info(fileName);
+    QString name = info.completeBaseName() + "_" + QFileInfo(port).fileName();
+    if(!info.suffix().isEmpty()) name += "." + info.suffix();
+    return info.dir().filePath(name);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("electronic_load_cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Command line control of the electronic load");
+    parser.addHelpOption();
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Serial port, repeat for several devices.", "name");
+    QCommandLineOption intervalOption(QStringList() << "n" << "interval", "State interval.", "ms",
+        QString::number(DeviceSession::MIN_INTERVAL_BINARY_MS));
+    QCommandLineOption voltageOption(QStringList() << "u" << "voltage", "Set the voltage limit before the script.", "V");
+    QCommandLineOption currentOption(QStringList() << "i" << "current", "Set the current before the script.", "A");
+    QCommandLineOption resetOption(QStringList() << "r" << "reset", "Reset energy counters before the script.");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "CSV file for samples, '-' - stdout.", "file", "-");
+    QCommandLineOption fastOption(QStringList() << "f" << "fast", "Enable the fast voltage stream and write it into CSV file, '-' - stdout.", "file");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", "Stop after this time, 0 - unlimited.", "s", "0");
+    QCommandLineOption scriptOption(QStringList() << "s" << "script", "Run steps from the file, '-' - stdin, and quit after the last one.", "file");
+    QCommandLineOption quietOption(QStringList() << "q" << "quiet", "No status messages on stderr.");
+    QCommandLineOption nativeOption("native", "Use the termios port backend instead of QSerialPort, Linux only.");
+    QCommandLineOption captureOption(QStringList() << "c" << "capture", "Record every frame on the link into a binary file, "
+                                     "the port name is added for several devices.", "file");
+    QCommandLineOption benchOption("bench", "Measure request-response round trips instead of running the script, "
+                                   "compare with and without --native.", "count");
+    parser.addOptions({ portOption, intervalOption, voltageOption, currentOption, resetOption, outputOption, fastOption,
+                        durationOption, scriptOption, quietOption, nativeOption, captureOption, benchOption });
+    parser.process(a);
+
+    QStringList ports = parser.values(portOption);
+    if(ports.isEmpty()) {
+        qCritical() << "no port given";
+        return 1;
+    }
+
+    Controller::Options options;
+    options.interval = std::max(parser.value(intervalOption).toInt(), (int)DeviceSession::MIN_INTERVAL_BINARY_MS);
+    options.fast     = parser.isSet(fastOption);
+    options.script   = parser.isSet(scriptOption);
+    options.quiet    = parser.isSet(quietOption);
+    options.native   = parser.isSet(nativeOption);
+    options.bench    = std::max(parser.value(benchOption).toInt(), 0);
+
+    if(options.native && !Comm::isBackendAvailable(Comm::Backend::Native)) {
+        qCritical() << "native port backend is not available on this platform";
+        return 1;
+    }
+    // command line settings go before the script
+    if(parser.isSet(voltageOption) || parser.isSet(currentOption)) {
+        Step s(Step::Type::Set);
+        bool ok = true;
+        if(parser.isSet(voltageOption)) {
+            s.u = parser.value(voltageOption).toDouble(&ok);
+            if(!ok || s.u < 0) {
+                qCritical().noquote() << "wrong voltage:" << parser.value(voltageOption);
+                return 1;
+            }
+        }
+        if(parser.isSet(currentOption)) {
+            s.i = parser.value(currentOption).toDouble(&ok);
+            if(!ok || s.i < 0) {
+                qCritical().noquote() << "wrong current:" << parser.value(currentOption);
+                return 1;
+            }
+        }
+        options.steps.push_back(s);
+    }
+    if(parser.isSet(resetOption))
+        options.steps.push_back(Step(Step::Type::Reset));
+
+    if(options.script) {
+        QString fileName = parser.value(scriptOption);
+        QFile file;
+        bool ok;
+        if(fileName == "-") {
+            ok = file.open(stdin, QIODevice::ReadOnly | QIODevice::Text);
+        }
+        else {
+            file.setFileName(fileName);
+            ok = file.open(QIODevice::ReadOnly | QIODevice::Text);
+        }
+        if(!ok) {
+            qCritical().noquote() << "cannot read from" << fileName << ":" << file.errorString();
+            return 1;
+        }
+
+        QTextStream in(&file);
+        QString error;
+        if(!parseScript(in, options.steps, error)) {
+            qCritical().noquote() << fileName << error;
+            return 1;
+        }
+    }
+
+    SessionManager manager;
+    for(const QString& port : ports)
+        manager.add(port, STORAGE_SAMPLES, STORAGE_FAST_SAMPLES);
+
+    if(parser.isSet(captureOption)) {
+        for(int i = 0; i < manager.size(); ++i) {
+            QObject::connect(manager.session(i), &DeviceSession::captureError, [](QString msg) {
+                qCritical().noquote() << msg;
+            } );
+            manager.session(i)->setCaptureFile(captureFileName(parser.value(captureOption), manager.port(i),
+                                                               manager.size() > 1));
+        }
+    }
+
+    Recorder recorder(manager);
+    if(!recorder.open(parser.value(outputOption), parser.value(fastOption), options.interval)) return 1;
+
+    // every device runs the script on its own, quit when all are done
+    int running = manager.size();
+    int result = 0;
+    QVector<Controller*> controllers;
+    for(int i = 0; i < manager.size(); ++i) {
+        Controller* c = new Controller(options, manager.port(i), manager.session(i), manager.storage(i), &manager);
+        QObject::connect(c, &Controller::finished, [&running, &result, &a](int code) {
+            result = std::max(result, code);
+            if(--running == 0) a.exit(result);
+        } );
+        controllers.append(c);
+    }
+    for(Controller* c : controllers)
+        c->start();
+
+    double duration = parser.value(durationOption).toDouble();
+    if(duration > 0)
+        QTimer::singleShot((int)(duration * 1000), [&a, &result]() { a.exit(result); });
+
+    // Ctrl+C - stop recording with all written samples flushed
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    QTimer interruptTimer;
+    QObject::connect(&interruptTimer, &QTimer::timeout, [&a, &result]() {
+        if(interrupted) a.exit(result);
+    });
+    interruptTimer.start(100);
+
+    int res = a.exec();
+    for(Controller* c : controllers)
+        c->report();
+    return res;
+}
@@ -0,0 +1,135 @@
+#include "recorder.h"
+
+#include <QDateTime>
+#include <QDebug>
+
+#include <cstdio>
+
+// =============================================================================================================
+
+static const QString dateTimeFormat("dd.MM.yyyy hh:mm.ss.zzz"); // the same as in logs saved by the GUI
+
+Recorder::Recorder(SessionManager& manager_, QObject *parent) :
+    QObject(parent),
+    manager(manager_),
+    begin(0)
+{
+}
+
+bool Recorder::openFile(QFile& file, const QString& name)
+{
+    bool ok;
+    if(name.isEmpty() || name == "-") {
+        ok = file.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    else {
+        file.setFileName(name);
+        ok = file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate);
+    }
+
+    if(!ok) qCritical().noquote() << "cannot write into" << name << ":" << file.errorString();
+    return ok;
+}
+
+bool Recorder::open(const QString& output, const QString& fastOutput, int interval)
+{
+    if(!openFile(out, output)) return false;
+
+    if(manager.size() == 1) {
+        out.write("\"Timestamp\",\"Time, s\",\"Current, A\",\"Voltage, V\",\"Energy, Ah\",\"Energy, Wh\"\n");
+        connect(manager.storage(0), &SampleStorage::afterAppend, this, &Recorder::on_afterAppend);
+        connect(manager.storage(0), &SampleStorage::afterAppendMultiple, this, &Recorder::on_afterAppendMultiple);
+    }
+    else {
+        QString header = "\"Timestamp\",\"Time, s\"";
+        for(int i = 0; i < manager.size(); ++i) {
+            QString p = manager.port(i);
+            header += QString(",\"%1 Current, A\",\"%1 Voltage, V\",\"%1 Energy, Ah\",\"%1 Energy, Wh\"").arg(p);
+        }
+        header += "\n";
+        out.write(header.toLatin1());
+        connect(&manager, &SessionManager::aligned, this, &Recorder::on_aligned);
+        manager.startMerge(interval);
+    }
+    out.flush();
+
+    if(!fastOutput.isEmpty()) {
+        bool toStdout = (output.isEmpty() || output == "-");
+        if(fastOutput == "-" ? toStdout : fastOutput == output) {
+            qCritical() << "fast samples need another output";
+            return false;
+        }
+        if(!openFile(fastOut, fastOutput)) return false;
+
+        fastOut.write(manager.size() == 1 ? "\"Timestamp\",\"Time, s\",\"Voltage, V\"\n"
+                                          : "\"Timestamp\",\"Time, s\",\"Device\",\"Voltage, V\"\n");
+        fastOut.flush();
+        for(int i = 0; i < manager.size(); ++i) {
+            connect(manager.storage(i), &SampleStorage::afterAppendFast, [this, i](const QVector<FastSample>& list) {
+                writeFast(i, list);
+            } );
+        }
+    }
+
+    return true;
+}
+
+void Recorder::writeTime(QFile& file, qint64 timestamp)
+{
+    if(!begin) begin = timestamp;
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), ",%.3f", (double)(timestamp - begin) / 1000.0);
+    file.write(QDateTime::fromMSecsSinceEpoch(timestamp).toString(dateTimeFormat).toLatin1());
+    file.write(buf);
+}
+
+void Recorder::on_afterAppend(const Sample& sample)
+{
+    on_afterAppendMultiple(QVector<Sample>() << sample);
+}
+
+void Recorder::on_afterAppendMultiple(const QVector<Sample>& list)
+{
+    char buf[128];
+    for(const Sample& sample : list) {
+        writeTime(out, sample.timestamp);
+        snprintf(buf, sizeof(buf), ",%.3f,%.3f,%.3f,%.3f\n", sample.i, sample.u, sample.ah, sample.wh);
+        out.write(buf);
+    }
+    out.flush();
+}
+
+void Recorder::on_aligned(qint64 timestamp, const QVector<Sample>& row)
+{
+    char buf[128];
+    writeTime(out, timestamp);
+    for(const Sample& sample : row) {
+        if(sample.timestamp) {
+            snprintf(buf, sizeof(buf), ",%.3f,%.3f,%.3f,%.3f", sample.i, sample.u, sample.ah, sample.wh);
+            out.write(buf);
+        }
+        else {
+            out.write(",,,,"); // no sample of this device
+        }
+    }
+    out.write("\n");
+    out.flush();
+}
+
+void Recorder::writeFast(int device, const QVector<FastSample>& list)
+{
+    char buf[64];
+    QByteArray port = manager.port(device).toLatin1();
+    for(const FastSample& sample : list) {
+        writeTime(fastOut, sample.timestamp);
+        if(manager.size() > 1) {
+            fastOut.write(",\"");
+            fastOut.write(port);
+            fastOut.write("\"");
+        }
+        snprintf(buf, sizeof(buf), ",%.3f\n", sample.u);
+        fastOut.write(buf);
+    }
+    fastOut.flush();
+}
@@ -0,0 +1,36 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "../sessionmanager.h"
+
+#include <QObject>
+#include <QFile>
+
+// Writes samples as CSV: one device - every sample, several devices - rows merged on the time grid
+class Recorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    Recorder(SessionManager& manager, QObject *parent = 0);
+
+    bool open(const QString& output, const QString& fastOutput, int interval); // empty or "-" - stdout
+
+private slots:
+    void on_afterAppend(const Sample& sample);
+    void on_afterAppendMultiple(const QVector<Sample>& list);
+    void on_aligned(qint64 timestamp, const QVector<Sample>& row);
+
+private:
+    bool openFile(QFile& file, const QString& name);
+    void writeTime(QFile& file, qint64 timestamp);
+    void writeFast(int device, const QVector<FastSample>& list);
+
+private:
+    SessionManager& manager;
+    QFile out;
+    QFile fastOut;
+    qint64 begin;             // of all devices
+};
+
+#endif // RECORDER_H
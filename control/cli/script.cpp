@@ -0,0 +1,113 @@
+#include "script.h"
+
+#include <QStringList>
+#include <QRegularExpression>
+
+// =============================================================================================================
+
+static double parseNumber(const QString& s)
+{
+    bool ok;
+    double v = s.toDouble(&ok);
+    if(!ok || v < 0)
+        throw "Wrong number";
+    return v;
+}
+
+static bool parseOnOff(const QString& s)
+{
+    if(s == "on")  return true;
+    if(s == "off") return false;
+    throw "Expected 'on' or 'off'";
+}
+
+// note: tokens are not empty and lower case
+static Step parseStep(const QStringList& tokens)
+{
+    const QString& cmd = tokens[0];
+
+    if(cmd == "set") {
+        Step s(Step::Type::Set);
+        if(tokens.size() < 2) throw "Nothing to set";
+        for(int n = 1; n < tokens.size(); ++n) {
+            if(tokens[n].startsWith("u="))      s.u = parseNumber(tokens[n].mid(2));
+            else if(tokens[n].startsWith("i=")) s.i = parseNumber(tokens[n].mid(2));
+            else throw "Expected 'u=<V>' or 'i=<A>'";
+        }
+        return s;
+    }
+
+    if(cmd == "reset") {
+        if(tokens.size() != 1) throw "Unexpected arguments";
+        return Step(Step::Type::Reset);
+    }
+
+    if(cmd == "wait") {
+        if(tokens.size() != 2) throw "Expected 'wait <seconds>', 'wait run' or 'wait stop'";
+        if(tokens[1] == "run")  return Step(Step::Type::WaitRun);
+        if(tokens[1] == "stop") return Step(Step::Type::WaitStop);
+
+        Step s(Step::Type::Wait);
+        s.seconds = parseNumber(tokens[1]);
+        return s;
+    }
+
+    if(cmd == "until") {
+        // allow both "u<3.0" and "u < 3.0"
+        QString cond = QStringList(tokens.mid(1)).join("");
+        QRegularExpressionMatch m = QRegularExpression("^(u|i|ah|wh)([<>])([0-9.]+)$").match(cond);
+        if(!m.hasMatch()) throw "Expected 'until <u|i|ah|wh> <'<'|'>'> <value>'";
+
+        Step s(Step::Type::Until);
+        QString v = m.captured(1);
+        if(v == "u")       s.value = Step::Value::U;
+        else if(v == "i")  s.value = Step::Value::I;
+        else if(v == "ah") s.value = Step::Value::Ah;
+        else               s.value = Step::Value::Wh;
+        s.less  = (m.captured(2) == "<");
+        s.limit = parseNumber(m.captured(3));
+        return s;
+    }
+
+    if(cmd == "stream" || cmd == "record") {
+        if(tokens.size() != 2) throw "Expected 'on' or 'off'";
+        Step s(cmd == "stream" ? Step::Type::Stream : Step::Type::Record);
+        s.on = parseOnOff(tokens[1]);
+        return s;
+    }
+
+    if(cmd == "quit" || cmd == "exit") {
+        if(tokens.size() != 1) throw "Unexpected arguments";
+        return Step(Step::Type::Quit);
+    }
+
+    throw "Unknown command";
+}
+
+bool parseScript(QTextStream& in, QVector<Step>& steps, QString& error)
+{
+    int lineNo = 0;
+    for(;;) {
+        QString line = in.readLine();
+        if(line.isNull()) break;
+        ++lineNo;
+
+        int comment = line.indexOf('#');
+        if(comment >= 0) line.truncate(comment);
+
+        QStringList tokens = line.toLower().split(QRegularExpression("\\s+"), QString::SkipEmptyParts);
+        if(tokens.isEmpty()) continue;
+
+        try {
+            Step s = parseStep(tokens);
+            s.line = lineNo;
+            steps.push_back(s);
+        }
+        catch(char const* msg) {
+            error = QString("Line %1: %2").arg(lineNo).arg(msg);
+            return false;
+        }
+    }
+
+    return true;
+}
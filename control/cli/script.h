@@ -0,0 +1,56 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <QString>
+#include <QVector>
+#include <QTextStream>
+
+// One step of a scripted sequence, one per line, '#' starts a comment:
+//   set [u=<V>] [i=<A>]   write limits, an omitted one is kept
+//   reset                 reset energy counters
+//   wait <seconds>
+//   wait run|stop         until the load is started or stopped on the device
+//   until <u|i|ah|wh> <'<'|'>'> <value>
+//   stream on|off         fast voltage stream
+//   record on|off         output of samples
+//   quit
+struct Step
+{
+    enum class Type {
+        Set,
+        Reset,
+        Wait,
+        WaitRun,
+        WaitStop,
+        Until,
+        Stream,
+        Record,
+        Quit
+    };
+
+    enum class Value {
+        U,
+        I,
+        Ah,
+        Wh
+    };
+
+    Type type;
+    int line;       // in the script, 0 - from the command line
+
+    double u;       // V, negative - keep
+    double i;       // A, negative - keep
+    double seconds;
+    Value value;
+    bool less;
+    double limit;
+    bool on;
+
+    Step() : type(Type::Quit), line(0), u(-1), i(-1), seconds(0), value(Value::U), less(true), limit(0), on(false) {}
+
+    Step(Type type_) : type(type_), line(0), u(-1), i(-1), seconds(0), value(Value::U), less(true), limit(0), on(false) {}
+};
+
+bool parseScript(QTextStream& in, QVector<Step>& steps, QString& error);
+
+#endif // SCRIPT_H
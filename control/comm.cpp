@@ -2,30 +2,109 @@
 #include <limits>
 #include <algorithm>
 
-#include <QDebug>
+#include <QDateTime>
 
 #include "crc.h"
+#include "logging.h"
+#ifdef Q_OS_LINUX
+#include "nativeportbackend.h"
+#endif
+
+static const uint8_t NOT_HEX = 0xFF;
+
+struct HexTable {
+    uint8_t v[256];
+
+    HexTable() {
+        std::fill(v, v + sizeof(v), NOT_HEX);
+        for(int c = '0'; c <= '9'; ++c) v[c] = c - '0';
+        for(int c = 'A'; c <= 'F'; ++c) v[c] = c - 'A' + 10;
+    }
+};
+static const HexTable HEX_TABLE;
 
 Comm::Comm()
-  : state(State::Idle)
+  : port(nullptr), backend(Backend::Qt), portBackend(Backend::Qt),
+    state(State::Idle), framing(Framing::Hex), subState(SubState::Start), framePos(0), rxBuf(&framePool[0]),
+    txScheduled(false), txQueued(0), txWritten(0)
 {
+    readBuf.resize(READBUF_SIZE);
+    for(int i = 0; i < FRAME_POOL_SIZE; ++i)
+        framePool[i].reserve(RXBUF_SIZE);
+    txClock.start();
 }
 
 void Comm::onStart()
 {
     setState(State::Idle);
-    ser = new QSerialPort(this);
-    connect(ser, &QSerialPort::readyRead, this, &Comm::on_readyRead);
+    createPort();
+}
+
+bool Comm::isBackendAvailable(Backend backend)
+{
+#ifdef Q_OS_LINUX
+    (void)backend;
+    return true;
+#else
+    return backend == Backend::Qt;
+#endif
+}
+
+void Comm::setBackend(Comm::Backend backend)
+{
+    if(isBackendAvailable(backend)) this->backend = backend;
+}
+
+void Comm::createPort()
+{
+    delete port;
+#ifdef Q_OS_LINUX
+    if(backend == Backend::Native)
+        port = new NativePortBackend(this);
+    else
+#endif
+        port = new QtPortBackend(this);
+    portBackend = backend;
+
+    connect(port, &PortBackend::readyRead, this, &Comm::on_readyRead);
+    connect(port, &PortBackend::bytesWritten, this, &Comm::on_bytesWritten);
+}
+
+void Comm::startCapture(QString fileName)
+{
+    stopCapture();
+
+    std::unique_ptr<CaptureWriter> w(new CaptureWriter());
+    QString msg;
+    if(!w->open(fileName, msg)) {
+        emit captureError("Cannot write into " + fileName + ": " + msg);
+        return;
+    }
+    captureWriter = std::move(w);
+}
+
+void Comm::stopCapture()
+{
+    captureWriter.reset(); // flushed and closed
+}
+
+void Comm::capture(const QByteArray& frame, qint64 timestamp, bool tx)
+{
+    if(captureWriter->append(frame, timestamp, tx)) return;
+
+    QString msg = captureWriter->getError();
+    stopCapture();
+    emit captureError("Capture stopped: " + msg);
 }
 
 void Comm::portConnect(QString portName)
 {
-    if(ser->isOpen()) portDisconnect();
+    if(port->isOpen()) portDisconnect();
+    if(portBackend != backend) createPort();
 
-    ser->setPortName(portName);
-    ser->setBaudRate(115200);
+    framing = Framing::Hex;
 
-    bool openSuccess = ser->open(QIODevice::ReadWrite);
+    bool openSuccess = port->open(portName, DEFAULT_BAUD_RATE);
     if(!openSuccess)
         emit error("Cannot connect to the port");
     else
@@ -37,123 +116,268 @@ void Comm::setState(State state)
     if(this->state != state) {
         this->state = state;
         resetRx();
+        resetTx();
         emit stateChanged(state);
     }
 }
 
 void Comm::portDisconnect()
 {
-    ser->close();
+    port->close();
     setState(State::Idle);
 }
 
+void Comm::setFraming(Comm::Framing framing)
+{
+    this->framing = framing;
+}
+
+void Comm::setBaudRate(qint32 baudRate)
+{
+    // the port stays open, nothing is lost on the host side
+    if(!port->isOpen()) return;
+
+    if(!port->setBaudRate(baudRate))
+        emit error("Cannot change the baud rate");
+    resetRx(); // a partial frame at the old rate is garbage
+}
+
 void Comm::send(QByteArray data)
 {
-    if(!ser->isOpen()) return;
+    if(!port->isOpen()) return;
 
-    ser->clear();
+    // note: the receive side is not touched, events and responses on the way are kept
+
+    if(captureWriter) capture(data, QDateTime::currentMSecsSinceEpoch(), true);
+
+    char crc = crc8(0, data.constData(), data.size());
 
     QByteArray buf;
-    buf.append('S');
-    buf.append(data.toHex().toUpper());
+    switch(framing) {
+        case Framing::Hex:
+            {
+                buf.append('S');
+                buf.append(data.toHex().toUpper());
+
+                QByteArray crcBuf;
+                crcBuf.append(crc);
+                buf.append(crcBuf.toHex().toUpper());
+
+                buf.append('\r');
+            }
+            break;
+
+        case Framing::Binary:
+            {
+                QByteArray frame = data;
+                frame.append(crc);
+
+                buf.append(SLIP_END);
+                for(auto i = frame.begin(), e = frame.end(); i != e; ++i) {
+                    if(*i == SLIP_END) {
+                        buf.append(SLIP_ESC);
+                        buf.append(SLIP_ESC_END);
+                    }
+                    else if(*i == SLIP_ESC) {
+                        buf.append(SLIP_ESC);
+                        buf.append(SLIP_ESC_ESC);
+                    }
+                    else {
+                        buf.append(*i);
+                    }
+                }
+                buf.append(SLIP_END);
+            }
+            break;
+    }
+
+    txBuf.append(buf);
+    txQueued += buf.size();
+    TxRecord r;
+    r.header = data.isEmpty() ? 0 : data.at(0);
+    r.bytes  = buf.size();
+    r.end    = txQueued;
+    r.queued = txClock.nsecsElapsed();
+    txRecords.append(r);
+    qCDebug(logComm) << "<=" << data.toHex();
+
+    // all requests of this event loop turn go in one write
+    if(!txScheduled) {
+        txScheduled = true;
+        QMetaObject::invokeMethod(this, "flushTx", Qt::QueuedConnection);
+    }
+}
+
+void Comm::flushTx()
+{
+    txScheduled = false;
+    if(txBuf.isEmpty() || !port->isOpen()) return;
+
+    if(port->write(txBuf) != txBuf.size())
+        emit error("Cannot write to the port");
+    txBuf.clear();
+}
 
-    char crc = std::accumulate(data.begin(), data.end(), 0, crc8);
-    QByteArray crcBuf;
-    crcBuf.append(crc);
-    buf.append(crcBuf.toHex().toUpper());
+void Comm::on_bytesWritten(qint64 bytes)
+{
+    txWritten += bytes;
 
-    buf.append('\r');
-    (void)ser->write(buf);
-    qDebug() << "<=" << data.toHex();
+    qint64 now = txClock.nsecsElapsed();
+    int n = 0;
+    while(n < txRecords.size() && txRecords[n].end <= txWritten) {
+        const TxRecord& r = txRecords[n];
+        emit transmitted(r.header, r.bytes, (now - r.queued) / 1000);
+        ++n;
+    }
+    txRecords.remove(0, n);
+}
+
+void Comm::resetTx()
+{
+    txBuf.clear();
+    txRecords.clear();
+    txQueued  = 0;
+    txWritten = 0;
 }
 
 void Comm::on_readyRead()
 {
-    while(!ser->atEnd()) {
-        processRead();
+    for(;;) {
+        qint64 n = port->read(readBuf.data(), readBuf.size());
+        if(n <= 0) break;
+
+        rxTimestamp = port->readTimestamp(); // one timestamp per chunk
+        processRead(readBuf.constData(), n);
     }
 }
 
 void Comm::resetRx()
 {
     subState = SubState::Start;
-    rxBuf.clear();
+    rxBuf->resize(0); // capacity is reserved, no reallocation
+}
+
+void Comm::nextFrame()
+{
+    framePos = (framePos + 1) % FRAME_POOL_SIZE;
+    rxBuf = &framePool[framePos];
+    if(!rxBuf->isDetached()) { // still used by the receiver, take a new one
+        *rxBuf = QByteArray();
+        rxBuf->reserve(RXBUF_SIZE);
+    }
 }
 
 void Comm::processRx()
 {
-    char crc = std::accumulate(rxBuf.begin(), rxBuf.end(), 0, crc8);
+    char crc = crc8(0, rxBuf->constData(), rxBuf->size());
     if(crc == 0) {
-        qDebug() << "=>" << rxBuf.toHex();
-
-        QByteArray buf;
-        buf.append(rxBuf.data(), rxBuf.size()-1);
-        emit data(buf, rxTimestamp);
+        rxBuf->chop(1);
+        if(captureWriter) capture(*rxBuf, frameTimestamp, false);
+        emit data(*rxBuf, frameTimestamp); // shared, not copied
+        nextFrame();
     }
 }
 
-void Comm::processRead()
+void Comm::appendRx(char c)
 {
-    char c;
-    if(!ser->getChar(&c)) return;
+    rxBuf->append(c);
+    if(rxBuf->size() >= RXBUF_SIZE) resetRx();
+}
 
-    switch(state) {
-        case State::Idle:
-            break;
+void Comm::startFrame(SubState s)
+{
+    resetRx();
+    frameTimestamp = rxTimestamp;
+    subState = s;
+}
+
+void Comm::processRead(const char* buf, qint64 size)
+{
+    if(state != State::Connected) return;
+
+    const char* end = buf + size;
+    while(buf < end) {
+        if(subState == SubState::H) {
+            // decode all complete bytes at once
+            while(end - buf >= 2) {
+                uint8_t h = HEX_TABLE.v[(uint8_t)buf[0]];
+                uint8_t l = HEX_TABLE.v[(uint8_t)buf[1]];
+                if((h | l) > 0x0F) break;
+
+                buf += 2;
+                appendRx((char)((h << 4) | l));
+                if(subState != SubState::H) break;
+            }
+            if(buf == end) break;
+        }
 
-        case State::Connected:
-            if(c == 'S') {
+        char c = *buf++;
+
+        if(c == SLIP_END) {
+            if(subState == SubState::Bin && !rxBuf->isEmpty()) { // stop
+                processRx();
                 resetRx();
-                rxTimestamp = QDateTime::currentMSecsSinceEpoch();
-                subState = SubState::H;
             }
-            else {
-                uint8_t v;
-
-                switch(subState) {
-                    case SubState::H:
-                    case SubState::L:
-                        if(c >= '0' && c <= '9') {
-                            v = c - '0';
-                        }
-                        else if(c >= 'A' && c <= 'F') {
-                            v = c - 'A' + 10;
-                        }
-                        else if(c == '\n') { // ignore
-                            break;
-                        }
-                        else if(c == '\r') { // stop
-                            if(subState == SubState::L) {  // unexpected, reset
-                            }
-                            else {
-                                processRx();
-                            }
-                            resetRx();
-
-                            break;
-                        }
-                        else {    // unexpected symbol, reset
-                            resetRx();
-                            break;
-                        }
+            else {                                               // start
+                startFrame(SubState::Bin);
+            }
+            continue;
+        }
+
+        switch(subState) {
+            case SubState::Start:
+                if(c == 'S') startFrame(SubState::H);
+                break; // ignore all other
 
+            case SubState::H:
+            case SubState::L:
+                {
+                    uint8_t v = HEX_TABLE.v[(uint8_t)c];
+                    if(v <= 0x0F) {
                         if(subState == SubState::H) {
-                            rxBuf.append(v << 4);
+                            rxHigh = (v << 4);
                             subState = SubState::L;
                         }
                         else {
-                            rxBuf[rxBuf.size()-1] = (rxBuf.at(rxBuf.size()-1) | (char)v);
                             subState = SubState::H;
-                            if(rxBuf.size() >= RXBUF_SIZE) resetRx();
+                            appendRx((char)(rxHigh | v));
                         }
-
-                        break;
-
-                    case SubState::Start:
-                        break; // ignore all
+                    }
+                    else if(c == 'S') {  // start
+                        startFrame(SubState::H);
+                    }
+                    else if(c == '\n') { // ignore
+                    }
+                    else if(c == '\r') { // stop
+                        if(subState == SubState::L) {  // unexpected, reset
+                        }
+                        else {
+                            processRx();
+                        }
+                        resetRx();
+                    }
+                    else {               // unexpected symbol, reset
+                        resetRx();
+                    }
                 }
-            }
+                break;
 
-            break;
+            case SubState::Bin:
+                if(c == SLIP_ESC)
+                    subState = SubState::BinEsc;
+                else
+                    appendRx(c);
+                break;
+
+            case SubState::BinEsc:
+                subState = SubState::Bin;
+                if(c == SLIP_ESC_END)
+                    appendRx(SLIP_END);
+                else if(c == SLIP_ESC_ESC)
+                    appendRx(SLIP_ESC);
+                else    // unexpected symbol, reset
+                    resetRx();
+                break;
+        }
     }
 }
@@ -1,7 +1,14 @@
 #ifndef COMM_H
 #define COMM_H
 
+#include "portbackend.h"
+#include "capture.h"
+
 #include <QtSerialPort/QtSerialPort>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include <memory>
 
 class Comm : public QObject {
     Q_OBJECT
@@ -12,44 +19,104 @@ public:
         Connected
     };
 
+    enum class Framing {
+        Hex,     // 'S' + hex + hex CRC + '\r'
+        Binary   // SLIP-like: END + escaped(data + CRC) + END
+    };
+
+    enum class Backend {
+        Qt,      // QSerialPort
+        Native   // termios and epoll, Linux only
+    };
+
+    static const char SLIP_END     = (char)0xC0;
+    static const char SLIP_ESC     = (char)0xDB;
+    static const char SLIP_ESC_END = (char)0xDC;
+    static const char SLIP_ESC_ESC = (char)0xDD;
+
+    static const qint32 DEFAULT_BAUD_RATE = 115200; // after connect and after a restart of the device
+
 public:
     Comm();
 
     static const int RXBUF_SIZE = 250;
+    static const int READBUF_SIZE = 4096;
+    static const int FRAME_POOL_SIZE = 16;  // frames which can be in the receiver's queue without reallocation
+
+    static bool isBackendAvailable(Backend backend);
 
 public slots:
     void onStart();
     void portConnect(QString portName);
     void portDisconnect();
     void send(QByteArray data);
+    void setFraming(Comm::Framing framing);
+    void setBaudRate(qint32 baudRate);
+    void setBackend(Comm::Backend backend); // used by the next connect
+    void startCapture(QString fileName);
+    void stopCapture();
 
 signals:
     void error(QString msg);
     void data(QByteArray d, qint64 timestamp);
     void stateChanged(Comm::State state);
+    void transmitted(char header, int bytes, qint64 delayUs); // bytes on the wire, delay from send() until taken by the driver
+    void captureError(QString msg); // the capture is stopped
 
 private slots:
     void on_readyRead();
+    void on_bytesWritten(qint64 bytes);
+    void flushTx();
 
 private:
+    struct TxRecord {
+        char header;    // first byte of the command
+        int bytes;      // framing included
+        qint64 end;     // offset of the end in the transmitted stream
+        qint64 queued;  // ns, txClock
+    };
+
     enum class SubState {
         Start,
         H,
-        L
+        L,
+        Bin,
+        BinEsc
     };
 
 private:
     void setState(State state);
-    void processRead();
+    void processRead(const char* buf, qint64 size);
     void resetRx();
     void processRx();
+    void appendRx(char c);
+    void startFrame(SubState s);
+    void nextFrame();
+    void resetTx();
+    void createPort();
+    void capture(const QByteArray& frame, qint64 timestamp, bool tx);
 
 private:
-    QSerialPort *ser;
+    PortBackend *port;
+    Backend backend;
+    Backend portBackend;   // of port
     State state;
+    Framing framing;
     SubState subState;
-    QByteArray rxBuf;
-    qint64 rxTimestamp;
+    QByteArray readBuf;
+    QByteArray framePool[FRAME_POOL_SIZE];
+    int framePos;
+    QByteArray* rxBuf;     // frame in progress, one of framePool
+    uint8_t rxHigh;
+    qint64 rxTimestamp;    // of the last read chunk
+    qint64 frameTimestamp;
+    QByteArray txBuf;      // frames sent in this event loop turn, written at once
+    bool txScheduled;
+    QVector<TxRecord> txRecords; // not taken by the driver yet
+    qint64 txQueued;       // bytes
+    qint64 txWritten;      // bytes
+    QElapsedTimer txClock;
+    std::unique_ptr<CaptureWriter> captureWriter; // null - not capturing
 };
 
 #endif // COMM_H
@@ -0,0 +1,49 @@
+#include "commpool.h"
+
+#include <algorithm>
+
+// =============================================================================================================
+
+CommPool::CommPool(int threadCount)
+{
+    threadCount = std::max(threadCount, 1);
+    for(int i = 0; i < threadCount; ++i) {
+        threads.emplace_back(new QThread());
+        threads.back()->setObjectName(QString("comm%1").arg(i));
+        threads.back()->start();
+        load.append(0);
+    }
+}
+
+CommPool::~CommPool()
+{
+    for(auto& t : threads)
+        t->quit();
+    for(auto& t : threads)
+        t->wait();
+}
+
+Comm* CommPool::create()
+{
+    int t = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+
+    Comm* comm = new Comm();
+    comm->moveToThread(threads[t].get());
+    QObject::connect(threads[t].get(), &QThread::finished, comm, &Comm::deleteLater);
+    QMetaObject::invokeMethod(comm, "onStart", Qt::QueuedConnection); // before any queued request
+
+    ++load[t];
+    assigned.insert(comm, t);
+    return comm;
+}
+
+void CommPool::release(Comm* comm)
+{
+    auto i = assigned.find(comm);
+    if(i == assigned.end()) return;
+
+    --load[i.value()];
+    assigned.erase(i);
+    QMetaObject::invokeMethod(comm, "portDisconnect", Qt::QueuedConnection);
+    comm->deleteLater();
+}
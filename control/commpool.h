@@ -0,0 +1,34 @@
+#ifndef COMMPOOL_H
+#define COMMPOOL_H
+
+#include "comm.h"
+
+#include <QThread>
+#include <QVector>
+#include <QHash>
+
+#include <memory>
+#include <vector>
+
+// Threads shared by Comm objects. A Comm only waits for its port, so a few threads
+// serve many devices and the cost per device doesn't grow with the thread count.
+class CommPool
+{
+public:
+    explicit CommPool(int threads);
+    ~CommPool();
+
+    Comm* create();           // started in the least loaded thread
+    void release(Comm* comm); // deleted in its thread
+
+    int threadCount() const { return (int)threads.size(); }
+
+private:
+    Q_DISABLE_COPY(CommPool)
+
+    std::vector<std::unique_ptr<QThread>> threads;
+    QVector<int> load;        // comms per thread
+    QHash<Comm*, int> assigned;
+};
+
+#endif // COMMPOOL_H
@@ -1,8 +1,39 @@
 #include "crc.h"
 
+#include <stdint.h>
+
+static const int SLICES = 4;
+
+struct Crc8Table {
+    uint8_t t[SLICES][256]; // t[k][x] == CRC of x followed by k zero bytes
+
+    Crc8Table() {
+        for(int x = 0; x < 256; ++x) {
+            uint8_t crc = x;
+            for(int i = 0; i < 8; ++i)
+                crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+            t[0][x] = crc;
+        }
+        for(int k = 1; k < SLICES; ++k)
+            for(int x = 0; x < 256; ++x)
+                t[k][x] = t[0][t[k-1][x]];
+    }
+};
+static const Crc8Table TABLE;
+
 char crc8(char crc, char b) {
-    crc ^= b;
-    for(char i = 0; i < 8; ++i)
-        crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
-    return crc;
+    return TABLE.t[0][(uint8_t)(crc ^ b)];
+}
+
+char crc8(char crc, const char* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint8_t c = crc;
+
+    for(; size >= SLICES; size -= SLICES, p += SLICES) {
+        c = TABLE.t[3][c ^ p[0]] ^ TABLE.t[2][p[1]] ^ TABLE.t[1][p[2]] ^ TABLE.t[0][p[3]];
+    }
+    for(; size > 0; --size, ++p)
+        c = TABLE.t[0][c ^ *p];
+
+    return c;
 }
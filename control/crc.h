@@ -1,6 +1,11 @@
 #ifndef CRC_H
 #define CRC_H
 
+#include <stddef.h>
+
 char crc8(char crc, char b);
 
+// the same CRC-8 (poly 0x07) over a whole buffer, table-driven, 4 bytes per step
+char crc8(char crc, const char* data, size_t size);
+
 #endif // CRC_H
@@ -0,0 +1,256 @@
+#include "csvexporter.h"
+
+#include <QDateTime>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// =============================================================================================================
+
+static const qint64 POW10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+static const int MAX_ROW = 256;  // bytes of one formatted row at most
+
+static char* putUInt(char* p, quint64 v, int minDigits = 1)
+{
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while(v || n < minDigits);
+    while(n) *p++ = tmp[--n];
+    return p;
+}
+
+static char* putInt(char* p, qint64 v)
+{
+    if(v < 0) {
+        *p++ = '-';
+        return putUInt(p, 0 - (quint64)v);
+    }
+    return putUInt(p, (quint64)v);
+}
+
+// fixed point, rounded half away from zero like printf
+static char* putFixed(char* p, double v, int precision)
+{
+    double a = std::fabs(v);
+    if(!(a < 1e15)) // also NaN and inf
+        return p + snprintf(p, 32, "%.*f", precision, v);
+
+    quint64 scaled = (quint64)(a * POW10[precision] + 0.5);
+    if(v < 0 && scaled) *p++ = '-';
+    p = putUInt(p, scaled / POW10[precision]);
+    if(precision) {
+        *p++ = '.';
+        p = putUInt(p, scaled % POW10[precision], precision);
+    }
+    return p;
+}
+
+// local date and time of the minute, the seconds are the same in all zones
+class DateCache
+{
+public:
+    explicit DateCache(CsvExporter::Options::Time time_) : time(time_), minute(0), valid(false), len(0) {}
+
+    char* put(char* p, qint64 timestamp)
+    {
+        qint64 m = timestamp >= 0 ? timestamp / 60000 : -((-timestamp + 59999) / 60000);
+        if(!valid || m != minute) {
+            QString s = QDateTime::fromMSecsSinceEpoch(m * 60000).toString(
+                time == CsvExporter::Options::Time::Iso ? "yyyy-MM-ddThh:mm" : "dd.MM.yyyy hh:mm");
+            QByteArray b = s.toLatin1();
+            len = std::min(b.size(), (int)sizeof(prefix));
+            memcpy(prefix, b.constData(), len);
+            minute = m;
+            valid = true;
+        }
+
+        int ms = (int)(timestamp - minute * 60000);
+        memcpy(p, prefix, len);
+        p += len;
+        *p++ = (time == CsvExporter::Options::Time::Iso ? ':' : '.');
+        p = putUInt(p, ms / 1000, 2);
+        *p++ = '.';
+        return putUInt(p, ms % 1000, 3);
+    }
+
+private:
+    CsvExporter::Options::Time time;
+    qint64 minute;
+    bool valid;
+    char prefix[32];
+    int len;
+};
+
+// =============================================================================================================
+
+CsvExporter::CsvExporter(QObject *parent) :
+    QObject(parent),
+    coldCount(0),
+    begin(0),
+    cancelled(false),
+    complete(false),
+    elapsedMs(0)
+{
+}
+
+CsvExporter::~CsvExporter()
+{
+    stop();
+}
+
+bool CsvExporter::start(const QString& fileName, const SampleStorage& storage, const Options& options, QString& error)
+{
+    if(isRunning()) {
+        error = "Another export is running";
+        return false;
+    }
+
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        error = file.errorString();
+        return false;
+    }
+
+    // the storage goes on changing while the worker writes
+    coldCount = storage.getCold();
+    cold = storage.coldViews();
+    storage.copyRing(ring);
+    begin = storage.getBegin();
+
+    this->options = options;
+    this->options.precision = std::max(0, std::min(options.precision, (int)MAX_PRECISION));
+    this->error.clear();
+    cancelled = false;
+    complete = false;
+    clock.start();
+    worker = std::thread(&CsvExporter::run, this);
+    return true;
+}
+
+void CsvExporter::cancel()
+{
+    cancelled = true; // finished() follows
+}
+
+void CsvExporter::stop()
+{
+    if(!isRunning()) return;
+
+    cancelled = true;
+    worker.join();
+    if(complete)
+        file.close();
+    else
+        file.remove();
+}
+
+void CsvExporter::done()
+{
+    worker.join();
+    bool wasCancelled = !complete && cancelled;
+    if(wasCancelled)
+        file.remove();
+    else
+        file.close();
+
+    qint64 rows = (qint64)(coldCount + ring.size());
+    ring = SampleStorage::Columns();
+    cold.clear();
+    emit finished(error.isEmpty(), error, wasCancelled, rows, elapsedMs);
+}
+
+void CsvExporter::run()
+{
+    const char d = options.delimiter;
+    const int precision = options.precision;
+    std::vector<char> block(BLOCK_SIZE + MAX_ROW);
+    char* p = block.data();
+    DateCache dates(options.time);
+
+    auto flush = [this, &block, &p]() {
+        qint64 size = p - block.data();
+        if(file.write(block.data(), size) != size) {
+            error = file.errorString();
+            return false;
+        }
+        p = block.data();
+        return true;
+    };
+
+    p += snprintf(p, MAX_ROW, "\"Timestamp\"%c\"Time, s\"%c\"Current, A\"%c\"Voltage, V\"%c\"Energy, Ah\"%c\"Energy, Wh\"\n",
+                  d, d, d, d, d);
+
+    size_t len = coldCount + ring.size();
+    size_t row = 0;
+    int lastPercent = -1;
+    auto put = [&](const Sample& s) {
+        if(options.time == Options::Time::Epoch)
+            p = putInt(p, s.timestamp);
+        else
+            p = dates.put(p, s.timestamp);
+        *p++ = d;
+        p = putFixed(p, (double)(s.timestamp - begin) / 1000.0, 3);
+        *p++ = d;
+        p = putFixed(p, s.i, precision);
+        *p++ = d;
+        p = putFixed(p, s.u, precision);
+        *p++ = d;
+        p = putFixed(p, s.ah, precision);
+        *p++ = d;
+        p = putFixed(p, s.wh, precision);
+        *p++ = '\n';
+        ++row;
+
+        if(p - block.data() >= BLOCK_SIZE) {
+            if(!flush()) return false;
+
+            int percent = (int)(100 * row / len);
+            if(percent != lastPercent) {
+                lastPercent = percent;
+                emit progress(percent);
+            }
+        }
+        return true;
+    };
+
+    // archived and spilled samples chunk by chunk
+    QByteArray buf;
+    QVector<Sample> chunk;
+    for(const SampleSpill::View& view : cold) {
+        size_t total = 0;
+        for(const SessionChunk& s : view.index)
+            total += s.count;
+        if(total <= view.dropped || !error.isEmpty() || cancelled) continue;
+
+        size_t skip = view.dropped;
+        QFile in(view.fileName);
+        if(!in.open(QIODevice::ReadOnly)) error = in.errorString();
+        for(int c = 0; c < view.index.size() && error.isEmpty() && !cancelled; ++c) {
+            if(skip >= view.index[c].count) {
+                skip -= view.index[c].count;
+                continue;
+            }
+            if(!SampleSpill::readChunk(in, view.index[c], buf, chunk)) {
+                error = "Cannot read samples from " + view.fileName;
+                break;
+            }
+            for(int k = (int)skip; k < chunk.size() && !cancelled; ++k)
+                if(!put(chunk[k])) break;
+            skip = 0;
+        }
+    }
+
+    for(size_t k = 0; k < ring.size() && error.isEmpty() && !cancelled; ++k)
+        if(!put(ring.sample(k))) break;
+
+    if(error.isEmpty() && !cancelled && flush()) complete = true;
+
+    elapsedMs = clock.elapsed();
+    QMetaObject::invokeMethod(this, "done", Qt::QueuedConnection);
+}
@@ -0,0 +1,74 @@
+#ifndef CSVEXPORTER_H
+#define CSVEXPORTER_H
+
+#include "sample.h"
+#include "samplestorage.h"
+
+#include <QObject>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include <atomic>
+#include <thread>
+
+// Writes a snapshot of the storage into a CSV file on a worker thread.
+// Archived and spilled samples are not copied, the worker reads their chunks from the files;
+// the ring is copied as its quantized columns and decoded by the worker.
+// Rows are formatted into a large block without QString, the date part of timestamps is formatted once a minute.
+class CsvExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        enum class Time {
+            DateTime,   // dd.MM.yyyy hh:mm.ss.zzz, local, the same as always
+            Iso,        // yyyy-MM-ddThh:mm:ss.zzz, local
+            Epoch       // ms since epoch
+        };
+
+        Time time;
+        char delimiter;
+        int precision;  // digits after the point of measured values
+
+        Options() : time(Time::DateTime), delimiter(','), precision(3) {}
+    };
+
+    static const int MAX_PRECISION = 6;
+    static const int BLOCK_SIZE = 1024 * 1024; // written at once
+
+public:
+    explicit CsvExporter(QObject *parent = 0);
+    ~CsvExporter();   // cancels silently
+
+    bool start(const QString& fileName, const SampleStorage& storage, const Options& options, QString& error);
+    void cancel();    // the partial file is removed, finished() follows
+    bool isRunning() const { return worker.joinable(); }
+
+signals:
+    void progress(double percent);
+    void finished(bool ok, QString error, bool cancelled, qint64 rows, qint64 elapsedMs);
+
+private slots:
+    void done();      // the worker has finished
+
+private:
+    void run();
+    void stop();
+
+private:
+    QFile file;
+    SampleStorage::Columns ring;  // the snapshot of the samples in memory
+    QVector<SampleSpill::View> cold; // and of the ones before them on disk
+    size_t coldCount;
+    qint64 begin;
+    Options options;
+    std::thread worker;
+    std::atomic<bool> cancelled;
+    bool complete;                // all rows written, set by the worker
+    QString error;                // set by the worker
+    qint64 elapsedMs;
+    QElapsedTimer clock;
+};
+
+#endif // CSVEXPORTER_H
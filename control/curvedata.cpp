@@ -1,17 +1,35 @@
 #include "curvedata.h"
 
+#include <QWidget>
+
+#include <algorithm>
+#include <cmath>
+
 // =============================================================================================================
 
-CurveData::CurveData(SampleStorage& storage_)
-    : storage(storage_)
+CurveData::CurveData(SampleStorage& storage_, const ChannelLod& lods_, Channel channel_)
+    : storage(storage_),
+      lods(lods_),
+      channel(channel_),
+      lod(lods_.lod(channel_)),
+      canvas(nullptr),
+      dirty(true),
+      width(0),
+      reshaped(true),
+      builtFrom(0),
+      builtTo(0),
+      builtLevel(-1),
+      tailFrom(0),
+      tailPoints(0),
+      stable(0),
+      redraw(true)
 {
-    cleared();
-
+    // the levels of detail are kept by lods, connected to the storage before
     connect(&storage, &SampleStorage::afterClear, this, &CurveData::cleared);
-    connect(&storage, &SampleStorage::afterAppend, this, &CurveData::added);
-    connect(&storage, &SampleStorage::afterAppendMultiple, this, &CurveData::addedMultiple);
-    // note: SampleStorage::afterDelete is not connected
-    //       - min/max value will not be recalculated when samples are deleted via limit
+    connect(&storage, &SampleStorage::afterAppend, this, &CurveData::changed);
+    connect(&storage, &SampleStorage::afterAppendMultiple, this, &CurveData::changed);
+    connect(&storage, &SampleStorage::afterDelete, this, &CurveData::changed);
+    connect(&storage, &SampleStorage::afterOpenSession, this, &CurveData::changed);
 }
 
 CurveData::~CurveData()
@@ -20,47 +38,178 @@ CurveData::~CurveData()
 
 QPointF CurveData::sample(size_t i) const
 {
-    const Sample& s = storage.sample(i);
-    return QPointF((qreal)(s.timestamp - begin)/1000.0, s.u);
+    update();
+    return points[(int)i];
+}
+
+size_t CurveData::size() const
+{
+    update();
+    return (size_t)points.size();
+}
+
+double CurveData::value(size_t i) const
+{
+    switch(channel) {
+        case Channel::Voltage: return storage.voltage(i);
+        case Channel::Current: return storage.current(i);
+        case Channel::Energy:  return storage.energy(i);
+        default:               return ChannelLod::derive(channel, storage.voltage(i), storage.current(i));
+    }
+}
+
+QPointF CurveData::point(size_t i) const
+{
+    return QPointF(x(storage.timestamp(i)), value(i));
+}
+
+qreal CurveData::x(qint64 timestamp) const
+{
+    return (qreal)(timestamp - lods.getBegin())/1000.0;
+}
+
+SampleLod::Bucket CurveData::scan(size_t from, size_t to) const
+{
+    SampleLod::Bucket b = SampleLod::EMPTY;
+    for(size_t i = from; i < to; ++i)
+        SampleLod::add(b, storage.timestamp(i), (float)value(i));
+    return b;
 }
 
 QRectF CurveData::boundingRect() const
 {
-    if(storage.size() == 0)
+    SampleLod::Bucket b = lod.bounds();
+    if(storage.size() == 0 || b.min > b.max)
         return QRectF();
 
-    const Sample& first = storage.sample(0);
-    const Sample& last = storage.sample(storage.size()-1);
+    qint64 first = storage.timestamp(0);
+    qint64 last = storage.timestamp(storage.size()-1);
+    double minValue = b.min;
+    double maxValue = b.max;
 
-    return QRectF((qreal)(first.timestamp - begin)/1000.0, minValue,
-                  (qreal)(last.timestamp - first.timestamp)/1000.0, maxValue - minValue);
+    return QRectF((qreal)(first - lods.getBegin())/1000.0, minValue,
+                  (qreal)(last - first)/1000.0, maxValue - minValue);
 }
 
-void CurveData::cleared()
+void CurveData::setRectOfInterest(const QRectF& rect)
 {
-    begin = 0;
-    minValue = 0.0;
-    maxValue = 0.0;
+    if(rect == interest) return;
+    interest = rect;
+    dirty = true;
+    reshaped = true;
 }
 
-void CurveData::added(const Sample& sample)
+size_t CurveData::stablePoints() const
 {
-    double value = sample.u;
-    if(value == std::numeric_limits<double>::infinity()) value = 0.0;
+    update();
+    return stable;
+}
 
-    if(!begin) {
-        begin = sample.timestamp;
-        minValue = value;
-        maxValue = value;
+bool CurveData::isRedrawNeeded() const
+{
+    update();
+    return redraw;
+}
+
+void CurveData::markDrawn() const
+{
+    update();
+    stable = (size_t)points.size();
+    redraw = false;
+}
+
+void CurveData::update() const
+{
+    int w = canvas ? std::max(canvas->width(), 1) : DEFAULT_WIDTH;
+    if(!dirty && w == width) return;
+    if(w != width) reshaped = true;
+    dirty = false;
+    width = w;
+
+    bool wasReshaped = reshaped;
+    reshaped = true; // until something is built
+    size_t n = storage.size();
+
+    // the visible samples and one more at each side, so that the lines go on to the edges
+    size_t from = 0;
+    size_t to = n;
+    if(n && interest.width() > 0) {
+        qint64 begin = lods.getBegin();
+        from = storage.lowerBound(begin + (qint64)std::floor(interest.left() * 1000.0));
+        to = storage.lowerBound(begin + (qint64)std::ceil(interest.right() * 1000.0));
+        if(from > 0) --from;
+        if(to < n) ++to;
+    }
+    if(from >= to) {
+        points.clear();
+        stable = 0;
+        redraw = true;
+        return;
+    }
+
+    int level = lod.levelFor(to - from, w);
+    if(level >= 0 && level < lod.getFinest() && to - from > MAX_SCAN) level = lod.getFinest();
+    bool scanned = (level >= 0 && level < lod.getFinest()); // the buckets from the samples, chunks decoded as they are read
+    size_t removed = lods.getRemoved();
+    size_t i = from;
+    if(!wasReshaped && removed + from == builtFrom && level == builtLevel && removed + to >= builtTo) {
+        // appended only: raw points stay, bucket points up to the last bucket, which may have changed
+        if(level >= 0) {
+            i = tailFrom - removed;
+            points.resize(tailPoints);
+        }
+        else {
+            i = builtTo - removed;
+        }
+        stable = std::min(stable, (size_t)points.size());
     }
     else {
-        if(value < minValue) minValue = value;
-        if(value > maxValue) maxValue = value;
+        points.clear();
+        stable = 0;
+        redraw = true;
+    }
+    reshaped = false;
+    builtFrom = removed + from;
+    builtTo = removed + to;
+    builtLevel = level;
+
+    if(level < 0) {
+        points.reserve(points.size() + (int)(to - i));
+        for(; i < to; ++i) {
+            QPointF p = point(i);
+            if(!std::isnan(p.y())) points.append(p);
+        }
+        return;
+    }
+
+    // first, min, max and last of every bucket: the line looks the same as drawn through all samples
+    points.reserve(points.size() + (int)(((to - i) >> level) + 2) * 4);
+    while(i < to) {
+        size_t end = scanned ? std::min((((removed + i) >> level) + 1) << level, removed + n) - removed
+                             : lod.bucketEnd(level, i);
+        SampleLod::Bucket b = scanned ? scan(i, end) : lod.bucket(level, i);
+        tailFrom = removed + i;
+        tailPoints = points.size();
+        if(b.min <= b.max) {
+            qreal first = x(b.firstTime);
+            qreal last = x(b.lastTime);
+            qreal middle = (first + last) / 2;
+            points.append(QPointF(first, b.first));
+            points.append(QPointF(middle, b.min));
+            points.append(QPointF(middle, b.max));
+            points.append(QPointF(last, b.last));
+        }
+        i = end;
     }
 }
 
-void CurveData::addedMultiple(const QVector<Sample> &list)
+void CurveData::cleared()
+{
+    dirty = true;
+    reshaped = true;
+}
+
+void CurveData::changed()
 {
-    for(auto i = list.begin(), e = list.end(); i != e; ++i)
-        added(*i);
+    dirty = true;
 }
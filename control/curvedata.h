@@ -2,35 +2,82 @@
 #define CURVEDATA_H
 
 #include "samplestorage.h"
+#include "channellod.h"
 
 #include <qwt_series_data.h>
 
 #include <QObject>
+#include <QVector>
 
+class QWidget;
+
+// A channel of the samples as a curve, its level of detail is shared with the other curves of the channel.
+// The curve gets only the visible samples, reduced to about 4 points per pixel column of the canvas
+// from the level of detail when there are too many of them; the samples are not read then, unless the
+// level needed is finer than the finest one kept (an opened session is summarized by chunks). Points are
+// rebuilt lazily when the data, the visible range or the canvas width changes, only from the last
+// bucket on when samples were just appended.
+// The bounding rect is the bounds of the level of detail, so it follows the samples deleted by the limit.
+// While only samples are appended the leading points stay the same, stablePoints() tells how many of them,
+// so that only the rest has to be drawn.
 class CurveData: public QObject, public QwtSeriesData<QPointF>
 {
     Q_OBJECT
 
 public:
-    CurveData(SampleStorage& storage_);
+    typedef ChannelLod::Channel Channel;
+
+    static const int DEFAULT_WIDTH = 1000; // pixels, without a canvas
+    static const size_t MAX_SCAN = 1 << 20; // samples read for a level finer than the finest one kept
+
+public:
+    CurveData(SampleStorage& storage_, const ChannelLod& lods_, Channel channel_ = Channel::Voltage);
     ~CurveData();
 
+    Channel getChannel() const { return channel; }
+
     QPointF sample(size_t i) const override;
-    size_t size() const override { return storage.size(); }
+    size_t size() const override;
     QRectF boundingRect() const override;
+    void setRectOfInterest(const QRectF& rect) override;
+
+    void setCanvas(const QWidget* canvas) { this->canvas = canvas; }
+
+    size_t stablePoints() const;      // leading points not changed since markDrawn()
+    bool isRedrawNeeded() const;      // not only appended since markDrawn()
+    void markDrawn() const;
 
 public slots:
     void cleared();
-    void added(const Sample& sample);
-    void addedMultiple(const QVector<Sample> &list);
+    void changed();                   // appended or deleted
+
+private:
+    double value(size_t i) const;    // NaN - none
+    QPointF point(size_t i) const;
+    qreal x(qint64 timestamp) const;
+    SampleLod::Bucket scan(size_t from, size_t to) const;
+    void update() const;
 
 private:
     SampleStorage& storage;
-    qint64 begin;
-    double minValue;
-    double maxValue;
+    const ChannelLod& lods;
+    Channel channel;
+    const SampleLod& lod;
+
+    const QWidget* canvas;
+    QRectF interest;                  // invalid - everything
+    mutable QVector<QPointF> points;
+    mutable bool dirty;
+    mutable int width;                // of the canvas the points were built for
+    mutable bool reshaped;            // range or width changed since the last build
+    mutable size_t builtFrom;         // number of the first sample since clear()
+    mutable size_t builtTo;           // after the last one
+    mutable int builtLevel;
+    mutable size_t tailFrom;          // number of the first sample of the last bucket
+    mutable int tailPoints;           // before the last bucket
+    mutable size_t stable;
+    mutable bool redraw;
 };
 
 
 #endif // CURVEDATA_H
-
@@ -62,6 +62,8 @@ QByteArray formCmdData(const CmdData& data)
             {
                 const CmdFlowStateData& d = static_cast<const CmdFlowStateData&>(data);
                 stream << d.interval;
+                if(d.flags || d.batch) stream << d.flags;
+                if(d.batch) stream << d.batch;
             }
             break;
 
@@ -72,6 +74,27 @@ QByteArray formCmdData(const CmdData& data)
             }
             break;
 
+        case Cmd::Framing:
+            {
+                const CmdFramingData& d = static_cast<const CmdFramingData&>(data);
+                stream << (uint8_t)(d.binary ? 1 : 0);
+            }
+            break;
+
+        case Cmd::Baud:
+            {
+                const CmdBaudData& d = static_cast<const CmdBaudData&>(data);
+                stream << d.baud;
+            }
+            break;
+
+        case Cmd::Stream:
+            {
+                const CmdStreamData& d = static_cast<const CmdStreamData&>(data);
+                stream << (uint8_t)(d.enable ? 1 : 0);
+            }
+            break;
+
         case Cmd::ReadConfig:
         case Cmd::ReadSettings:
         case Cmd::GetVersion:
@@ -86,96 +109,218 @@ QByteArray formCmdData(const CmdData& data)
     return res;
 }
 
-CmdData* parseCmdData(const QByteArray& data)
+// big-endian loads from a frame, which size is already checked
+struct FrameReader {
+    const uint8_t* p;
+
+    FrameReader(const QByteArray& data) : p((const uint8_t*)data.constData() + 1) {} // skip command byte
+
+    uint8_t u8() {
+        return *p++;
+    }
+
+    uint16_t u16() {
+        uint16_t v = ((uint16_t)p[0] << 8) | p[1];
+        p += 2;
+        return v;
+    }
+
+    uint32_t u32() {
+        uint32_t v = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        p += 4;
+        return v;
+    }
+
+    bool atEnd(const QByteArray& data) const {
+        return p == (const uint8_t*)data.constData() + data.size();
+    }
+
+    // little-endian base-128, the size is not known in advance
+    bool varint(const QByteArray& data, uint16_t& v) {
+        const uint8_t* end = (const uint8_t*)data.constData() + data.size();
+        v = 0;
+        for(int shift = 0; shift < 16; shift += 7) {
+            if(p >= end) return false;
+            uint8_t b = *p++;
+            v |= (uint16_t)(b & 0x7F) << shift;
+            if(!(b & 0x80)) return true;
+        }
+        return false;
+    }
+};
+
+bool parseCmdHeader(const QByteArray& data, Cmd& cmd, CmdState& state)
 {
-    if(data.isEmpty()) return nullptr;
+    if(data.isEmpty()) return false;
 
-    QDataStream stream(data);
-    stream.setByteOrder(QDataStream::ByteOrder::BigEndian);
+    uint8_t c = data.at(0);
+    cmd   = (Cmd)(c & 0x1F);
+    state = (CmdState)(c & 0xE0);
+    return true;
+}
 
-    uint8_t c;
-    stream >> c;
-    Cmd      cmd   = (Cmd)(c & 0x1F);
-    CmdState state = (CmdState)(c & 0xE0);
+static bool parseHeader(const QByteArray& data, int size, CmdData& res)
+{
+    if(data.size() != size) return false;
+    return parseCmdHeader(data, res.cmd, res.state);
+}
 
-    switch(cmd) {
-        case Cmd::ReadConfig:
-            {
-                if(data.size() != 66) return nullptr;
-
-                CmdConfigData* res = new CmdConfigData(cmd, state);
-                stream >> res->iSetCoef.offset;
-                stream >> res->iSetCoef.mul;
-                stream >> res->iSetCoef.div;
-                stream >> res->uCurCoef.offset;
-                stream >> res->uCurCoef.mul;
-                stream >> res->uCurCoef.div;
-                stream >> res->uSenseCoef.offset;
-                stream >> res->uSenseCoef.mul;
-                stream >> res->uSenseCoef.div;
-                stream >> res->uSupMin;
-                stream >> res->tempThreshold;
-                stream >> res->tempFanLow;
-                stream >> res->tempFanMid;
-                stream >> res->tempFanFull;
-                stream >> res->tempLimit;
-                stream >> res->tempDefect;
-                stream >> res->iSetMin;
-                stream >> res->iSetMax;
-                stream >> res->uSetMin;
-                stream >> res->uSetMax;
-                stream >> res->uSenseMin;
-                stream >> res->uNegative;
-                stream >> res->uMainLimit;
-                stream >> res->powLimit;
-                stream >> res->ahMax;
-                stream >> res->whMax;
-                stream >> res->fun;
-                stream >> res->beepOn;
-                stream >> res->uSet;
-                stream >> res->iSet;
-                stream >> res->curUnit;
-                return res;
-            }
+bool parseCmdData(const QByteArray& data, CmdData& res)
+{
+    return parseHeader(data, CMD_SIZE_EMPTY, res);
+}
 
-        case Cmd::ReadSettings:
-            {
-                if(data.size() != 5) return nullptr;
+bool parseCmdData(const QByteArray& data, CmdConfigData& res)
+{
+    if(!parseHeader(data, CMD_SIZE_CONFIG, res)) return false;
 
-                CmdSettingData* res = new CmdSettingData(cmd, state);
-                stream >> res->u;
-                stream >> res->i;
-                return res;
-            }
+    FrameReader r(data);
+    res.iSetCoef.offset   = r.u16();
+    res.iSetCoef.mul      = r.u16();
+    res.iSetCoef.div      = r.u16();
+    res.uCurCoef.offset   = r.u16();
+    res.uCurCoef.mul      = r.u16();
+    res.uCurCoef.div      = r.u16();
+    res.uSenseCoef.offset = r.u16();
+    res.uSenseCoef.mul    = r.u16();
+    res.uSenseCoef.div    = r.u16();
+    res.uSupMin           = r.u16();
+    res.tempThreshold     = r.u16();
+    res.tempFanLow        = r.u16();
+    res.tempFanMid        = r.u16();
+    res.tempFanFull       = r.u16();
+    res.tempLimit         = r.u16();
+    res.tempDefect        = r.u16();
+    res.iSetMin           = r.u16();
+    res.iSetMax           = r.u16();
+    res.uSetMin           = r.u16();
+    res.uSetMax           = r.u16();
+    res.uSenseMin         = r.u16();
+    res.uNegative         = r.u16();
+    res.uMainLimit        = r.u16();
+    res.powLimit          = r.u32();
+    res.ahMax             = r.u32();
+    res.whMax             = r.u32();
+    res.fun               = r.u8();
+    res.beepOn            = r.u8();
+    res.uSet              = r.u16();
+    res.iSet              = r.u16();
+    res.curUnit           = r.u8();
+    assert(r.atEnd(data));
+    return true;
+}
 
-        case Cmd::GetVersion:
-            {
-                if(data.size() != 5) return nullptr;
+bool parseCmdData(const QByteArray& data, CmdSettingData& res)
+{
+    if(!parseHeader(data, CMD_SIZE_SETTINGS, res)) return false;
 
-                CmdVersionData* res = new CmdVersionData(cmd, state);
-                stream >> res->v;
-                return res;
-            }
+    FrameReader r(data);
+    res.u = r.u16();
+    res.i = r.u16();
+    assert(r.atEnd(data));
+    return true;
+}
 
-        case Cmd::GetState:
-            {
-                if(data.size() != 19) return nullptr;
-
-                CmdStateData* res = new CmdStateData(cmd, state);
-                uint8_t mode;
-                stream >> mode;
-                stream >> res->error;
-                stream >> res->uMain;
-                stream >> res->uSense;
-                stream >> res->tempRaw;
-                stream >> res->uSupRaw;
-                stream >> res->ah;
-                stream >> res->wh;
-                res->mode = (DeviceMode)mode;
-                return res;
-            }
+bool parseCmdData(const QByteArray& data, CmdVersionData& res)
+{
+    if(!parseHeader(data, CMD_SIZE_VERSION, res)) return false;
 
-        default:
-            return nullptr;
+    FrameReader r(data);
+    res.v = r.u32();
+    assert(r.atEnd(data));
+    return true;
+}
+
+bool parseCmdData(const QByteArray& data, CmdBaudData& res)
+{
+    if(!parseHeader(data, CMD_SIZE_BAUD, res)) return false;
+
+    FrameReader r(data);
+    res.baud = r.u32();
+    assert(r.atEnd(data));
+    return true;
+}
+
+bool parseCmdData(const QByteArray& data, CmdStateData& res)
+{
+    if(data.size() != CMD_SIZE_STATE && data.size() != CMD_SIZE_STATE_EXT) return false;
+    if(!parseCmdHeader(data, res.cmd, res.state)) return false;
+
+    FrameReader r(data);
+    res.mode    = (DeviceMode)r.u8();
+    res.error   = r.u8();
+    res.uMain   = r.u16();
+    res.uSense  = r.u16();
+    res.tempRaw = r.u16();
+    res.uSupRaw = r.u16();
+    res.ah      = r.u32();
+    res.wh      = r.u32();
+    res.extended = (data.size() == CMD_SIZE_STATE_EXT);
+    if(res.extended) {
+        res.seq = r.u16();
+        res.ms  = r.u32();
+    }
+    else {
+        res.seq = 0;
+        res.ms  = 0;
+    }
+    assert(r.atEnd(data));
+    return true;
+}
+
+bool parseCmdData(const QByteArray& data, CmdStateBatchData& res)
+{
+    if(data.size() < CMD_SIZE_STATE_BATCH_HEADER) return false;
+    if((data.size() - CMD_SIZE_STATE_BATCH_HEADER) % CMD_SIZE_STATE_BATCH_SAMPLE != 0) return false;
+    if(!parseCmdHeader(data, res.cmd, res.state)) return false;
+
+    FrameReader r(data);
+    CmdStateData last(Cmd::GetState, res.state);
+    res.mode      = (DeviceMode)r.u8();
+    last.error    = r.u8();
+    last.tempRaw  = r.u16();
+    last.uSupRaw  = r.u16();
+    uint16_t seq  = r.u16();
+    uint32_t ms   = r.u32();
+    int count     = r.u8();
+    if(count != (data.size() - CMD_SIZE_STATE_BATCH_HEADER) / CMD_SIZE_STATE_BATCH_SAMPLE) return false;
+
+    res.states.resize(count); // a reused res keeps its capacity, no allocation
+    for(int i = 0; i < count; ++i) {
+        CmdStateData& c = res.states[i];
+        c = last;
+        c.extended = true;
+        c.seq      = seq + i;
+        c.ms       = ms + r.u16();
+        c.mode     = (DeviceMode)r.u8();
+        c.uMain    = r.u16();
+        c.uSense   = r.u16();
+        c.ah       = r.u32();
+        c.wh       = r.u32();
+    }
+    assert(r.atEnd(data));
+    return true;
+}
+
+bool parseCmdData(const QByteArray& data, CmdStreamData& res)
+{
+    if(data.size() < CMD_SIZE_STREAM_HEADER) return false;
+    if(!parseCmdHeader(data, res.cmd, res.state)) return false;
+
+    FrameReader r(data);
+    res.seq       = r.u16();
+    uint32_t ms   = r.u32();
+    int count     = r.u8();
+
+    res.points.resize(count); // the same
+    uint16_t u = 0;
+    for(int i = 0; i < count; ++i) {
+        uint16_t dt, z;
+        if(!r.varint(data, dt) || !r.varint(data, z)) return false;
+        ms += dt;
+        u  += (uint16_t)((z >> 1) ^ -(z & 1)); // zigzag, wraps like on the device
+        res.points[i].ms = ms;
+        res.points[i].u  = u;
     }
+    return r.atEnd(data);
 }
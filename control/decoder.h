@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include <QByteArray>
+#include <QVector>
 
 static const uint8_t DEVICE_ERROR_POLARITY = (1 << 0);
 static const uint8_t DEVICE_ERROR_SUPPLY   = (1 << 1);
@@ -11,6 +12,16 @@ static const uint8_t DEVICE_ERROR_OUP      = (1 << 2);
 static const uint8_t DEVICE_ERROR_OTP      = (1 << 3);
 static const uint8_t DEVICE_ERROR_ERT      = (1 << 4);
 
+static const uint32_t DEVICE_VERSION_FRAMING   = 0x00010100; // first version with Cmd::Framing
+static const uint32_t DEVICE_VERSION_STATE_EXT = 0x00010200; // first version with FLOW_EXTENDED
+static const uint32_t DEVICE_VERSION_BATCH     = 0x00010300; // first version with Cmd::StateBatch
+static const uint32_t DEVICE_VERSION_STREAM    = 0x00010400; // first version with Cmd::Stream
+static const uint32_t DEVICE_VERSION_BAUD      = 0x00010500; // first version with Cmd::Baud
+
+static const uint8_t FLOW_EXTENDED = (1 << 0); // state events carry sequence number and device time
+static const int FLOW_BATCH_MAX = 8;            // samples per StateBatch event
+static const int STREAM_POINTS_MAX = 8;         // points per Stream event, as the device sends
+
 enum class Cmd {
     Reboot            = 0x01,
     GetVersion,
@@ -29,6 +40,10 @@ enum class Cmd {
     ReadRaw,
     WriteRaw,
     Bootloader,
+    Framing,
+    StateBatch,         // event only
+    Stream,
+    Baud,
 };
 
 enum class CmdState {
@@ -111,6 +126,7 @@ struct CmdSettingData : public CmdData {
 };
 
 struct CmdStateData : public CmdData {
+    CmdStateData() : CmdData(Cmd::GetState, CmdState::Event) {} // elements of CmdStateBatchData
     CmdStateData(Cmd cmd_, CmdState state_) : CmdData(cmd_, state_) {}
 
     DeviceMode mode;
@@ -121,12 +137,25 @@ struct CmdStateData : public CmdData {
     uint16_t uSupRaw;
     uint32_t ah;
     uint32_t wh;
+    bool extended;  // seq and ms are valid
+    uint16_t seq;   // wraps
+    uint32_t ms;    // device time, wraps
+};
+
+struct CmdStateBatchData : public CmdData {
+    CmdStateBatchData(Cmd cmd_, CmdState state_) : CmdData(cmd_, state_) {}
+
+    DeviceMode mode;              // at the moment of sending
+    QVector<CmdStateData> states; // error, tempRaw and uSupRaw are the same for all
 };
 
 struct CmdFlowStateData : public CmdData {
-    CmdFlowStateData(uint16_t interval_) : CmdData(Cmd::FlowState, CmdState::Request), interval(interval_) {}
+    CmdFlowStateData(uint16_t interval_, uint8_t flags_ = 0, uint8_t batch_ = 0)
+        : CmdData(Cmd::FlowState, CmdState::Request), interval(interval_), flags(flags_), batch(batch_) {}
 
     uint16_t interval;
+    uint8_t flags;  // FLOW_*, not supported before DEVICE_VERSION_STATE_EXT
+    uint8_t batch;  // samples per StateBatch event, 0 or 1 - GetState events; not supported before DEVICE_VERSION_BATCH
 };
 
 struct CmdVersionData : public CmdData {
@@ -141,8 +170,58 @@ struct CmdBootloaderData : public CmdData {
     bool enable;
 };
 
+struct CmdFramingData : public CmdData {
+    CmdFramingData(bool binary_) : CmdData(Cmd::Framing, CmdState::Request), binary(binary_) {}
+
+    bool binary;
+};
+
+struct CmdBaudData : public CmdData {
+    CmdBaudData(uint32_t baud_) : CmdData(Cmd::Baud, CmdState::Request), baud(baud_) {}
+    CmdBaudData(Cmd cmd_, CmdState state_) : CmdData(cmd_, state_), baud(0) {}
+
+    uint32_t baud;  // the same rate as the current one - ping
+};
+
+struct CmdStreamData : public CmdData {
+    CmdStreamData(bool enable_) : CmdData(Cmd::Stream, CmdState::Request), enable(enable_) {}
+    CmdStreamData(Cmd cmd_, CmdState state_) : CmdData(cmd_, state_), enable(false) {}
+
+    bool enable;
+
+    // event only
+    struct Point {
+        uint32_t ms;    // device time
+        uint16_t u;     // mV, sense or main input, whichever is connected
+    };
+    uint16_t seq;       // of the first point, wraps
+    QVector<Point> points;
+};
+
 QByteArray formCmdData(const CmdData& data);
 
-CmdData* parseCmdData(const QByteArray &data);
+// frame sizes, including the command byte
+static const int CMD_SIZE_EMPTY    = 1;
+static const int CMD_SIZE_CONFIG   = 66;
+static const int CMD_SIZE_SETTINGS = 5;
+static const int CMD_SIZE_VERSION  = 5;
+static const int CMD_SIZE_STATE    = 19;
+static const int CMD_SIZE_STATE_EXT = 25;
+static const int CMD_SIZE_STATE_BATCH_HEADER = 14;
+static const int CMD_SIZE_STATE_BATCH_SAMPLE = 15;
+static const int CMD_SIZE_STREAM_HEADER = 8;
+static const int CMD_SIZE_BAUD     = 5;
+
+bool parseCmdHeader(const QByteArray& data, Cmd& cmd, CmdState& state);
+
+// decode into the given object, return false if the frame size doesn't match
+bool parseCmdData(const QByteArray& data, CmdData& res); // commands without payload
+bool parseCmdData(const QByteArray& data, CmdConfigData& res);
+bool parseCmdData(const QByteArray& data, CmdSettingData& res);
+bool parseCmdData(const QByteArray& data, CmdVersionData& res);
+bool parseCmdData(const QByteArray& data, CmdStateData& res);
+bool parseCmdData(const QByteArray& data, CmdStateBatchData& res);
+bool parseCmdData(const QByteArray& data, CmdStreamData& res); // events only
+bool parseCmdData(const QByteArray& data, CmdBaudData& res);
 
 #endif // DECODER_H
@@ -0,0 +1,53 @@
+#include "deviceclock.h"
+
+void SeqCounter::reset()
+{
+    valid    = false;
+    expected = 0;
+    lost     = 0;
+}
+
+void SeqCounter::add(uint16_t seq, uint16_t n)
+{
+    uint16_t end = seq + n;
+    if(valid) {
+        int16_t gap = (int16_t)(seq - expected);
+        if(gap < 0) { // a duplicate or reordered: not lost, and expected never goes back
+            if((int16_t)(end - expected) > 0) expected = end;
+            return;
+        }
+        lost += gap;
+    }
+    valid    = true;
+    expected = end;
+}
+
+void DeviceClock::reset()
+{
+    valid   = false;
+    base    = 0;
+    elapsed = 0;
+    lastMs  = 0;
+    states.reset();
+}
+
+qint64 DeviceClock::toHost(uint32_t ms, qint64 received)
+{
+    if(!valid) {
+        valid   = true;
+        base    = received; // the only moment the host time is used
+        elapsed = 0;
+    }
+    else {
+        elapsed += (int32_t)(ms - lastMs); // signed: stream and state events may interleave; device counter wraps after ~50 days
+    }
+    lastMs = ms;
+
+    return base + elapsed;
+}
+
+qint64 DeviceClock::timestamp(const CmdStateData& c, qint64 received)
+{
+    states.add(c.seq);
+    return toHost(c.ms, received);
+}
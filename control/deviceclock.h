@@ -0,0 +1,44 @@
+#ifndef DEVICECLOCK_H
+#define DEVICECLOCK_H
+
+#include "decoder.h"
+
+#include <QtGlobal>
+
+// Counts gaps in a wrapping sequence
+class SeqCounter
+{
+public:
+    SeqCounter() { reset(); }
+
+    void reset();
+    void add(uint16_t seq, uint16_t n = 1); // n items starting with seq were received
+    quint64 getLost() const { return lost; }
+
+private:
+    bool valid;
+    uint16_t expected;
+    quint64 lost;
+};
+
+// Maps device time of extended state events and stream samples to host time,
+// counts lost state events
+class DeviceClock
+{
+public:
+    DeviceClock() { reset(); }
+
+    void reset(); // the device was (re-)connected or restarted
+    qint64 toHost(uint32_t ms, qint64 received); // ms since epoch
+    qint64 timestamp(const CmdStateData& c, qint64 received); // c must be extended
+    quint64 getLost() const { return states.getLost(); }
+
+private:
+    bool valid;
+    qint64 base;      // host time of the first event
+    qint64 elapsed;   // device time since the first event
+    uint32_t lastMs;
+    SeqCounter states;
+};
+
+#endif // DEVICECLOCK_H
@@ -0,0 +1,429 @@
+#include "devicesession.h"
+#include "settings.h"
+#include "logging.h"
+
+#include <QDateTime>
+#include <QtMath>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+// =============================================================================================================
+
+#define U_THRESHOLD 5
+
+Q_DECLARE_METATYPE(Comm::State)
+Q_DECLARE_METATYPE(Comm::Framing)
+Q_DECLARE_METATYPE(Comm::Backend)
+
+DeviceSession::DeviceSession(CommPool& pool_, QObject *parent) :
+    QObject(parent),
+    pool(pool_),
+    requestedInterval(MIN_INTERVAL_MS),
+    fastStream(false),
+    interval(MIN_INTERVAL_MS),
+    deviceCurrent(0),
+    deviceLastU(0xFFFF),
+    deviceConfigData(Cmd::ReadConfig, CmdState::Error),
+    deviceVersion(0),
+    deviceRunning(false),
+    linkBaudRate(Comm::DEFAULT_BAUD_RATE),
+    baudFailed(false),
+    batchData(Cmd::StateBatch, CmdState::Event),
+    streamData(Cmd::Stream, CmdState::Event)
+{
+    qRegisterMetaType<Comm::State>();
+    qRegisterMetaType<Comm::Framing>();
+    qRegisterMetaType<Comm::Backend>();
+
+    memset(&deviceConfigData, 0, sizeof(deviceConfigData));
+    memset(txStats, 0, sizeof(txStats));
+    batchData.states.reserve(FLOW_BATCH_MAX);
+    streamData.points.reserve(STREAM_POINTS_MAX);
+
+    comm = pool.create();
+    connect(this, &DeviceSession::portConnect, comm, &Comm::portConnect);
+    connect(this, &DeviceSession::portDisconnect, comm, &Comm::portDisconnect);
+    connect(this, &DeviceSession::send, comm, &Comm::send);
+    connect(this, &DeviceSession::setFraming, comm, &Comm::setFraming);
+    connect(this, &DeviceSession::setBaudRate, comm, &Comm::setBaudRate);
+    connect(this, &DeviceSession::setBackend, comm, &Comm::setBackend);
+    connect(this, &DeviceSession::startCapture, comm, &Comm::startCapture);
+    connect(this, &DeviceSession::stopCapture, comm, &Comm::stopCapture);
+    connect(comm, &Comm::captureError, this, &DeviceSession::captureError);
+    connect(comm, &Comm::error, this, &DeviceSession::error);
+    connect(comm, &Comm::data, this, &DeviceSession::on_serData);
+    connect(comm, &Comm::stateChanged, this, &DeviceSession::on_serStateChanged);
+    connect(comm, &Comm::transmitted, this, &DeviceSession::on_transmitted);
+
+    commandTimer.setInterval(Settings::commandTimeoutMs / 5);
+    connect(&commandTimer, &QTimer::timeout, this, &DeviceSession::checkTimeouts);
+}
+
+DeviceSession::~DeviceSession()
+{
+    pool.release(comm);
+}
+
+void DeviceSession::connectPort(QString portName)
+{
+    emit portConnect(portName);
+}
+
+void DeviceSession::disconnectPort()
+{
+    emit portDisconnect();
+    memset(&deviceConfigData, 0, sizeof(deviceConfigData));
+}
+
+void DeviceSession::setCaptureFile(const QString& fileName)
+{
+    if(fileName.isEmpty())
+        emit stopCapture();
+    else
+        emit startCapture(fileName);
+}
+
+void DeviceSession::setFastStream(bool enable)
+{
+    fastStream = enable;
+    if(deviceVersion < DEVICE_VERSION_STREAM) return; // also not connected; will be sent on connect
+
+    if(enable) streamSeq.reset();
+    request(formCmdData(CmdStreamData(enable)));
+}
+
+void DeviceSession::request(const QByteArray& data)
+{
+    toExecute.enqueue(ToExecute(ToExecute::Action::Send, data));
+    executeNext();
+}
+
+void DeviceSession::call(std::function<void()> f)
+{
+    toExecute.enqueue(ToExecute(f));
+    executeNext();
+}
+
+void DeviceSession::clearQueue()
+{
+    toExecute.clear();
+}
+
+Sample DeviceSession::parseSample(const CmdStateData& c, qint64 timestamp, DeviceClock& clock)
+{
+    Sample s;
+    if(c.extended)
+        s.timestamp = clock.timestamp(c, timestamp); // device time, free of transfer jitter
+    else if(this->interval > 0)
+        s.timestamp = ((timestamp + this->interval/2) / this->interval) * this->interval; // round up to interval borders
+    else
+        s.timestamp = timestamp;
+
+    bool is4Wire = (c.uSense + 100 >= c.uMain);
+    uint16_t u = (is4Wire ? c.uSense : c.uMain);
+    if(abs((int)u - (int)deviceLastU) < U_THRESHOLD)
+        u = deviceLastU;
+    else
+        deviceLastU = u;
+
+    s.u = qFloor((double)u / 10.0 + 0.5) / 100.0; // FIXME good? or s.u = (double)u / 1000;
+    s.i = (double)deviceCurrent / 1000;
+    s.ah = (double)c.ah / 1000;
+    s.wh = (double)c.wh / 1000;
+
+    return s;
+}
+
+void DeviceSession::on_serData(QByteArray d, qint64 timestamp)
+{
+    Cmd cmd;
+    CmdState state;
+    if(parseCmdHeader(d, cmd, state)) {
+        if(state == CmdState::Response || state == CmdState::Event) {
+            switch(cmd) {
+                case Cmd::Reboot:
+                    {
+                        CmdData c(cmd, state);
+                        if(!parseCmdData(d, c)) break;
+                        if(c.state == CmdState::Event) // the device was restarted, re-config it
+                            configDevice();
+                        else
+                            fallBackBaudRate(); // the device restarts at the default rate
+                    }
+                    break;
+
+                case Cmd::ReadConfig:
+                    {
+                        CmdConfigData c(cmd, state);
+                        if(!parseCmdData(d, c)) break;
+                        deviceConfigData = c;
+                        emit config(c);
+                    }
+                    break;
+
+                case Cmd::ReadSettings:
+                    {
+                        CmdSettingData c(cmd, state);
+                        if(!parseCmdData(d, c)) break;
+                        deviceCurrent = c.i;
+                        emit settings(c.u, c.i);
+                    }
+                    break;
+
+                case Cmd::GetVersion:
+                    {
+                        CmdVersionData c(cmd, state);
+                        if(!parseCmdData(d, c)) break;
+                        deviceVersion = c.v;
+                        emit version(c.v);
+
+                        if(c.v >= DEVICE_VERSION_FRAMING) {
+                            toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(CmdFramingData(true))));
+                            this->interval = requestedInterval; // short intervals are possible in binary mode only
+                        }
+                        if(c.v >= DEVICE_VERSION_BAUD && Settings::baudRate != Comm::DEFAULT_BAUD_RATE && !baudFailed)
+                            toExecute.enqueue(ToExecute(ToExecute::Action::SendAlone, formCmdData(CmdBaudData(Settings::baudRate))));
+                        uint8_t flowFlags = (c.v >= DEVICE_VERSION_STATE_EXT ? FLOW_EXTENDED : 0);
+                        uint8_t flowBatch = 0;
+                        if(c.v >= DEVICE_VERSION_BATCH && this->interval > 0)
+                            flowBatch = std::min(std::max(Settings::flowBatchDelayMs / this->interval, 1), FLOW_BATCH_MAX);
+                        toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(CmdFlowStateData(this->interval, flowFlags, flowBatch))));
+                        if(c.v >= DEVICE_VERSION_STREAM && fastStream) {
+                            streamSeq.reset();
+                            toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(CmdStreamData(true))));
+                        }
+                    }
+                    break;
+
+                case Cmd::Framing:
+                    {
+                        CmdData c(cmd, state);
+                        if(parseCmdData(d, c)) emit setFraming(Comm::Framing::Binary); // the device has switched just after the response
+                    }
+                    break;
+
+                case Cmd::Baud:
+                    {
+                        CmdBaudData c(cmd, state);
+                        if(!parseCmdData(d, c)) break;
+                        if((qint32)c.baud != linkBaudRate) {
+                            // the device has switched just after the response, confirm the link before it falls back
+                            linkBaudRate = c.baud;
+                            emit setBaudRate(linkBaudRate);
+                            toExecute.prepend(ToExecute(ToExecute::Action::SendAlone, formCmdData(CmdBaudData(c.baud))));
+                        }
+                    }
+                    break;
+
+                case Cmd::GetState:
+                    {
+                        CmdStateData c(cmd, state);
+                        if(!parseCmdData(d, c)) break;
+                        Sample s = parseSample(c, timestamp, deviceClock);
+                        deviceRunning = (c.mode == DeviceMode::Fun1Run || c.mode == DeviceMode::Fun2Run);
+                        if(deviceRunning)
+                            emit sample(s);
+                        if(c.extended) updateLost();
+                        emit deviceState(c, s);
+                    }
+                    break;
+
+                case Cmd::StateBatch:
+                    {
+                        CmdStateBatchData& c = batchData;
+                        if(!parseCmdData(d, c) || c.states.isEmpty()) break;
+
+                        // a new list each time: the receivers may keep it
+                        QVector<Sample> list;
+                        list.reserve(c.states.size());
+                        Sample s;
+                        for(const CmdStateData& st : c.states) {
+                            s = parseSample(st, timestamp, deviceClock);
+                            if(st.mode == DeviceMode::Fun1Run || st.mode == DeviceMode::Fun2Run)
+                                list.push_back(s);
+                        }
+                        if(!list.isEmpty())
+                            emit sampleMultiple(list);
+                        updateLost();
+
+                        CmdStateData last = c.states.last();
+                        last.mode = c.mode;
+                        deviceRunning = (c.mode == DeviceMode::Fun1Run || c.mode == DeviceMode::Fun2Run);
+                        emit deviceState(last, s);
+                    }
+                    break;
+
+                case Cmd::Stream:
+                    {
+                        CmdStreamData& c = streamData;
+                        if(state != CmdState::Event || !parseCmdData(d, c)) break;
+
+                        streamSeq.add(c.seq, c.points.size());
+                        updateLost();
+                        if(!deviceRunning) break;
+
+                        QVector<FastSample> list;
+                        list.reserve(c.points.size());
+                        for(const CmdStreamData::Point& p : c.points) {
+                            FastSample s;
+                            s.timestamp = deviceClock.toHost(p.ms, timestamp);
+                            s.u         = (double)p.u / 1000;
+                            list.push_back(s);
+                        }
+                        emit fastSamples(list);
+                    }
+                    break;
+
+                default:
+                    ;
+            }
+        }
+
+        if(state == CmdState::Response || state == CmdState::Error)
+            completeRequest(cmd);
+    }
+    executeNext();
+}
+
+void DeviceSession::on_serStateChanged(Comm::State state)
+{
+    switch(state) {
+        case Comm::State::Connected:
+            linkBaudRate = Comm::DEFAULT_BAUD_RATE;
+            baudFailed = false;
+            memset(txStats, 0, sizeof(txStats));
+            configDevice();
+            deviceLastU = 0xFFFF;
+            break;
+
+        case Comm::State::Idle:
+            // requests can't be answered any more; calls don't need the link, e.g. the upgrade after disconnect
+            for(auto i = toExecute.begin(); i != toExecute.end(); )
+                i = (i->action == ToExecute::Action::Call ? i + 1 : toExecute.erase(i));
+            inFlight.clear();
+            commandTimer.stop();
+            deviceVersion = 0;
+            deviceRunning = false;
+            break;
+    }
+    emit stateChanged(state);
+    executeNext();
+}
+
+void DeviceSession::on_transmitted(char header, int bytes, qint64 delayUs)
+{
+    TxStats& s = txStats[(uint8_t)header & 0x1F];
+    ++s.count;
+    s.bytes   += bytes;
+    s.delayUs += delayUs;
+    if(delayUs > s.maxDelayUs) s.maxDelayUs = delayUs;
+}
+
+void DeviceSession::configDevice()
+{
+    this->interval = std::max(requestedInterval, (int)MIN_INTERVAL_MS); // hex framing until negotiated
+    deviceVersion = 0;
+    deviceRunning = false;
+    deviceClock.reset();
+
+    // the flow is started after GetVersion, when the supported features are known
+    toExecute.clear();
+    inFlight.clear();
+    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::GetVersion)));
+    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ReadConfig)));
+    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ReadSettings)));
+    executeNext();
+}
+
+void DeviceSession::updateLost()
+{
+    quint64 lostStates = deviceClock.getLost();
+    quint64 lostFast = streamSeq.getLost();
+    if(lostStates == 0 && lostFast == 0) return;
+
+    emit lost(lostStates, lostFast);
+}
+
+void DeviceSession::fallBackBaudRate()
+{
+    if(linkBaudRate == Comm::DEFAULT_BAUD_RATE) return;
+
+    linkBaudRate = Comm::DEFAULT_BAUD_RATE;
+    emit setBaudRate(linkBaudRate);
+}
+
+void DeviceSession::executeNext()
+{
+    while(!toExecute.isEmpty()) {
+        if(!inFlight.isEmpty() && inFlight.last().action == ToExecute::Action::SendAlone) break; // wait for its response
+
+        ToExecute::Action action = toExecute.head().action;
+        if(action == ToExecute::Action::Send || action == ToExecute::Action::SendAlone) {
+            if(inFlight.size() >= Settings::commandWindow) break;
+            if(action == ToExecute::Action::SendAlone && !inFlight.isEmpty()) break;
+
+            ToExecute e = toExecute.dequeue();
+            e.tries  = 1;
+            e.sentAt = QDateTime::currentMSecsSinceEpoch();
+            emit send(e.data);
+            inFlight.append(e);
+        }
+        else {
+            if(!inFlight.isEmpty()) break; // wait until all previous requests are done
+
+            ToExecute e = toExecute.dequeue();
+            e.f();
+            break; // the action itself triggers the next one
+        }
+    }
+
+    if(inFlight.isEmpty())
+        commandTimer.stop();
+    else if(!commandTimer.isActive())
+        commandTimer.start();
+}
+
+void DeviceSession::completeRequest(Cmd cmd)
+{
+    // the device answers in order, so the oldest request with the same command is the one
+    for(auto i = inFlight.begin(); i != inFlight.end(); ++i) {
+        Cmd c;
+        CmdState state;
+        if(parseCmdHeader(i->data, c, state) && c == cmd) {
+            inFlight.erase(i);
+            break;
+        }
+    }
+}
+
+void DeviceSession::checkTimeouts()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for(auto i = inFlight.begin(); i != inFlight.end(); ) {
+        if(now - i->sentAt < Settings::commandTimeoutMs) {
+            ++i;
+        }
+        else if(i->tries <= Settings::commandRetries) {
+            qCDebug(logComm) << "retry" << i->data.toHex();
+            ++i->tries;
+            i->sentAt = now;
+            emit send(i->data);
+            ++i;
+        }
+        else {
+            qCWarning(logComm) << "no response, request dropped:" << i->data.toHex();
+            i = inFlight.erase(i);
+
+            if(linkBaudRate != Comm::DEFAULT_BAUD_RATE) {
+                // the new rate doesn't work or the device was restarted - it's at the default rate now
+                baudFailed = true;
+                fallBackBaudRate();
+                configDevice();
+                return;
+            }
+        }
+    }
+    executeNext();
+}
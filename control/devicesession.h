@@ -0,0 +1,141 @@
+#ifndef DEVICESESSION_H
+#define DEVICESESSION_H
+
+#include "decoder.h"
+#include "comm.h"
+#include "commpool.h"
+#include "sample.h"
+#include "deviceclock.h"
+
+#include <QObject>
+#include <QQueue>
+#include <QList>
+#include <QTimer>
+
+#include <functional>
+#include <stdint.h>
+
+// Protocol logic of one connected device: negotiation, request queue with retries,
+// conversion of state events into samples. Used by the GUI and by the command line tool.
+class DeviceSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceSession(CommPool& pool, QObject *parent = 0);
+    ~DeviceSession();
+
+public:
+    struct TxStats {
+        quint64 count;
+        quint64 bytes;          // on the wire, framing included
+        qint64 delayUs;         // sum of delays from send() until taken by the driver
+        qint64 maxDelayUs;
+    };
+
+    static const int MIN_INTERVAL_MS = 250;
+    static const int MIN_INTERVAL_BINARY_MS = 100; // the device measures 10 times per second
+
+public:
+    void connectPort(QString portName);
+    void disconnectPort();
+    void setInterval(int ms) { requestedInterval = ms; } // applied on the next (re-)config
+    void setFastStream(bool enable);
+    void setPortBackend(Comm::Backend backend) { emit setBackend(backend); } // used by the next connect
+    void setCaptureFile(const QString& fileName); // all frames on the link, empty - stop
+    void request(const QByteArray& data);
+    void call(std::function<void()> f); // when all previous requests are done; continue with executeNext()
+    void clearQueue();
+
+    const CmdConfigData& getConfig() const { return deviceConfigData; }
+    uint32_t getVersion() const { return deviceVersion; }
+    bool isRunning() const { return deviceRunning; }
+    int getInterval() const { return interval; }
+    const TxStats& getTxStats(Cmd cmd) const { return txStats[(int)cmd & 0x1F]; }
+    Sample parseSample(const CmdStateData& c, qint64 timestamp, DeviceClock& clock);
+
+public slots:
+    void executeNext();
+
+signals:
+    void stateChanged(Comm::State state);
+    void error(QString msg);
+    void captureError(QString msg);
+    void version(uint32_t v);
+    void config(const CmdConfigData& c);
+    void settings(uint16_t u, uint16_t i); // mV, mA
+    void deviceState(const CmdStateData& c, const Sample& s);
+    void lost(quint64 lost, quint64 lostFast);
+    void sample(Sample s);
+    void sampleMultiple(const QVector<Sample> &list);
+    void fastSamples(const QVector<FastSample> &list);
+
+    // to comm
+    void portConnect(QString portName);
+    void portDisconnect();
+    void send(QByteArray data);
+    void setFraming(Comm::Framing framing);
+    void setBaudRate(qint32 baudRate);
+    void setBackend(Comm::Backend backend);
+    void startCapture(QString fileName);
+    void stopCapture();
+
+private slots:
+    void on_serData(QByteArray d, qint64 timestamp);
+    void on_serStateChanged(Comm::State state);
+    void on_transmitted(char header, int bytes, qint64 delayUs);
+
+private:
+    void completeRequest(Cmd cmd);
+    void checkTimeouts();
+    void configDevice();
+    void updateLost();
+    void fallBackBaudRate();
+
+private:
+    struct ToExecute {
+        enum class Action {
+            Send,
+            SendAlone,  // nothing else in flight, e.g. the link is changed by the response
+            Call,
+        };
+
+        Action action;
+        QByteArray data;
+        std::function<void()> f;
+        int tries;      // how many times already sent
+        qint64 sentAt;  // ms, last try
+
+        ToExecute() {}
+
+        ToExecute(const ToExecute& o) : action(o.action), data(o.data), f(o.f), tries(o.tries), sentAt(o.sentAt) {}
+
+        ToExecute(Action action_, QByteArray data_) : action(action_), data(data_), tries(0), sentAt(0) {}
+
+        ToExecute(std::function<void()> f_) : action(Action::Call), f(f_), tries(0), sentAt(0) {}
+    };
+
+private:
+    CommPool& pool;
+    Comm *comm;
+    QQueue<ToExecute> toExecute;
+    QList<ToExecute> inFlight;  // sent, waiting for response
+    QTimer commandTimer;
+    int requestedInterval;
+    bool fastStream;
+    int interval;
+    uint16_t deviceCurrent;
+    uint16_t deviceLastU;
+    CmdConfigData deviceConfigData;
+    uint32_t deviceVersion;     // 0 - not known yet
+    bool deviceRunning;
+    DeviceClock deviceClock;
+    SeqCounter streamSeq;
+    qint32 linkBaudRate;
+    bool baudFailed;            // don't try again until reconnect
+    CmdStateBatchData batchData; // decoded into again and again, the capacity is kept
+    CmdStreamData streamData;   // the same
+    TxStats txStats[32];        // by command
+};
+
+#endif // DEVICESESSION_H
@@ -26,7 +26,21 @@ SOURCES += main.cpp\
     flasherworker.cpp \
     flasher.cpp \
     flashprogressdialog.cpp \
-    crc.cpp
+    crc.cpp \
+    deviceclock.cpp \
+    devicesession.cpp \
+    commpool.cpp \
+    portbackend.cpp \
+    capture.cpp \
+    rawlogimporter.cpp \
+    csvexporter.cpp \
+    exportdialog.cpp \
+    sessionfile.cpp \
+    samplespill.cpp \
+    samplelod.cpp \
+    channellod.cpp \
+    renderscheduler.cpp \
+    logging.cpp
 
 HEADERS  += mainwindow.h \
     decoder.h \
@@ -44,12 +58,27 @@ HEADERS  += mainwindow.h \
     flasherworker.h \
     flasher.h \
     flashprogressdialog.h \
-    crc.h
+    crc.h \
+    deviceclock.h \
+    devicesession.h \
+    commpool.h \
+    portbackend.h \
+    capture.h \
+    rawlogimporter.h \
+    csvexporter.h \
+    exportdialog.h \
+    sessionfile.h \
+    samplespill.h \
+    samplelod.h \
+    channellod.h \
+    renderscheduler.h \
+    logging.h
 
 FORMS    += mainwindow.ui \
     aboutdialog.ui \
     configdialog.ui \
-    flashprogressdialog.ui
+    flashprogressdialog.ui \
+    exportdialog.ui
 
 RC_ICONS = app.ico
 
@@ -58,6 +87,11 @@ DISTFILES +=
 RESOURCES += \
     common.qrc
 
+linux {
+    SOURCES += nativeportbackend.cpp
+    HEADERS += nativeportbackend.h
+}
+
 unix {
     CONFIG   += qwt-qt5
     INCLUDEPATH += /usr/include/qwt
@@ -0,0 +1,42 @@
+#include "exportdialog.h"
+#include "ui_exportdialog.h"
+
+ExportDialog::ExportDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ExportDialog)
+{
+    ui->setupUi(this);
+
+    ui->timeBox->addItem("dd.MM.yyyy hh:mm.ss.zzz", (int)CsvExporter::Options::Time::DateTime);
+    ui->timeBox->addItem("ISO 8601", (int)CsvExporter::Options::Time::Iso);
+    ui->timeBox->addItem("ms since epoch", (int)CsvExporter::Options::Time::Epoch);
+
+    ui->delimiterBox->addItem("Comma", (int)',');
+    ui->delimiterBox->addItem("Semicolon", (int)';');
+    ui->delimiterBox->addItem("Tab", (int)'\t');
+
+    ui->precisionBox->setRange(0, CsvExporter::MAX_PRECISION);
+}
+
+ExportDialog::~ExportDialog()
+{
+    delete ui;
+}
+
+void ExportDialog::setOptions(const CsvExporter::Options& options)
+{
+    int t = ui->timeBox->findData((int)options.time);
+    ui->timeBox->setCurrentIndex(t < 0 ? 0 : t);
+    int d = ui->delimiterBox->findData((int)options.delimiter);
+    ui->delimiterBox->setCurrentIndex(d < 0 ? 0 : d);
+    ui->precisionBox->setValue(options.precision);
+}
+
+CsvExporter::Options ExportDialog::getOptions() const
+{
+    CsvExporter::Options options;
+    options.time      = (CsvExporter::Options::Time)ui->timeBox->currentData().toInt();
+    options.delimiter = (char)ui->delimiterBox->currentData().toInt();
+    options.precision = ui->precisionBox->value();
+    return options;
+}
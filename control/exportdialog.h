@@ -0,0 +1,27 @@
+#ifndef EXPORTDIALOG_H
+#define EXPORTDIALOG_H
+
+#include "csvexporter.h"
+
+#include <QDialog>
+
+namespace Ui {
+class ExportDialog;
+}
+
+class ExportDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ExportDialog(QWidget *parent = 0);
+    ~ExportDialog();
+
+    void setOptions(const CsvExporter::Options& options);
+    CsvExporter::Options getOptions() const;
+
+private:
+    Ui::ExportDialog *ui;
+};
+
+#endif // EXPORTDIALOG_H
@@ -0,0 +1,4 @@
+#include "logging.h"
+
+Q_LOGGING_CATEGORY(logComm, "load.comm", QtWarningMsg)
+Q_LOGGING_CATEGORY(logRender, "load.render", QtWarningMsg)
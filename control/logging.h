@@ -0,0 +1,10 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QLoggingCategory>
+
+// Traces off by default, enabled with QT_LOGGING_RULES, e.g. "load.comm.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(logComm)
+Q_DECLARE_LOGGING_CATEGORY(logRender)
+
+#endif // LOGGING_H
@@ -5,10 +5,16 @@
 #include "aboutdialog.h"
 #include "configdialog.h"
 #include "flashprogressdialog.h"
-#include "crc.h"
+#include "exportdialog.h"
+#include "logging.h"
 
 #include <qwt_plot_curve.h>
+#include <qwt_plot_directpainter.h>
+#include <qwt_scale_engine.h>
+#include <qwt_interval.h>
 #include <qwt_plot_grid.h>
+#include <qwt_plot_magnifier.h>
+#include <qwt_plot_panner.h>
 
 #include <QLineEdit>
 #include <QVariant>
@@ -19,37 +25,42 @@
 #include <QAbstractTableModel>
 #include <QSpinBox>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QSignalBlocker>
+#include <QActionGroup>
 #include <QDebug>
 
 #include <string>
 #include <map>
+#include <algorithm>
 #include <cstdio>
 
 // =============================================================================================================
 
-#define U_THRESHOLD 5
-
 Q_DECLARE_METATYPE(Cmd)
 Q_DECLARE_METATYPE(Sample)
-Q_DECLARE_METATYPE(Comm::State)
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
+    commPool(1),
     isConnected(false),
-    deviceConfigData(Cmd::ReadConfig, CmdState::Error),
-    storage(Settings::maxSamples)
+    storage(Settings::maxSamples, Settings::maxFastSamples),
+    channels(storage),
+    importProgress(nullptr),
+    exportProgress(nullptr),
+    graphStale(true),
+    lastState(Cmd::GetState, CmdState::Event),
+    lastSample()
 {
     ui->setupUi(this);
 
     qRegisterMetaType<Sample>();
     qRegisterMetaType<Cmd>();
-    qRegisterMetaType<Comm::State>();
 
     ui->temperatureBox->setOrientation(Qt::Horizontal);
     ui->temperatureBox->setFillBrush(Qt::green);
     ui->temperatureBox->setScalePosition(QwtThermo::NoScale);
-    setControlEnabled(false);
 
     QSettings settings("Anatoli Klassen", "Electronic Load Control");
 
@@ -77,28 +88,67 @@ MainWindow::MainWindow(QWidget *parent) :
     grid->setMinorPen(Qt::gray, 0, Qt::DotLine);
     grid->attach(ui->graphPlot);
 
-    data = new CurveData(storage);
+    data = new CurveData(storage, channels);
+    data->setCanvas(ui->graphPlot->canvas());
 
-    QwtPlotCurve * curve = new QwtPlotCurve();
+    curve = new QwtPlotCurve();
     curve->setRenderHint(QwtPlotItem::RenderAntialiased);
     curve->setPen(Qt::yellow);
     curve->setData(data);
     curve->attach(ui->graphPlot);
+    ui->graphPlot->setAxisTitle(QwtPlot::yLeft, ChannelLod::title(CurveData::Channel::Voltage));
+
+    // one more channel on the right axis, View / Second Channel
+    channelData = nullptr;
+    channelCurve = new QwtPlotCurve();
+    channelCurve->setRenderHint(QwtPlotItem::RenderAntialiased);
+    channelCurve->setPen(Qt::cyan);
+    channelCurve->setYAxis(QwtPlot::yRight);
+    channelCurve->setVisible(false);
+    channelCurve->attach(ui->graphPlot);
+
+    // new points are painted on the canvas as they come, the backing store gets them too
+    graphPainter = new QwtPlotDirectPainter(this);
+    graphPainter->setAttribute(QwtPlotDirectPainter::CopyBackingStore, true);
+
+    // zoom with the wheel, pan with the left button; View / Reset Zoom goes back to autoscale
+    new QwtPlotMagnifier(ui->graphPlot->canvas());
+    new QwtPlotPanner(ui->graphPlot->canvas());
+
+    // device
+    session = new DeviceSession(commPool, this);
+    connect(session, &DeviceSession::error, this, &MainWindow::on_serError);
+    connect(session, &DeviceSession::captureError, this, &MainWindow::on_captureError);
+    connect(session, &DeviceSession::stateChanged, this, &MainWindow::on_serStateChanged);
+    connect(session, &DeviceSession::version, this, &MainWindow::on_deviceVersion);
+    connect(session, &DeviceSession::config, this, &MainWindow::on_deviceConfig);
+    connect(session, &DeviceSession::settings, this, &MainWindow::on_deviceSettings);
+    connect(session, &DeviceSession::deviceState, this, &MainWindow::showDeviceState);
+    connect(session, &DeviceSession::lost, this, &MainWindow::on_deviceLost);
+    setControlEnabled(false);
 
     // storage
-    connect(this, &MainWindow::sample, &storage, &SampleStorage::append);
+    connect(session, &DeviceSession::sample, &storage, &SampleStorage::append);
+    connect(session, &DeviceSession::sampleMultiple, &storage, &SampleStorage::appendMultiple);
+    connect(session, &DeviceSession::fastSamples, &storage, &SampleStorage::appendFast);
     connect(this, &MainWindow::sampleMultiple, &storage, &SampleStorage::appendMultiple);
-    connect(&storage, &SampleStorage::afterAppend, [this]() {
-        if(!this->ui->graphDock->isHidden()) this->ui->graphPlot->replot();
-    } );
-    connect(&storage, &SampleStorage::afterAppendMultiple, [this]() {
-        if(!this->ui->graphDock->isHidden()) this->ui->graphPlot->replot();
-    } );
-    connect(&storage, &SampleStorage::afterClear, [this]() {
-        if(!this->ui->graphDock->isHidden()) this->ui->graphPlot->replot();
-    } );
+    connect(&importer, &RawLogImporter::states, this, &MainWindow::on_importStates);
+    connect(&importer, &RawLogImporter::finished, this, &MainWindow::on_importFinished);
+    connect(&exporter, &CsvExporter::finished, this, &MainWindow::on_exportFinished);
+    connect(&storage, &SampleStorage::spillError, this, &MainWindow::on_spillError);
+    ui->actionKeepAllSamples->setChecked(settings.value("keepAllSamples", false).toBool());
+
+    // views are rendered at most once a frame
+    renderer.setRate(settings.value("frameRate", RenderScheduler::DEFAULT_RATE).toInt());
+    graphRender = renderer.addView([this]() { this->renderGraph(); } );
+    auto graphChanged = [this]() { this->renderer.markDirty(this->graphRender); };
+    connect(&storage, &SampleStorage::afterAppend, graphChanged);
+    connect(&storage, &SampleStorage::afterAppendMultiple, graphChanged);
+    connect(&storage, &SampleStorage::afterClear, graphChanged);
+    connect(&storage, &SampleStorage::afterOpenSession, graphChanged);
     connect(ui->graphDock, &QDockWidget::visibilityChanged, [this]() {
-        if(!this->ui->graphDock->isHidden()) this->ui->graphPlot->replot();
+        this->graphStale = true;
+        this->renderer.markDirty(this->graphRender);
     } );
 
     // table
@@ -106,27 +156,38 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->tableView->setModel(tableModel);
     ui->tableView->setColumnWidth(0, 140);
     ui->tableView->setColumnWidth(1, 80);
-    connect(&storage, &SampleStorage::beforeAppend, tableModel, &TableModel::beforeAppend);
-    connect(&storage, &SampleStorage::beforeAppendMultiple, tableModel, &TableModel::beforeAppendMultiple);
-    connect(&storage, &SampleStorage::afterAppend, tableModel, &TableModel::afterAppend);
-    connect(&storage, &SampleStorage::afterAppendMultiple, tableModel, &TableModel::afterAppendMultiple);
     connect(&storage, &SampleStorage::beforeClear, tableModel, &TableModel::beforeClear);
     connect(&storage, &SampleStorage::afterClear, tableModel, &TableModel::afterClear);
-    connect(&storage, &SampleStorage::beforeDelete, tableModel, &TableModel::beforeDelete);
     connect(&storage, &SampleStorage::afterDelete, tableModel, &TableModel::afterDelete);
-
-    // comm
-    comm = new Comm();
-    comm->moveToThread(&commThread);
-    connect(&commThread, &QThread::started, comm, &Comm::onStart);
-    connect(&commThread, &QThread::finished, comm, &Comm::deleteLater);
-    connect(this, &MainWindow::portConnect, comm, &Comm::portConnect);
-    connect(this, &MainWindow::portDisconnect, comm, &Comm::portDisconnect);
-    connect(this, &MainWindow::send, comm, &Comm::send);
-    connect(comm, &Comm::error, this, &MainWindow::on_serError);
-    connect(comm, &Comm::data, this, &MainWindow::on_serData);
-    connect(comm, &Comm::stateChanged, this, &MainWindow::on_serStateChanged);
-    commThread.start();
+    tableRender = renderer.addView([this]() { this->tableModel->sync(); } );
+    auto tableChanged = [this]() { this->renderer.markDirty(this->tableRender); };
+    connect(&storage, &SampleStorage::afterAppend, tableChanged);
+    connect(&storage, &SampleStorage::afterAppendMultiple, tableChanged);
+    connect(&storage, &SampleStorage::afterDelete, tableChanged);
+    connect(&storage, &SampleStorage::afterOpenSession, tableChanged);
+
+    stateRender = renderer.addView([this]() { this->renderDeviceState(); } );
+
+    // second channel of the graph
+    ui->actionChannelNone->setData(-1);
+    ui->actionChannelCurrent->setData((int)CurveData::Channel::Current);
+    ui->actionChannelPower->setData((int)CurveData::Channel::Power);
+    ui->actionChannelEnergy->setData((int)CurveData::Channel::Energy);
+    ui->actionChannelResistance->setData((int)CurveData::Channel::Resistance);
+    QActionGroup* channels = new QActionGroup(this);
+    for(QAction* a : ui->menuChannel->actions())
+        channels->addAction(a);
+    connect(channels, &QActionGroup::triggered, [this](QAction* a) {
+        this->setGraphChannel(a->data().toInt());
+    } );
+    int channel = settings.value("graphChannel", -1).toInt();
+    ui->actionChannelNone->setChecked(true);
+    for(QAction* a : ui->menuChannel->actions()) {
+        if(a->data().toInt() == channel) {
+            a->setChecked(true);
+            setGraphChannel(channel);
+        }
+    }
 
     // flasher
     flasher = new Flasher();
@@ -139,7 +200,19 @@ MainWindow::MainWindow(QWidget *parent) :
     flasherThread.start();
 
     // interval
-    ui->intervalBox->setValue(settings.value("interval", MIN_INTERVAL_MS).toInt());
+    connect(ui->intervalBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](int value) {
+        this->session->setInterval(value);
+    } );
+    ui->intervalBox->setMinimum(DeviceSession::MIN_INTERVAL_BINARY_MS);
+    ui->intervalBox->setValue(settings.value("interval", DeviceSession::MIN_INTERVAL_MS).toInt());
+    session->setInterval(ui->intervalBox->value());
+    ui->fastStreamCheckBox->setChecked(settings.value("fastStream", false).toBool());
+    session->setFastStream(ui->fastStreamCheckBox->isChecked());
+
+    // serial backend
+    ui->actionNativeSerial->setVisible(Comm::isBackendAvailable(Comm::Backend::Native));
+    ui->actionNativeSerial->setChecked(settings.value("nativeSerial", false).toBool());
+    on_actionNativeSerial_toggled(ui->actionNativeSerial->isChecked());
 
     // status bar
     deviceVersionLabel = new QLabel();
@@ -150,16 +223,18 @@ MainWindow::MainWindow(QWidget *parent) :
     deviceMessageLabel->setToolTip("Device Status");
     deviceMessageLabel->setVisible(false);
     ui->statusBar->addWidget(deviceMessageLabel);
-
-    clearDeviceInfo();
+    deviceLostLabel = new QLabel();
+    deviceLostLabel->setToolTip("State events lost on the way from the device");
+    deviceLostLabel->setVisible(false);
+    ui->statusBar->addWidget(deviceLostLabel);
 }
 
 MainWindow::~MainWindow()
 {
-    commThread.quit();
-    flasherThread.quit();
+    qCDebug(logRender) << "render:" << renderer.getRendered() << "frames," << renderer.getSkipped() << "changes merged";
 
-    commThread.wait();
+    delete session; // before the pool of its comm
+    flasherThread.quit();
     flasherThread.wait();
 
     delete ui;
@@ -189,9 +264,98 @@ void MainWindow::on_actionShowControl_triggered()
     ui->controlDock->show();
 }
 
+void MainWindow::renderGraph()
+{
+    if(ui->graphDock->isHidden()) {
+        graphStale = true;
+        return;
+    }
+
+    // appended points are drawn alone, everything else needs a full replot
+    CurveData* datas[] = { data, channelData };
+    QwtPlotCurve* curves[] = { curve, channelCurve };
+    bool full = graphStale || isRescaleNeeded();
+    for(CurveData* d : datas)
+        if(d && d->isRedrawNeeded()) full = true;
+
+    if(full) {
+        graphStale = false;
+        ui->graphPlot->replot();
+    }
+    else {
+        for(int k = 0; k < 2; ++k) {
+            if(!datas[k]) continue;
+            size_t stable = datas[k]->stablePoints();
+            size_t n = datas[k]->size();
+            if(n > stable) graphPainter->drawSeries(curves[k], (int)std::max(stable, (size_t)1) - 1, (int)n - 1);
+        }
+    }
+
+    for(CurveData* d : datas)
+        if(d) d->markDrawn();
+}
+
+bool MainWindow::isRescaleNeeded() const
+{
+    // the same as QwtPlot::updateAxes() does for autoscaled axes
+    QwtInterval intervals[QwtPlot::axisCnt];
+    const QwtPlotItemList& items = ui->graphPlot->itemList();
+    for(const QwtPlotItem* item : items) {
+        if(!item->testItemAttribute(QwtPlotItem::AutoScale) || !item->isVisible()) continue;
+
+        QRectF rect = item->boundingRect();
+        if(rect.width() >= 0.0) intervals[item->xAxis()] |= QwtInterval(rect.left(), rect.right());
+        if(rect.height() >= 0.0) intervals[item->yAxis()] |= QwtInterval(rect.top(), rect.bottom());
+    }
+
+    for(int axis = 0; axis < QwtPlot::axisCnt; ++axis) {
+        if(!ui->graphPlot->axisAutoScale(axis) || !intervals[axis].isValid()) continue;
+
+        double lower = intervals[axis].minValue();
+        double upper = intervals[axis].maxValue();
+        double step = 0.0;
+        ui->graphPlot->axisScaleEngine(axis)->autoScale(ui->graphPlot->axisMaxMajor(axis), lower, upper, step);
+
+        const QwtScaleDiv& div = ui->graphPlot->axisScaleDiv(axis);
+        if(div.lowerBound() != lower || div.upperBound() != upper) return true;
+    }
+    return false;
+}
+
+void MainWindow::setGraphChannel(int channel)
+{
+    bool shown = (channel >= 0);
+    if(shown) {
+        CurveData::Channel c = (CurveData::Channel)channel;
+        channels.select(c);
+        channelData = new CurveData(storage, channels, c);
+        channelData->setCanvas(ui->graphPlot->canvas());
+        channelCurve->setData(channelData); // the previous one is deleted
+        ui->graphPlot->setAxisTitle(QwtPlot::yRight, ChannelLod::title(c));
+    }
+    else {
+        channelData = nullptr;
+        channelCurve->setData(new QwtPointSeriesData());
+        channels.select(CurveData::Channel::Voltage);
+    }
+    channelCurve->setVisible(shown);
+    ui->graphPlot->enableAxis(QwtPlot::yRight, shown);
+
+    graphStale = true;
+    renderer.markDirty(graphRender);
+}
+
+void MainWindow::on_actionResetZoom_triggered()
+{
+    ui->graphPlot->setAxisAutoScale(QwtPlot::xBottom);
+    ui->graphPlot->setAxisAutoScale(QwtPlot::yLeft);
+    ui->graphPlot->setAxisAutoScale(QwtPlot::yRight);
+    ui->graphPlot->replot();
+}
+
 void MainWindow::updateFun()
 {
-    bool showEnergy = (deviceConfigData.fun == 1);
+    bool showEnergy = (session->getConfig().fun == 1);
     ui->energyLabel->setVisible(showEnergy);
     ui->energyBox->setVisible(showEnergy);
     ui->energyResetButton->setVisible(showEnergy);
@@ -208,7 +372,7 @@ void MainWindow::setControlEnabled(bool state)
     ui->actionDeviceConfiguration->setEnabled(state);
 
     if(state) {
-        bool showEnergy = (deviceConfigData.fun == 1);
+        bool showEnergy = (session->getConfig().fun == 1);
         ui->energyLabel->setVisible(showEnergy);
         ui->energyBox->setVisible(showEnergy);
         ui->energyResetButton->setVisible(showEnergy);
@@ -233,7 +397,7 @@ void MainWindow::setControlEnabled(bool state)
 
 void MainWindow::connectSer()
 {
-    emit portConnect(currentPort);
+    session->connectPort(currentPort);
 
     ui->connectButton->setText("Disconnect");
     isConnected = true;
@@ -241,11 +405,10 @@ void MainWindow::connectSer()
 
 void MainWindow::disconnectSer()
 {
-    emit portDisconnect();
+    session->disconnectPort();
 
     ui->connectButton->setText("Connect");
     isConnected = false;
-    clearDeviceInfo();
 }
 
 void MainWindow::on_connectButton_clicked()
@@ -268,6 +431,14 @@ void MainWindow::on_refreshPortsButton_clicked()
             ui->portBox->setCurrentIndex(count);
         }
     }
+
+    // pseudo-terminals are not listed
+    if(QFile::exists(Settings::simulatorPort)) {
+        QString port(Settings::simulatorPort);
+        ui->portBox->addItem(QString("%1: Simulator").arg(port), QVariant(port));
+        if(selPort == port)
+            ui->portBox->setCurrentIndex(count);
+    }
 }
 
 void MainWindow::on_clearDataButton_clicked()
@@ -289,6 +460,11 @@ void MainWindow::closeEvent(QCloseEvent *event)
     settings.setValue("port", currentPort);
     settings.setValue("logData", ui->logDataCheckBox->checkState());
     settings.setValue("interval", ui->intervalBox->value());
+    settings.setValue("fastStream", ui->fastStreamCheckBox->isChecked());
+    settings.setValue("nativeSerial", ui->actionNativeSerial->isChecked());
+    settings.setValue("keepAllSamples", ui->actionKeepAllSamples->isChecked());
+    settings.setValue("frameRate", renderer.getRate());
+    settings.setValue("graphChannel", channelData ? (int)channelData->getChannel() : -1);
 
     QMainWindow::closeEvent(event);
 }
@@ -300,49 +476,109 @@ void MainWindow::on_actionAbout_triggered()
     delete dialog;
 }
 
-static bool saveStorageToCsvFile(const SampleStorage &storage, QFile &file)
-{
-    if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
-
-    static const QString dateTimeFormat("dd.MM.yyyy hh:mm.ss.zzz");
-    QFileDevice::FileError error;
-    QString header = "\"Timestamp\",\"Time, s\",\"Current, A\",\"Voltage, V\",\"Energy, Ah\",\"Energy, Wh\"\n";
-    file.write(header.toLatin1());
-    error = file.error();
-    size_t len = storage.size();
-    for(size_t i = 0; (QFileDevice::NoError == error) && (i < len); ++i) {
-        const Sample& sample = storage.sample(i);
-        QString line = QDateTime::fromMSecsSinceEpoch(sample.timestamp).toString(dateTimeFormat);
-        line.append(",").append(QString("%1").arg(((double)(sample.timestamp - storage.getBegin())/1000.0), 0, 'f', 3));
-        line.append(",").append(QString("%1").arg(sample.i, 0, 'f', 3));
-        line.append(",").append(QString("%1").arg(sample.u, 0, 'f', 3));
-        line.append(",").append(QString("%1").arg(sample.ah, 0, 'f', 3));
-        line.append(",").append(QString("%1").arg(sample.wh, 0, 'f', 3));
-        line.append("\n");
-        file.write(line.toLatin1());
-        error = file.error();
-    }
-    if(QFileDevice::NoError == error) {
-        file.flush();
-        error = file.error();
+void MainWindow::on_actionSaveLog_triggered()
+{
+    if(exporter.isRunning()) return;
+
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Save Log", QString(), "CSV tables (*.csv);;Test files (*.txt);;All files (*)");
+    if(fileName.isEmpty()) return;
+
+    QSettings settings("Anatoli Klassen", "Electronic Load Control");
+    CsvExporter::Options options;
+    options.time      = (CsvExporter::Options::Time)settings.value("export/time", (int)options.time).toInt();
+    options.delimiter = (char)settings.value("export/delimiter", (int)options.delimiter).toInt();
+    options.precision = settings.value("export/precision", options.precision).toInt();
+
+    ExportDialog dialog(this);
+    dialog.setOptions(options);
+    if(dialog.exec() != QDialog::Accepted) return;
+    options = dialog.getOptions();
+    settings.setValue("export/time", (int)options.time);
+    settings.setValue("export/delimiter", (int)options.delimiter);
+    settings.setValue("export/precision", options.precision);
+
+    QString error;
+    if(!exporter.start(fileName, storage, options, error)) {
+        showError("Cannot write into " + fileName + ": " + error);
+        return;
     }
 
-    file.close();
-    return (QFileDevice::NoError == error);
+    exportProgress = new QProgressDialog("Saving " + QFileInfo(fileName).fileName() + "...", "Cancel", 0, 100, this);
+    exportProgress->setWindowModality(Qt::WindowModal);
+    exportProgress->setMinimumDuration(500);
+    connect(exportProgress, &QProgressDialog::canceled, &exporter, &CsvExporter::cancel);
+    connect(&exporter, &CsvExporter::progress, exportProgress, [this](double percent) {
+        this->exportProgress->setValue((int)percent);
+    } );
 }
 
-void MainWindow::on_actionSaveLog_triggered()
+void MainWindow::on_exportFinished(bool ok, QString error, bool cancelled, qint64 rows, qint64 elapsedMs)
+{
+    exportProgress->deleteLater();
+    exportProgress = nullptr;
+
+    if(!ok)
+        showError("Cannot save the log: " + error);
+    else if(!cancelled)
+        ui->statusBar->showMessage(QString("Log saved: %1 rows in %2 s").arg(rows).arg(elapsedMs / 1000.0, 0, 'f', 2), 10000);
+}
+
+void MainWindow::on_actionSaveSession_triggered()
 {
     QString fileName = QFileDialog::getSaveFileName(this,
-        "Save Log", QString(), "CSV tables (*.csv);;Test files (*.txt);;All files (*)");
+        "Save Session", QString(), "Sessions (*.elss);;All files (*)");
+    if(fileName.isEmpty()) return;
+    if(QFileInfo(fileName) == QFileInfo(storage.getSessionFileName())) {
+        showError("Cannot write into " + fileName + ": the opened session is read from it");
+        return;
+    }
+
+    SessionWriter writer;
+    QString error;
+    bool ok = writer.open(fileName, storage.getBegin(), error);
+    for(size_t i = 0, len = storage.size(); ok && i < len; ++i)
+        ok = writer.append(storage.sample(i), error);
+    if(ok) ok = writer.close(error);
+
+    if(!ok)
+        showError("Cannot write into " + fileName + ": " + error);
+    else
+        ui->statusBar->showMessage(QString("Session saved: %1 samples, %2 KB")
+            .arg(storage.size()).arg(QFileInfo(fileName).size() / 1024), 10000);
+}
+
+void MainWindow::on_actionOpenSession_triggered()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+        "Open Session", QString(), "Sessions (*.elss);;All files (*)");
     if(fileName.isEmpty()) return;
 
-    QFile file(fileName);
-    if(!saveStorageToCsvFile(storage, file)) {
-        showError("Cannot write into " + fileName + ": " + file.errorString());
+    // the samples stay in the file, chunks are read when they are shown or exported
+    QString error;
+    if(!storage.openSession(fileName, error)) {
+        showError("Cannot open " + fileName + ": " + error);
+        return;
+    }
+    ui->statusBar->showMessage(QString("Session opened: %1 samples").arg(storage.size()), 10000);
+}
+
+void MainWindow::on_actionKeepAllSamples_toggled(bool checked)
+{
+    QString error;
+    if(!storage.setSpilling(checked, error)) {
+        QSignalBlocker blocker(ui->actionKeepAllSamples);
+        ui->actionKeepAllSamples->setChecked(false);
+        showError("Cannot create a temporary file: " + error);
     }
 }
 
+void MainWindow::on_spillError(QString msg)
+{
+    showError("Cannot spill samples: " + msg + "\nThe spilled samples are kept, new ones are not stored. "
+              "Turn off Keep All Samples to go on with the latest ones only.");
+}
+
 void MainWindow::on_runButton_clicked()
 {
 }
@@ -366,6 +602,8 @@ void MainWindow::setupTemperatureBox()
     static QColor cFull(238, 154, 0);
     static QColor cLimit(223, 32, 32);
 
+    const CmdConfigData& deviceConfigData = session->getConfig();
+
     double min = 1/(double)deviceConfigData.tempDefect;
     double low = 1/(double)deviceConfigData.tempFanLow;
     double mid = 1/(double)deviceConfigData.tempFanMid;
@@ -388,6 +626,7 @@ void MainWindow::setupTemperatureBox()
 }
 
 void MainWindow::updateDeviceSettings() {
+    const CmdConfigData& deviceConfigData = session->getConfig();
     setupTemperatureBox();
     ui->uLimitBox->setMinimum((double)deviceConfigData.uSetMin / 1000.0);
     ui->uLimitBox->setMaximum((double)deviceConfigData.uSetMax / 1000.0);
@@ -395,127 +634,80 @@ void MainWindow::updateDeviceSettings() {
     ui->currentBox->setMaximum((double)deviceConfigData.iSetMax / 1000.0);
 }
 
-Sample MainWindow::parseSample(CmdStateData *c, qint64 timestamp)
+void MainWindow::on_deviceVersion(uint32_t v)
 {
-    Sample s;
-    if(this->interval > 0)
-        s.timestamp = ((timestamp + this->interval/2) / this->interval) * this->interval; // round up to interval borders
-    else
-        s.timestamp = timestamp;
+    deviceVersionLabel->setText("0x" + QString("%1").arg(v, 8, 16, QChar('0')).toUpper());
+    deviceVersionLabel->setVisible(true);
+}
 
-    bool is4Wire = (c->uSense + 100 >= c->uMain);
-    uint16_t u = (is4Wire ? c->uSense : c->uMain);
-    if(abs((int)u - (int)deviceLastU) < U_THRESHOLD)
-        u = deviceLastU;
+void MainWindow::on_deviceConfig(const CmdConfigData& c)
+{
+    if(c.fun == 0)
+        ui->fun1Button->setChecked(true);
     else
-        deviceLastU = u;
-
-    s.u = qFloor((double)u / 10.0 + 0.5) / 100.0; // FIXME good? or s.u = (double)u / 1000;
-    s.i = (double)deviceCurrent / 1000;
-    s.ah = (double)c->ah / 1000;
-    s.wh = (double)c->wh / 1000;
+        ui->fun2Button->setChecked(true);
 
-    return s;
+    ui->soundBox->setChecked(c.beepOn);
+    updateFun();
+    updateDeviceSettings();
 }
 
-void MainWindow::on_serData(QByteArray d, qint64 timestamp)
+void MainWindow::on_deviceSettings(uint16_t u, uint16_t i)
 {
-    CmdData* cmd = parseCmdData(d);
-    if(cmd != nullptr) {
-        if(cmd->state == CmdState::Response || cmd->state == CmdState::Event) {
-            switch(cmd->cmd) {
-                case Cmd::Reboot:
-                    if(cmd->state == CmdState::Event) // the device was restarted, re-config it
-                        configDevice();
-                    break;
-
-                case Cmd::ReadConfig:
-                    {
-                        CmdConfigData* c = static_cast<CmdConfigData*>(cmd);
-                        deviceConfigData = *c;
-
-                        if(deviceConfigData.fun == 0)
-                            ui->fun1Button->setChecked(true);
-                        else
-                            ui->fun2Button->setChecked(true);
-
-                        ui->soundBox->setChecked(deviceConfigData.beepOn);
-                        updateFun();
-                        updateDeviceSettings();
-                    }
-                    break;
-
-                case Cmd::ReadSettings:
-                    {
-                        CmdSettingData* c = static_cast<CmdSettingData*>(cmd);
-                        ui->uLimitBox->setValue((double)c->u / 1000);
-                        ui->currentBox->setValue((double)c->i / 1000);
-                        deviceCurrent = c->i;
-                    }
-                    break;
-
-                case Cmd::GetVersion:
-                    {
-                        CmdVersionData* c = static_cast<CmdVersionData*>(cmd);
-                        deviceVersionLabel->setText("0x" + QString("%1").arg(c->v, 8, 16, QChar('0')).toUpper());
-                        deviceVersionLabel->setVisible(true);
-                    }
-                    break;
+    ui->uLimitBox->setValue((double)u / 1000);
+    ui->currentBox->setValue((double)i / 1000);
+}
 
-                case Cmd::GetState:
-                    {
-                        CmdStateData* c = static_cast<CmdStateData*>(cmd);
-                        Sample s = parseSample(c, timestamp);
-                        if(c->mode == DeviceMode::Fun1Run || c->mode == DeviceMode::Fun2Run)
-                            emit sample(s);
-
-                        QString deviceMessage;
-                        if(c->error) {
-                            if(c->error & DEVICE_ERROR_POLARITY) addError(deviceMessage, "Polarity error");
-                            if(c->error & DEVICE_ERROR_SUPPLY)   addError(deviceMessage, "Supply error");
-                            if(c->error & DEVICE_ERROR_OUP)      addError(deviceMessage, "Overvoltage");
-                            if(c->error & DEVICE_ERROR_OTP)      addError(deviceMessage, "Overheat");
-                            if(c->error & DEVICE_ERROR_ERT)      addError(deviceMessage, "Temperature sensor defect");
-                        }
-                        else {
-                            switch(c->mode) {
-                                case DeviceMode::Booting:  deviceMessage = "Booting";     break;
-                                case DeviceMode::MenuFun:  deviceMessage = "Menu";        break;
-                                case DeviceMode::MenuBeep: deviceMessage = "Menu";        break;
-                                case DeviceMode::MenuCalV: deviceMessage = "Menu";        break;
-                                case DeviceMode::MenuCalI: deviceMessage = "Menu";        break;
-                                case DeviceMode::CalV1:    deviceMessage = "Calibration"; break;
-                                case DeviceMode::CalV2:    deviceMessage = "Calibration"; break;
-                                case DeviceMode::CalI1r:   deviceMessage = "Calibration"; break;
-                                case DeviceMode::CalI1v:   deviceMessage = "Calibration"; break;
-                                case DeviceMode::CalI2r:   deviceMessage = "Calibration"; break;
-                                case DeviceMode::CalI2v:   deviceMessage = "Calibration"; break;
-                                case DeviceMode::Fun1:     deviceMessage = "Idle";        break;
-                                case DeviceMode::Fun1Run:  deviceMessage = "Run";         break;
-                                case DeviceMode::Fun2:     deviceMessage = "Idle";        break;
-                                case DeviceMode::Fun2Pre:  deviceMessage = "Run";         break;
-                                case DeviceMode::Fun2Run:  deviceMessage = "Run";         break;
-                                case DeviceMode::Fun2Warn: deviceMessage = "Stop";        break;
-                                case DeviceMode::Fun2Res:  deviceMessage = "Stop";        break;
-                            }
-                        }
-                        deviceMessageLabel->setText(deviceMessage);
-                        deviceMessageLabel->setVisible(true);
-
-                        bool is4Wire = (c->uSense + 100 >= c->uMain);
-                        ui->uActualBox->setText(QString("%L1 V").arg(s.u, 0, 'f', 2));
-                        ui->energyBox->setText(QString("%L1 A⋅h (%L2 W⋅h)").arg(s.ah, 0, 'f', 3).arg(s.wh, 0, 'f', 3));
-                        ui->wireLabel->setVisible(is4Wire);
-                        ui->temperatureBox->setValue(1/(double)c->tempRaw);
-                    }
-                    break;
+void MainWindow::showDeviceState(const CmdStateData& c, const Sample& s)
+{
+    lastState = c;
+    lastSample = s;
+    renderer.markDirty(stateRender);
+}
 
-                default:
-                    ;
-            }
+void MainWindow::renderDeviceState()
+{
+    const CmdStateData& c = lastState;
+    const Sample& s = lastSample;
+
+    QString deviceMessage;
+    if(c.error) {
+        if(c.error & DEVICE_ERROR_POLARITY) addError(deviceMessage, "Polarity error");
+        if(c.error & DEVICE_ERROR_SUPPLY)   addError(deviceMessage, "Supply error");
+        if(c.error & DEVICE_ERROR_OUP)      addError(deviceMessage, "Overvoltage");
+        if(c.error & DEVICE_ERROR_OTP)      addError(deviceMessage, "Overheat");
+        if(c.error & DEVICE_ERROR_ERT)      addError(deviceMessage, "Temperature sensor defect");
+    }
+    else {
+        switch(c.mode) {
+            case DeviceMode::Booting:  deviceMessage = "Booting";     break;
+            case DeviceMode::MenuFun:  deviceMessage = "Menu";        break;
+            case DeviceMode::MenuBeep: deviceMessage = "Menu";        break;
+            case DeviceMode::MenuCalV: deviceMessage = "Menu";        break;
+            case DeviceMode::MenuCalI: deviceMessage = "Menu";        break;
+            case DeviceMode::CalV1:    deviceMessage = "Calibration"; break;
+            case DeviceMode::CalV2:    deviceMessage = "Calibration"; break;
+            case DeviceMode::CalI1r:   deviceMessage = "Calibration"; break;
+            case DeviceMode::CalI1v:   deviceMessage = "Calibration"; break;
+            case DeviceMode::CalI2r:   deviceMessage = "Calibration"; break;
+            case DeviceMode::CalI2v:   deviceMessage = "Calibration"; break;
+            case DeviceMode::Fun1:     deviceMessage = "Idle";        break;
+            case DeviceMode::Fun1Run:  deviceMessage = "Run";         break;
+            case DeviceMode::Fun2:     deviceMessage = "Idle";        break;
+            case DeviceMode::Fun2Pre:  deviceMessage = "Run";         break;
+            case DeviceMode::Fun2Run:  deviceMessage = "Run";         break;
+            case DeviceMode::Fun2Warn: deviceMessage = "Stop";        break;
+            case DeviceMode::Fun2Res:  deviceMessage = "Stop";        break;
         }
     }
-    executeNext();
+    deviceMessageLabel->setText(deviceMessage);
+    deviceMessageLabel->setVisible(true);
+
+    bool is4Wire = (c.uSense + 100 >= c.uMain);
+    ui->uActualBox->setText(QString("%L1 V").arg(s.u, 0, 'f', 2));
+    ui->energyBox->setText(QString("%L1 A⋅h (%L2 W⋅h)").arg(s.ah, 0, 'f', 3).arg(s.wh, 0, 'f', 3));
+    ui->wireLabel->setVisible(is4Wire);
+    ui->temperatureBox->setValue(1/(double)c.tempRaw);
 }
 
 void MainWindow::on_serStateChanged(Comm::State state)
@@ -523,52 +715,28 @@ void MainWindow::on_serStateChanged(Comm::State state)
     switch(state) {
         case Comm::State::Connected:
             setControlEnabled(true);
-            configDevice();
-            deviceLastU = 0xFFFF;
             break;
 
         case Comm::State::Idle:
+            renderer.renderNow(); // a pending state must not show up after the labels are cleared
             setControlEnabled(false);
             deviceVersionLabel->setVisible(false);
             deviceVersionLabel->clear();
             deviceMessageLabel->setVisible(false);
             deviceMessageLabel->clear();
+            deviceLostLabel->setVisible(false);
+            deviceLostLabel->clear();
             break;
     }
-    executeNext();
-}
-
-void MainWindow::configDevice()
-{
-    this->interval = ui->intervalBox->value();
-
-    toExecute.clear();
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::GetVersion)));
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ReadConfig)));
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ReadSettings)));
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(CmdFlowStateData(this->interval))));
-    executeNext();
 }
 
-void MainWindow::executeNext()
+void MainWindow::on_deviceLost(quint64 lost, quint64 lostFast)
 {
-    if(toExecute.isEmpty()) return;
-
-    ToExecute e = toExecute.dequeue();
-    switch(e.action) {
-        case ToExecute::Action::Send:
-            emit send(e.data);
-            break;
-
-    case ToExecute::Action::Disconnect:
-        disconnectSer();
-        break;
-
-
-    case ToExecute::Action::StartUpgrade:
-        startUpgrade(e.data);
-        break;
-    }
+    if(lostFast == 0)
+        deviceLostLabel->setText(QString("Lost: %1").arg(lost));
+    else
+        deviceLostLabel->setText(QString("Lost: %1, fast: %2").arg(lost).arg(lostFast));
+    deviceLostLabel->setVisible(true);
 }
 
 void MainWindow::on_limitUpdateButton_clicked()
@@ -576,9 +744,8 @@ void MainWindow::on_limitUpdateButton_clicked()
     CmdSettingData d(Cmd::WriteSettings, CmdState::Request);
     d.u = (uint16_t)(ui->uLimitBox->value() * 1000 + 0.5);
     d.i = (uint16_t)(ui->currentBox->value() * 1000 + 0.5);
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(d)));
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ReadSettings)));
-    executeNext();
+    session->request(formCmdData(d));
+    session->request(formCmdData(Cmd::ReadSettings));
 }
 
 void MainWindow::on_uLimitBox_editingFinished()
@@ -593,21 +760,19 @@ void MainWindow::on_currentBox_editingFinished()
 
 void MainWindow::on_actionDeviceConfiguration_triggered()
 {
-    CmdConfigData d = deviceConfigData;
+    CmdConfigData d = session->getConfig();
     ConfigDialog * dialog = new ConfigDialog(this, d);
-    connect(dialog, &ConfigDialog::send, comm, &Comm::send);
+    connect(dialog, &ConfigDialog::send, session, &DeviceSession::request); // queued with retries, like all other commands
     if(1 == dialog->exec()) {
-        toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(d)));
-        toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ReadConfig)));
-        executeNext();
+        session->request(formCmdData(d));
+        session->request(formCmdData(Cmd::ReadConfig));
     }
     delete dialog;
 }
 
 void MainWindow::on_energyResetButton_clicked()
 {
-    toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::ResetState)));
-    executeNext();
+    session->request(formCmdData(Cmd::ResetState));
 }
 
 // note: length not checked
@@ -754,14 +919,13 @@ void MainWindow::on_actionUpgradeFirmware_triggered()
     }
 
     if(isConnected) {
-        toExecute.clear();
-        toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(CmdBootloaderData(true))));
-        toExecute.enqueue(ToExecute(ToExecute::Action::Send, formCmdData(Cmd::Reboot)));
-        toExecute.enqueue(ToExecute(ToExecute::Action::Disconnect));
+        session->clearQueue();
+        session->request(formCmdData(CmdBootloaderData(true)));
+        session->request(formCmdData(Cmd::Reboot));
+        session->call([this]() { disconnectSer(); });
     }
 
-    toExecute.enqueue(ToExecute(ToExecute::Action::StartUpgrade, fileContent));
-    executeNext();
+    session->call([this, fileContent]() { startUpgrade(fileContent); });
 }
 
 void MainWindow::startUpgrade(const QByteArray &data)
@@ -775,12 +939,7 @@ void MainWindow::startUpgrade(const QByteArray &data)
     emit cancelUpgradeDevice();
 
     delete dialog;
-    executeNext();
-}
-
-void MainWindow::clearDeviceInfo()
-{
-    memset(&deviceConfigData, 0, sizeof(deviceConfigData));
+    session->executeNext();
 }
 
 void MainWindow::on_flasherError(QString msg)
@@ -791,65 +950,92 @@ void MainWindow::on_flasherError(QString msg)
 
 void MainWindow::on_actionLoadRawLog_triggered()
 {
+    if(importer.isRunning()) return;
+
     QString fileName = QFileDialog::getOpenFileName(this,
         tr("Select RAW-log file"), "",
         tr("Text Files (*.txt *.raw *.log);;All Files (*)"));
     if(fileName.isEmpty()) return;
 
-    QFile inputFile(fileName);
-    int skippedLines = 0;
-    QVector<Sample> list;
-    if(inputFile.open(QIODevice::ReadOnly)) {
-        QTextStream in(&inputFile);
-        for(;;) {
-            QString line = in.readLine();
-            if(line.isNull()) break;
-
-            QStringList tokens = line.split(',');
-            if(tokens.length() != 2) {
-                ++skippedLines;
-                continue;
-            }
+    QString error;
+    importClock.reset();
+    if(!importer.start(fileName, error)) {
+        showError(QString("Cannot open file %1: %2").arg(fileName, error));
+        return;
+    }
 
-            bool ok;
-            qint64 timestamp = tokens[0].toLongLong(&ok);
-            if(!ok) {
-                ++skippedLines;
-                continue;
-            }
+    importProgress = new QProgressDialog("Loading " + QFileInfo(fileName).fileName() + "...", "Cancel", 0, 1000, this);
+    importProgress->setWindowModality(Qt::WindowModal);
+    importProgress->setMinimumDuration(500);
+    connect(importProgress, &QProgressDialog::canceled, &importer, &RawLogImporter::cancel);
+    connect(&importer, &RawLogImporter::progress, importProgress, [this](double percent) {
+        this->importProgress->setValue((int)(percent * 10));
+    } );
+}
 
-            if(!tokens[1].startsWith("s") && !tokens[1].startsWith("S")) {
-                ++skippedLines;
-                continue;
-            }
+void MainWindow::on_importStates(const QVector<RawLogImporter::State>& list)
+{
+    // in file order, the device clock and the filters of the session see them as if received
+    QVector<Sample> samples;
+    samples.reserve(list.size());
+    for(const RawLogImporter::State& st : list) {
+        Sample s = session->parseSample(st.c, st.timestamp, importClock);
+        if(st.c.mode == DeviceMode::Fun1Run || st.c.mode == DeviceMode::Fun2Run)
+            samples.push_back(s);
+    }
 
-            QByteArray data = QByteArray::fromHex(tokens[1].toUtf8()); // 'S' will be skipped
-            char crc = std::accumulate(data.begin(), data.end(), 0, crc8);
-            if(crc != 0) {
-                ++skippedLines;
-                continue;
-            }
+    if(!samples.isEmpty())
+        emit sampleMultiple(samples);
+}
 
-            QByteArray buf;
-            buf.append(data.data(), data.size()-1);
+void MainWindow::on_importFinished(const RawLogImporter::Stats& stats)
+{
+    importProgress->deleteLater();
+    importProgress = nullptr;
+
+    if(stats.bytes > 0) {
+        double seconds = stats.elapsedMs / 1000.0;
+        ui->statusBar->showMessage(QString("Raw log %1: %2 MB in %3 s, %4 s/GB")
+            .arg(stats.cancelled ? "cancelled" : "loaded")
+            .arg(stats.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(seconds, 0, 'f', 2)
+            .arg(seconds * (1 << 30) / stats.bytes, 0, 'f', 2), 10000);
+    }
 
-            CmdData* cmd = parseCmdData(buf);
-            if(cmd != nullptr && cmd->state == CmdState::Event && cmd->cmd == Cmd::GetState) {
-                CmdStateData* c = static_cast<CmdStateData*>(cmd);
-                Sample s = parseSample(c, timestamp * 1000);
-                if(c->mode == DeviceMode::Fun1Run || c->mode == DeviceMode::Fun2Run)
-                    list.push_back(s);
-            }
-        }
-        inputFile.close();
+    if(!stats.cancelled && stats.skipped > 0)
+        showError(QString("Read successfully, but %1 lines skipped.").arg(stats.skipped));
+}
 
-        if(!list.isEmpty())
-            emit sampleMultiple(list);
+void MainWindow::on_fastStreamCheckBox_toggled(bool checked)
+{
+    session->setFastStream(checked);
+}
+
+void MainWindow::on_actionNativeSerial_toggled(bool checked)
+{
+    session->setPortBackend(checked ? Comm::Backend::Native : Comm::Backend::Qt);
+}
 
-        if(skippedLines > 0)
-            showError(QString("Read successfully, but %1 lines skipped.").arg(skippedLines));
+void MainWindow::on_actionCapture_toggled(bool checked)
+{
+    if(!checked) {
+        session->setCaptureFile(QString());
+        return;
     }
-    else {
-        showError(QString("Cannot opene file %1").arg(fileName));
+
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Capture Traffic", QString(), "Link captures (*.elcap);;All files (*)");
+    if(fileName.isEmpty()) {
+        QSignalBlocker blocker(ui->actionCapture);
+        ui->actionCapture->setChecked(false);
+        return;
     }
+    session->setCaptureFile(fileName);
+}
+
+void MainWindow::on_captureError(QString msg)
+{
+    QSignalBlocker blocker(ui->actionCapture);
+    ui->actionCapture->setChecked(false);
+    showError(msg);
 }
@@ -3,10 +3,17 @@
 
 #include "decoder.h"
 #include "comm.h"
+#include "devicesession.h"
 #include "flasher.h"
 #include "samplestorage.h"
+#include "channellod.h"
 #include "curvedata.h"
 #include "tablemodel.h"
+#include "deviceclock.h"
+#include "rawlogimporter.h"
+#include "csvexporter.h"
+#include "sessionfile.h"
+#include "renderscheduler.h"
 
 #include <qwt_color_map.h>
 
@@ -17,9 +24,13 @@
 #include <QPointF>
 #include <QThread>
 #include <QLabel>
+#include <QProgressDialog>
 
 #include <stdint.h>
 
+class QwtPlotCurve;
+class QwtPlotDirectPainter;
+
 namespace Ui {
 class MainWindow;
 }
@@ -32,9 +43,6 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
-public:
-    static const int MIN_INTERVAL_MS = 250;
-
 private slots:
     void on_portBox_currentIndexChanged(int index);
 
@@ -44,11 +52,19 @@ private slots:
 
     void on_actionShowControl_triggered();
 
+    void on_actionResetZoom_triggered();
+
     void on_connectButton_clicked();
 
     void on_serError(QString msg);
 
-    void on_serData(QByteArray d, qint64 timestamp);
+    void on_deviceVersion(uint32_t v);
+
+    void on_deviceConfig(const CmdConfigData& c);
+
+    void on_deviceSettings(uint16_t u, uint16_t i);
+
+    void on_deviceLost(quint64 lost, quint64 lostFast);
 
     void on_serStateChanged(Comm::State state);
 
@@ -78,11 +94,29 @@ private slots:
 
     void on_actionLoadRawLog_triggered();
 
+    void on_fastStreamCheckBox_toggled(bool checked);
+
+    void on_actionNativeSerial_toggled(bool checked);
+
+    void on_actionCapture_toggled(bool checked);
+
+    void on_captureError(QString msg);
+
+    void on_importStates(const QVector<RawLogImporter::State>& list);
+
+    void on_importFinished(const RawLogImporter::Stats& stats);
+
+    void on_exportFinished(bool ok, QString error, bool cancelled, qint64 rows, qint64 elapsedMs);
+
+    void on_actionSaveSession_triggered();
+
+    void on_actionOpenSession_triggered();
+
+    void on_actionKeepAllSamples_toggled(bool checked);
+
+    void on_spillError(QString msg);
+
 signals:
-    void portConnect(QString portName);
-    void portDisconnect();
-    void send(QByteArray data);
-    void sample(Sample s);
     void sampleMultiple(const QVector<Sample> &list);
     void upgradeDevice(QString portName, QByteArray fileContent);
     void cancelUpgradeDevice();
@@ -94,55 +128,49 @@ private:
     void setControlEnabled(bool state);
     void connectSer();
     void disconnectSer();
-    void executeNext();
-    void configDevice();
     void updateFun();
     void setupTemperatureBox();
     void startUpgrade(const QByteArray& data);
-    void clearDeviceInfo();
     void updateDeviceSettings();
-    Sample parseSample(CmdStateData* c, qint64 timestamp);
-
-private:
-    struct ToExecute {
-        enum class Action {
-            Send,
-            Disconnect,
-            StartUpgrade,
-        };
-
-        Action action;
-        QByteArray data;
-
-        ToExecute() {}
-
-        ToExecute(const ToExecute& o) : action(o.action), data(o.data) {}
-
-        ToExecute(Action action_) : action(action_) {}
-
-        ToExecute(Action action_, QByteArray data_) : action(action_), data(data_) {}
-    };
+    void showDeviceState(const CmdStateData& c, const Sample& s); // the latest one is rendered once a frame
+    void renderDeviceState();
+    void renderGraph();
+    bool isRescaleNeeded() const; // autoscaling would change an axis
+    void setGraphChannel(int channel); // CurveData::Channel on the right axis, -1 - none
 
 private:
     Ui::MainWindow *ui;
 
-    Comm *comm;
-    QThread commThread;
+    CommPool commPool;
+    DeviceSession *session;
     Flasher *flasher;
     QThread flasherThread;
     bool isConnected;
     QString currentPort;
-    QQueue<ToExecute> toExecute;
-    int interval;
-    uint16_t deviceCurrent;
-    uint16_t deviceLastU;
-    CmdConfigData deviceConfigData;
 
     SampleStorage storage;
+    ChannelLod channels;          // the levels of detail of the curves
+    RawLogImporter importer;
+    DeviceClock importClock;
+    QProgressDialog* importProgress;
+    CsvExporter exporter;
+    QProgressDialog* exportProgress;
     CurveData *data;
+    QwtPlotCurve *curve;
+    CurveData *channelData;       // null - none
+    QwtPlotCurve *channelCurve;
+    QwtPlotDirectPainter *graphPainter;
     TableModel *tableModel;
     QLabel* deviceVersionLabel;
     QLabel* deviceMessageLabel;
+    QLabel* deviceLostLabel;
+    RenderScheduler renderer;
+    int graphRender;
+    int tableRender;
+    int stateRender;
+    bool graphStale;              // needs a full replot
+    CmdStateData lastState;
+    Sample lastSample;
 };
 
 #endif // MAINWINDOW_H
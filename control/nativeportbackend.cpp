@@ -0,0 +1,263 @@
+#include "nativeportbackend.h"
+
+#include <QDateTime>
+
+#include <algorithm>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+// =============================================================================================================
+
+static speed_t toSpeed(qint32 baudRate)
+{
+    switch(baudRate) {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return 0;
+    }
+}
+
+NativePortBackend::NativePortBackend(QObject *parent) :
+    PortBackend(parent),
+    fd(-1),
+    epollFd(-1),
+    stopFd(-1),
+    notified(false),
+    lastTimestamp(0)
+{
+}
+
+NativePortBackend::~NativePortBackend()
+{
+    close();
+}
+
+bool NativePortBackend::open(const QString& name, qint32 baudRate)
+{
+    close();
+
+    speed_t speed = toSpeed(baudRate);
+    if(!speed) return false;
+
+    fd = ::open(name.toLocal8Bit().constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0) return false;
+    ioctl(fd, TIOCEXCL); // one user at a time, as QSerialPort does
+
+    struct termios t;
+    if(tcgetattr(fd, &t) != 0) {
+        close();
+        return false;
+    }
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+    t.c_iflag &= ~(IXON | IXOFF | IXANY);
+    // VMIN/VTIME don't apply to the non-blocking fd: epoll wakes the reader on the first byte
+    // and a read takes whatever is there
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    if(tcsetattr(fd, TCSANOW, &t) != 0) {
+        close();
+        return false;
+    }
+
+    // pushes received bytes to the line discipline at once instead of deferred work, if the driver supports it
+    struct serial_struct ss;
+    if(ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+        ss.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &ss);
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(epollFd < 0 || stopFd < 0) {
+        close();
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    ev.data.fd = stopFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &ev);
+
+    notified = false;
+    reader = std::thread(&NativePortBackend::run, this);
+    return true;
+}
+
+void NativePortBackend::close()
+{
+    if(reader.joinable()) {
+        uint64_t one = 1;
+        (void)::write(stopFd, &one, sizeof(one));
+        reader.join();
+    }
+
+    if(stopFd >= 0)  ::close(stopFd);
+    if(epollFd >= 0) ::close(epollFd);
+    if(fd >= 0)      ::close(fd);
+    stopFd  = -1;
+    epollFd = -1;
+    fd      = -1;
+
+    chunks.clear();
+    notified = false;
+    pending.clear();
+}
+
+bool NativePortBackend::isOpen() const
+{
+    return fd >= 0;
+}
+
+bool NativePortBackend::setBaudRate(qint32 baudRate)
+{
+    speed_t speed = toSpeed(baudRate);
+    if(fd < 0 || !speed) return false;
+
+    struct termios t;
+    if(tcgetattr(fd, &t) != 0) return false;
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+void NativePortBackend::run()
+{
+    struct epoll_event events[2];
+    char buf[CHUNK_SIZE];
+
+    for(;;) {
+        int n = epoll_wait(epollFd, events, 2, -1);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return;
+        }
+
+        bool writable = false;
+        bool notify   = false;
+        for(int i = 0; i < n; ++i) {
+            if(events[i].data.fd == stopFd) return;
+
+            if(events[i].events & EPOLLOUT) writable = true;
+            if(!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) continue;
+
+            for(;;) {
+                ssize_t r = ::read(fd, buf, sizeof(buf));
+                if(r > 0) {
+                    Chunk c;
+                    c.timestamp = QDateTime::currentMSecsSinceEpoch(); // stamped on arrival, not when the owner gets to it
+                    c.data      = QByteArray(buf, (int)r);
+                    c.pos       = 0;
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    chunks.enqueue(c);
+                    if(!notified) notified = notify = true;
+                }
+                else if(r < 0 && errno == EINTR) {
+                    continue;
+                }
+                else {
+                    if(r == 0 || errno != EAGAIN)
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr); // device is gone, don't spin on it
+                    break;
+                }
+            }
+        }
+
+        if(notify) QMetaObject::invokeMethod(this, "on_ready", Qt::QueuedConnection);
+        if(writable) {
+            watchWritable(false); // level triggered, the owner arms it again if still needed
+            QMetaObject::invokeMethod(this, "on_writable", Qt::QueuedConnection);
+        }
+    }
+}
+
+void NativePortBackend::on_ready()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        notified = false;
+    }
+    emit readyRead();
+}
+
+qint64 NativePortBackend::read(char* data, qint64 maxSize)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(chunks.isEmpty()) return 0;
+
+    // one chunk at most, every one has its own timestamp
+    Chunk& c = chunks.head();
+    qint64 n = std::min(maxSize, (qint64)(c.data.size() - c.pos));
+    memcpy(data, c.data.constData() + c.pos, n);
+    c.pos += n;
+    lastTimestamp = c.timestamp;
+    if(c.pos >= c.data.size()) chunks.dequeue();
+    return n;
+}
+
+qint64 NativePortBackend::readTimestamp() const
+{
+    return lastTimestamp;
+}
+
+qint64 NativePortBackend::write(const QByteArray& data)
+{
+    if(fd < 0) return -1;
+
+    if(!pending.isEmpty()) { // keep the order
+        pending.append(data);
+        return data.size();
+    }
+
+    ssize_t n = ::write(fd, data.constData(), data.size());
+    if(n < 0) {
+        if(errno != EAGAIN && errno != EINTR) return -1;
+        n = 0;
+    }
+    if(n < data.size()) {
+        pending = data.mid((int)n);
+        watchWritable(true);
+    }
+    if(n > 0) emit bytesWritten(n);
+    return data.size();
+}
+
+void NativePortBackend::on_writable()
+{
+    if(fd < 0 || pending.isEmpty()) return;
+
+    ssize_t n = ::write(fd, pending.constData(), pending.size());
+    if(n > 0) {
+        pending.remove(0, (int)n);
+        emit bytesWritten(n);
+    }
+    if(!pending.isEmpty()) watchWritable(true);
+}
+
+void NativePortBackend::watchWritable(bool on)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN | (on ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
@@ -0,0 +1,59 @@
+#ifndef NATIVEPORTBACKEND_H
+#define NATIVEPORTBACKEND_H
+
+#include "portbackend.h"
+
+#include <QByteArray>
+#include <QQueue>
+
+#include <mutex>
+#include <thread>
+
+// Linux only: raw termios, a reader thread on epoll and ASYNC_LOW_LATENCY where the driver supports it.
+// The reader drains the driver as soon as bytes arrive and stamps them, the owner thread is only notified.
+class NativePortBackend : public PortBackend
+{
+    Q_OBJECT
+
+public:
+    explicit NativePortBackend(QObject *parent = 0);
+    ~NativePortBackend();
+
+    bool open(const QString& name, qint32 baudRate) override;
+    void close() override;
+    bool isOpen() const override;
+    bool setBaudRate(qint32 baudRate) override;
+    qint64 read(char* data, qint64 maxSize) override;
+    qint64 readTimestamp() const override;
+    qint64 write(const QByteArray& data) override;
+
+    static const int CHUNK_SIZE = 4096;
+
+private slots:
+    void on_ready();
+    void on_writable();
+
+private:
+    struct Chunk {
+        qint64 timestamp;   // ms since epoch
+        QByteArray data;
+        int pos;            // already read
+    };
+
+private:
+    void run();              // reader thread
+    void watchWritable(bool on);
+
+private:
+    int fd;
+    int epollFd;
+    int stopFd;              // eventfd, wakes the reader to exit
+    std::thread reader;
+    std::mutex lock;         // chunks and notified
+    QQueue<Chunk> chunks;
+    bool notified;           // on_ready is queued
+    qint64 lastTimestamp;
+    QByteArray pending;      // not taken by the driver yet, owner thread only
+};
+
+#endif // NATIVEPORTBACKEND_H
@@ -0,0 +1,50 @@
+#include "portbackend.h"
+
+#include <QDateTime>
+
+// =============================================================================================================
+
+QtPortBackend::QtPortBackend(QObject *parent) :
+    PortBackend(parent)
+{
+    ser = new QSerialPort(this);
+    connect(ser, &QSerialPort::readyRead, this, &PortBackend::readyRead);
+    connect(ser, &QSerialPort::bytesWritten, this, &PortBackend::bytesWritten);
+}
+
+bool QtPortBackend::open(const QString& name, qint32 baudRate)
+{
+    ser->setPortName(name);
+    ser->setBaudRate(baudRate);
+    return ser->open(QIODevice::ReadWrite);
+}
+
+void QtPortBackend::close()
+{
+    ser->close();
+}
+
+bool QtPortBackend::isOpen() const
+{
+    return ser->isOpen();
+}
+
+bool QtPortBackend::setBaudRate(qint32 baudRate)
+{
+    return ser->setBaudRate(baudRate);
+}
+
+qint64 QtPortBackend::read(char* data, qint64 maxSize)
+{
+    return ser->read(data, maxSize);
+}
+
+qint64 QtPortBackend::readTimestamp() const
+{
+    return QDateTime::currentMSecsSinceEpoch(); // read just after readyRead
+}
+
+qint64 QtPortBackend::write(const QByteArray& data)
+{
+    return ser->write(data);
+}
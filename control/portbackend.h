@@ -0,0 +1,51 @@
+#ifndef PORTBACKEND_H
+#define PORTBACKEND_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QtSerialPort/QSerialPort>
+
+// The serial port as used by Comm: 8N1, no flow control, non-blocking
+class PortBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PortBackend(QObject *parent = 0) : QObject(parent) {}
+    virtual ~PortBackend() {}
+
+    virtual bool open(const QString& name, qint32 baudRate) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+    virtual bool setBaudRate(qint32 baudRate) = 0;
+    virtual qint64 read(char* data, qint64 maxSize) = 0;
+    virtual qint64 readTimestamp() const = 0;  // ms since epoch, when the data of the last read() arrived
+    virtual qint64 write(const QByteArray& data) = 0;
+
+signals:
+    void readyRead();
+    void bytesWritten(qint64 bytes); // taken by the driver
+};
+
+// QSerialPort, all platforms
+class QtPortBackend : public PortBackend
+{
+    Q_OBJECT
+
+public:
+    explicit QtPortBackend(QObject *parent = 0);
+
+    bool open(const QString& name, qint32 baudRate) override;
+    void close() override;
+    bool isOpen() const override;
+    bool setBaudRate(qint32 baudRate) override;
+    qint64 read(char* data, qint64 maxSize) override;
+    qint64 readTimestamp() const override;
+    qint64 write(const QByteArray& data) override;
+
+private:
+    QSerialPort *ser;
+};
+
+#endif // PORTBACKEND_H
@@ -0,0 +1,275 @@
+#include "rawlogimporter.h"
+#include "crc.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <cstring>
+
+// =============================================================================================================
+
+static const uint8_t NOT_HEX = 0xFF;
+
+struct HexDigits {
+    uint8_t v[256];
+
+    HexDigits() {
+        std::fill(v, v + sizeof(v), NOT_HEX);
+        for(int c = '0'; c <= '9'; ++c) v[c] = c - '0';
+        for(int c = 'A'; c <= 'F'; ++c) v[c] = c - 'A' + 10;
+        for(int c = 'a'; c <= 'f'; ++c) v[c] = c - 'a' + 10;
+    }
+};
+static const HexDigits HEX_DIGITS;
+
+enum class Line { Skipped, Other, State };
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// "seconds,S<hex>", frame is a scratch buffer
+static Line parseLine(const char* p, const char* end, std::vector<char>& frame, RawLogImporter::State& s)
+{
+    while(p < end && isSpace(*p)) ++p;
+    while(end > p && isSpace(end[-1])) --end;
+
+    const char* comma = (const char*)memchr(p, ',', end - p);
+    if(!comma || memchr(comma + 1, ',', end - comma - 1)) return Line::Skipped;
+
+    // timestamp
+    const char* t = p;
+    const char* tEnd = comma;
+    while(tEnd > t && isSpace(tEnd[-1])) --tEnd;
+    bool negative = false;
+    if(t < tEnd && (*t == '-' || *t == '+')) negative = (*t++ == '-');
+    if(t == tEnd) return Line::Skipped;
+    qint64 timestamp = 0;
+    for(; t < tEnd; ++t) {
+        if(*t < '0' || *t > '9') return Line::Skipped;
+        timestamp = timestamp * 10 + (*t - '0');
+    }
+    if(negative) timestamp = -timestamp;
+
+    // frame
+    const char* h = comma + 1;
+    while(h < end && isSpace(*h)) ++h;
+    if(h == end || (*h != 'S' && *h != 's')) return Line::Skipped;
+    ++h;
+
+    // as lenient as QByteArray::fromHex: from the end, other characters are ignored,
+    // an odd digit count leaves the first byte with the low nibble only
+    size_t capacity = (end - h + 1) / 2;
+    if(frame.size() < capacity) frame.resize(capacity);
+    char* first = frame.data() + capacity;
+    bool odd = true;
+    for(const char* c = end; c > h; ) {
+        uint8_t v = HEX_DIGITS.v[(uint8_t)*--c];
+        if(v == NOT_HEX) continue;
+        if(odd) *--first = (char)v;
+        else *first = (char)(*first | (v << 4));
+        odd = !odd;
+    }
+    size_t size = frame.data() + capacity - first;
+    if(size == 0 || crc8(0, first, size) != 0) return Line::Skipped;
+
+    QByteArray d = QByteArray::fromRawData(first, (int)size - 1); // without CRC, not copied
+    s.c = CmdStateData(Cmd::GetState, CmdState::Event);
+    if(!parseCmdData(d, s.c) || s.c.state != CmdState::Event || s.c.cmd != Cmd::GetState) return Line::Other;
+
+    s.timestamp = timestamp * 1000;
+    return Line::State;
+}
+
+// =============================================================================================================
+
+RawLogImporter::RawLogImporter(QObject *parent) :
+    QObject(parent),
+    data(nullptr),
+    threads(0),
+    next(0),
+    collected(0),
+    cancelled(false),
+    running(false),
+    collecting(false)
+{
+}
+
+RawLogImporter::~RawLogImporter()
+{
+    if(running) stop();
+}
+
+bool RawLogImporter::start(const QString& fileName, QString& error)
+{
+    if(running) {
+        error = "Another import is running";
+        return false;
+    }
+
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    qint64 size = file.size();
+    data = nullptr;
+    if(size > 0) {
+        data = (const char*)file.map(0, size);
+        if(!data) {
+            error = file.errorString();
+            file.close();
+            return false;
+        }
+    }
+
+    // chunks end after a newline, the last one at the end of the file
+    chunks.clear();
+    for(qint64 pos = 0; pos < size; ) {
+        qint64 end = std::min(pos + CHUNK_SIZE, size);
+        if(end < size) {
+            const char* nl = (const char*)memchr(data + end, '\n', size - end);
+            end = nl ? (nl - data) + 1 : size;
+        }
+        Chunk c;
+        c.begin   = data + pos;
+        c.end     = data + end;
+        c.done    = false;
+        c.lines   = 0;
+        c.skipped = 0;
+        chunks.push_back(c);
+        pos = end;
+    }
+
+    next      = 0;
+    collected = 0;
+    cancelled = false;
+    running   = true;
+    stats.bytes     = size;
+    stats.lines     = 0;
+    stats.skipped   = 0;
+    stats.elapsedMs = 0;
+    stats.cancelled = false;
+    clock.start();
+
+    threads = std::max(1, std::min(QThread::idealThreadCount(), (int)chunks.size()));
+    if(chunks.empty())
+        QMetaObject::invokeMethod(this, "collect", Qt::QueuedConnection);
+    else
+        for(int i = 0; i < threads; ++i)
+            workers.emplace_back(&RawLogImporter::work, this);
+
+    return true;
+}
+
+void RawLogImporter::cancel()
+{
+    if(running) finish(true);
+}
+
+void RawLogImporter::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        cancelled = true;
+    }
+    ahead.notify_all();
+    for(std::thread& w : workers)
+        w.join();
+    workers.clear();
+
+    chunks.clear();
+    if(data) file.unmap((uchar*)data);
+    data = nullptr;
+    file.close();
+    running = false;
+}
+
+void RawLogImporter::finish(bool cancelled)
+{
+    stop();
+
+    stats.elapsedMs = clock.elapsed();
+    stats.cancelled = cancelled;
+    emit finished(stats); // throughput is shown by the receiver
+}
+
+void RawLogImporter::work()
+{
+    for(;;) {
+        size_t i;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ahead.wait(guard, [this]() {
+                return cancelled || next >= chunks.size() || next < collected + (size_t)(MAX_AHEAD * threads);
+            } );
+            if(cancelled || next >= chunks.size()) return;
+            i = next++;
+        }
+
+        parseChunk(chunks[i]);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            chunks[i].done = true;
+        }
+        QMetaObject::invokeMethod(this, "collect", Qt::QueuedConnection);
+    }
+}
+
+void RawLogImporter::parseChunk(Chunk& chunk)
+{
+    std::vector<char> frame(64);
+    State s;
+    chunk.states.reserve((int)((chunk.end - chunk.begin) / 32));
+
+    for(const char* p = chunk.begin; p < chunk.end; ) {
+        const char* nl = (const char*)memchr(p, '\n', chunk.end - p);
+        const char* e = nl ? nl : chunk.end;
+
+        ++chunk.lines;
+        switch(parseLine(p, e, frame, s)) {
+            case Line::Skipped: ++chunk.skipped; break;
+            case Line::State: chunk.states.append(s); break;
+            case Line::Other: break;
+        }
+        p = e + 1;
+    }
+}
+
+void RawLogImporter::collect()
+{
+    if(!running || collecting) return; // the outer call picks the rest up
+
+    collecting = true;
+    qint64 done = 0;
+    for(;;) {
+        Chunk* c;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(cancelled || collected >= chunks.size() || !chunks[collected].done) break;
+            c = &chunks[collected];
+        }
+
+        QVector<State> list;
+        list.swap(c->states);
+        stats.lines   += c->lines;
+        stats.skipped += c->skipped;
+        done = c->end - chunks.front().begin;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ++collected;
+        }
+        ahead.notify_all();
+
+        if(!list.isEmpty()) emit states(list);
+        emit progress(100.0 * (double)done / (double)stats.bytes);
+        if(!running) break; // cancelled by a slot
+    }
+    collecting = false;
+
+    if(running && collected == chunks.size()) finish(false);
+}
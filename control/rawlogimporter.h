@@ -0,0 +1,90 @@
+#ifndef RAWLOGIMPORTER_H
+#define RAWLOGIMPORTER_H
+
+#include "decoder.h"
+
+#include <QObject>
+#include <QFile>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Imports a raw log ("seconds,S<hex frame with CRC>" per line) in the background.
+// The file is mapped and split into chunks at line borders, the chunks are parsed by a pool of threads
+// and the state events are delivered in file order on the thread of the importer.
+class RawLogImporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct State {
+        qint64 timestamp;    // ms since epoch
+        CmdStateData c;
+
+        State() : timestamp(0), c(Cmd::GetState, CmdState::Event) {}
+    };
+
+    struct Stats {
+        qint64 bytes;
+        quint64 lines;
+        quint64 skipped;     // not a valid frame
+        qint64 elapsedMs;
+        bool cancelled;
+    };
+
+    static const qint64 CHUNK_SIZE = 4 * 1024 * 1024;
+    static const int MAX_AHEAD = 4;   // chunks per thread parsed but not delivered yet
+
+public:
+    explicit RawLogImporter(QObject *parent = 0);
+    ~RawLogImporter();   // cancels silently
+
+    bool start(const QString& fileName, QString& error);
+    void cancel();       // states delivered so far are kept
+    bool isRunning() const { return running; }
+
+signals:
+    void states(const QVector<RawLogImporter::State>& list); // next ones in file order
+    void progress(double percent);
+    void finished(const RawLogImporter::Stats& stats);
+
+private slots:
+    void collect();      // deliver parsed chunks in order
+
+private:
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        bool done;       // guarded by lock
+        quint64 lines;
+        quint64 skipped;
+        QVector<State> states;
+    };
+
+    void work();
+    void parseChunk(Chunk& chunk);
+    void stop();         // joins the workers and unmaps the file
+    void finish(bool cancelled);
+
+private:
+    QFile file;
+    const char* data;        // mapped file, null if empty
+    std::vector<Chunk> chunks;
+    std::vector<std::thread> workers;
+    int threads;
+    std::mutex lock;
+    std::condition_variable ahead;
+    size_t next;             // chunk to parse
+    size_t collected;        // chunks delivered
+    bool cancelled;
+    bool running;
+    bool collecting;         // collect() is not re-entered from event processing in a slot
+    Stats stats;
+    QElapsedTimer clock;
+};
+
+#endif // RAWLOGIMPORTER_H
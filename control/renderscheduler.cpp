@@ -0,0 +1,65 @@
+#include "renderscheduler.h"
+
+#include <algorithm>
+
+// =============================================================================================================
+
+RenderScheduler::RenderScheduler(QObject *parent) :
+    QObject(parent),
+    rate(0),
+    rendered(0),
+    skipped(0)
+{
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &RenderScheduler::frame);
+    setRate(DEFAULT_RATE);
+}
+
+int RenderScheduler::addView(std::function<void()> render)
+{
+    View v;
+    v.render = render;
+    v.dirty = false;
+    views.push_back(v);
+    return (int)views.size() - 1;
+}
+
+void RenderScheduler::setRate(int fps)
+{
+    rate = std::max((int)MIN_RATE, std::min(fps, (int)MAX_RATE));
+    timer.setInterval(1000 / rate);
+}
+
+void RenderScheduler::markDirty(int view)
+{
+    View& v = views[view];
+    if(v.dirty) {
+        ++skipped;
+        return;
+    }
+
+    v.dirty = true;
+    if(!timer.isActive()) timer.start();
+}
+
+void RenderScheduler::renderNow()
+{
+    bool any = false;
+    for(View& v : views) {
+        if(!v.dirty) continue;
+        v.dirty = false; // the view may be marked again while rendering
+        v.render();
+        any = true;
+    }
+    if(any) ++rendered;
+}
+
+void RenderScheduler::frame()
+{
+    renderNow();
+
+    // idle after a frame without changes
+    for(const View& v : views)
+        if(v.dirty) return;
+    timer.stop();
+}
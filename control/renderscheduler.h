@@ -0,0 +1,52 @@
+#ifndef RENDERSCHEDULER_H
+#define RENDERSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+
+#include <functional>
+#include <vector>
+
+// Views are marked dirty when their data change and rendered at most once a frame.
+// The timer runs only while something is dirty.
+class RenderScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int MIN_RATE = 10;      // frames per second
+    static const int MAX_RATE = 60;
+    static const int DEFAULT_RATE = 30;
+
+public:
+    explicit RenderScheduler(QObject *parent = 0);
+
+    int addView(std::function<void()> render); // returns the view
+    void setRate(int fps);
+    int getRate() const { return rate; }
+
+    quint64 getRendered() const { return rendered; } // frames with at least one view rendered
+    quint64 getSkipped() const { return skipped; }   // changes merged into an already pending frame
+
+public slots:
+    void markDirty(int view);
+    void renderNow();                    // the dirty views, without waiting for the frame
+
+private slots:
+    void frame();
+
+private:
+    struct View {
+        std::function<void()> render;
+        bool dirty;
+    };
+
+private:
+    QTimer timer;
+    std::vector<View> views;
+    int rate;
+    quint64 rendered;
+    quint64 skipped;
+};
+
+#endif // RENDERSCHEDULER_H
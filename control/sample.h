@@ -13,4 +13,10 @@ struct Sample {
     double wh;
 };
 
+// high-rate channel, voltage only
+struct FastSample {
+    qint64 timestamp;
+    double u;
+};
+
 #endif // SAMPLE_H
@@ -0,0 +1,182 @@
+#include "samplelod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// =============================================================================================================
+
+const SampleLod::Bucket SampleLod::EMPTY = { std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), 0, 0, 0, 0 };
+
+// x goes after y
+static void merge(SampleLod::Bucket& y, const SampleLod::Bucket& x)
+{
+    if(x.min > x.max) return;
+    if(y.min > y.max) {
+        y = x;
+        return;
+    }
+    y.min = std::min(y.min, x.min);
+    y.max = std::max(y.max, x.max);
+    y.last = x.last;
+    y.lastTime = x.lastTime;
+}
+
+// =============================================================================================================
+
+void SampleLod::add(Bucket& b, qint64 timestamp, float v)
+{
+    if(std::isnan(v)) return;
+    if(b.min > b.max) {
+        b.first = v;
+        b.firstTime = timestamp;
+    }
+    if(v < b.min) b.min = v;
+    if(v > b.max) b.max = v;
+    b.last = v;
+    b.lastTime = timestamp;
+}
+
+// =============================================================================================================
+
+void SampleLod::clear(size_t removed)
+{
+    finest = MIN_LEVEL;
+    deleted = removed; // so that the buckets are the same as of a level of detail kept from the first sample
+    total = removed;
+    levels.clear();
+}
+
+void SampleLod::append(const Sample& s)
+{
+    // a new level once the top one would get a third bucket
+    if(levels.empty() || total >= ((size_t)2 << (finest + levels.size() - 1)))
+        addLevel();
+
+    float v = (float)value(s);
+    size_t a = total++;
+    for(size_t k = 0; k < levels.size(); ++k) {
+        Level& l = levels[k];
+        size_t b = a >> (finest + k);
+        if(b >= l.first + l.buckets.size())
+            l.buckets.push_back(EMPTY);
+        add(l.buckets.back(), s.timestamp, v);
+    }
+
+    if(levels.size() > 1 && levels[0].buckets.size() > MAX_BUCKETS) {
+        levels.erase(levels.begin());
+        ++finest;
+    }
+}
+
+void SampleLod::appendBucket(int level, const Bucket& bucket, size_t count)
+{
+    // finer levels can't be kept from a summary
+    while(finest < level && !levels.empty()) {
+        levels.erase(levels.begin());
+        ++finest;
+    }
+    if(levels.empty()) finest = std::max(finest, level);
+
+    if(levels.empty() || total >= ((size_t)2 << (finest + levels.size() - 1)))
+        addLevel();
+
+    size_t a = total;
+    total += count;
+    for(size_t k = 0; k < levels.size(); ++k) {
+        Level& l = levels[k];
+        size_t b = a >> (finest + k);
+        if(b >= l.first + l.buckets.size())
+            l.buckets.push_back(EMPTY);
+        merge(l.buckets.back(), bucket);
+    }
+
+    if(levels.size() > 1 && levels[0].buckets.size() > MAX_BUCKETS) {
+        levels.erase(levels.begin());
+        ++finest;
+    }
+}
+
+void SampleLod::del(size_t n)
+{
+    deleted = std::min(deleted + n, total);
+
+    // buckets partly deleted are kept with their values
+    for(size_t k = 0; k < levels.size(); ++k) {
+        Level& l = levels[k];
+        size_t firstKept = deleted >> (finest + k);
+        while(l.first < firstKept) {
+            if(!l.buckets.empty()) l.buckets.pop_front();
+            ++l.first;
+        }
+    }
+}
+
+int SampleLod::levelFor(size_t n, int points) const
+{
+    if(points < 1) points = 1;
+    int k = 0;
+    while((n >> k) > (size_t)points) ++k;
+    if(k < MIN_LEVEL || levels.empty()) return -1;
+    return std::min(k, finest + (int)levels.size() - 1);
+}
+
+size_t SampleLod::bucketEnd(int level, size_t i) const
+{
+    size_t a = deleted + i;
+    size_t end = ((a >> level) + 1) << level;
+    return std::min(end, total) - deleted;
+}
+
+const SampleLod::Bucket& SampleLod::bucket(int level, size_t i) const
+{
+    const Level& l = levels[level - finest];
+    size_t b = (deleted + i) >> level;
+    return l.buckets[b - l.first];
+}
+
+SampleLod::Bucket SampleLod::bounds() const
+{
+    // going up from the bucket of the first sample: a right half is taken on its own,
+    // a left half is covered by its parent, the top level covers the rest
+    Bucket b = EMPTY;
+    if(deleted >= total) return b;
+    auto take = [&b](const Level& l, size_t i) {
+        if(i >= l.first + l.buckets.size()) return;
+        const Bucket& x = l.buckets[i - l.first];
+        b.min = std::min(b.min, x.min);
+        b.max = std::max(b.max, x.max);
+    };
+    size_t lo = deleted >> finest;
+    for(size_t k = 0; k + 1 < levels.size(); ++k) {
+        if(lo & 1) take(levels[k], lo++);
+        lo >>= 1;
+    }
+    const Level& top = levels.back();
+    for(size_t i = lo; i < top.first + top.buckets.size(); ++i)
+        take(top, i);
+    return b;
+}
+
+void SampleLod::addLevel()
+{
+    Level l;
+    int k = finest + (int)levels.size();
+    l.first = deleted >> k;
+
+    // from pairs of buckets of the level below
+    if(!levels.empty()) {
+        const Level& below = levels.back();
+        for(size_t i = 0; i < below.buckets.size(); ++i) {
+            const Bucket& x = below.buckets[i];
+            size_t b = (below.first + i) >> 1;
+            if(b >= l.first + l.buckets.size()) {
+                l.buckets.push_back(x);
+            }
+            else {
+                merge(l.buckets.back(), x);
+            }
+        }
+    }
+    levels.push_back(l);
+}
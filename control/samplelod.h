@@ -0,0 +1,70 @@
+#ifndef SAMPLELOD_H
+#define SAMPLELOD_H
+
+#include "sample.h"
+
+#include <deque>
+#include <vector>
+
+// Level of detail of one value of the samples: at level k a bucket holds the min, the max, the first and
+// the last value with their timestamps of 2^k samples, so it is drawn without reading the samples.
+// NaN values are skipped, a bucket without values has min > max.
+// Kept up to date on every sample, 2 bytes per sample for all levels up to MAX_BUCKETS at the finest one;
+// beyond that the finest level is dropped, so the memory stays bounded with spilled samples.
+// The bounds of all samples take a bucket per level.
+class SampleLod
+{
+public:
+    struct Bucket {
+        float min;
+        float max;
+        float first;
+        float last;
+        qint64 firstTime;       // of the first value
+        qint64 lastTime;
+    };
+
+    typedef double (*Value)(const Sample& s);
+
+    static const int MIN_LEVEL = 5; // fewer samples per bucket are drawn as they are
+    static const size_t MAX_BUCKETS = 1 << 16; // of the finest level, about 4 MB for all levels
+    static const Bucket EMPTY;
+
+    static void add(Bucket& b, qint64 timestamp, float v); // NaN is skipped
+
+public:
+    explicit SampleLod(Value value_) : value(value_) { clear(); }
+
+    void clear(size_t removed = 0); // the next sample is the removed-th since clear() of the storage
+    void append(const Sample& s);   // after the last one
+    // count samples summarized at the level, which becomes the finest one if it is coarser;
+    // the bucket is after all samples so far, whose number is a multiple of 2^level
+    void appendBucket(int level, const Bucket& b, size_t count);
+    void del(size_t n);             // the first n were deleted
+
+    // the coarsest level still giving at least one bucket per point for n samples, at most the top one;
+    // below getFinest() the buckets are to be taken from the samples, -1 - draw the samples
+    int levelFor(size_t n, int points) const;
+    int getFinest() const { return finest; }
+    size_t bucketEnd(int level, size_t i) const;  // storage index after the bucket of sample i
+    const Bucket& bucket(int level, size_t i) const; // the bucket of storage index i
+    Bucket bounds() const;          // of the samples in the storage, partly deleted buckets included
+
+private:
+    struct Level {
+        std::deque<Bucket> buckets;
+        size_t first;           // number of the first bucket since clear()
+    };
+
+private:
+    void addLevel();
+
+private:
+    Value value;
+    int finest;                 // level of levels[0]
+    size_t deleted;             // since clear(), storage index = number since clear() - deleted
+    size_t total;
+    std::vector<Level> levels;  // from the finest one
+};
+
+#endif // SAMPLELOD_H
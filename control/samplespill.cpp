@@ -0,0 +1,79 @@
+#include "samplespill.h"
+
+#include <QDir>
+
+#include <algorithm>
+
+// =============================================================================================================
+
+SampleSpill::SampleSpill() :
+    chunks([this](const SessionChunk& chunk, QVector<Sample>& samples) {
+        return readChunk(*file, chunk, buf, samples);
+    } ),
+    dropped(0)
+{
+}
+
+bool SampleSpill::open(QString& error)
+{
+    std::shared_ptr<QTemporaryFile> f(new QTemporaryFile());
+    f->setFileTemplate(QDir::temp().filePath("electronic_load_XXXXXX.elss"));
+    if(!f->open()) {
+        error = f->errorString();
+        return false;
+    }
+    file = f;
+    clear();
+    return true;
+}
+
+void SampleSpill::clear()
+{
+    chunks.clear();
+    dropped = 0;
+    if(file && file.use_count() == 1) file->resize(0); // else an export still reads the old chunks
+}
+
+bool SampleSpill::append(const Sample* samples, int count, QString& error)
+{
+    if(count <= 0) return true;
+
+    SessionChunk s;
+    encodeSessionChunk(samples, count, buf, s);
+    s.offset = (quint64)file->size();
+    if(!file->seek((qint64)s.offset) || file->write(buf) != buf.size()) {
+        error = file->errorString();
+        return false;
+    }
+
+    chunks.append(s);
+    return true;
+}
+
+void SampleSpill::drop(size_t n)
+{
+    dropped = std::min(dropped + n, chunks.size());
+}
+
+size_t SampleSpill::lowerBound(qint64 timestamp) const
+{
+    size_t i = chunks.lowerBound(timestamp);
+    return i > dropped ? i - dropped : 0;
+}
+
+bool SampleSpill::readChunk(QFile& file, const SessionChunk& chunk, QByteArray& buf, QVector<Sample>& samples)
+{
+    if(!file.seek((qint64)chunk.offset)) return false;
+    buf = file.read(chunk.size);
+    return (buf.size() == (int)chunk.size) && decodeSessionChunk((const uchar*)buf.constData(), chunk, samples);
+}
+
+SampleSpill::View SampleSpill::view() const
+{
+    View v;
+    v.fileName = file->fileName();
+    v.index = chunks.getIndex();
+    v.dropped = dropped;
+    v.file = file;
+    return v;
+}
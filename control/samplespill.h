@@ -0,0 +1,50 @@
+#ifndef SAMPLESPILL_H
+#define SAMPLESPILL_H
+
+#include "sessionfile.h"
+
+#include <QTemporaryFile>
+#include <QVector>
+
+#include <memory>
+
+// The cold tier of the storage: the oldest samples in chunks of the session file format in a temporary file,
+// read back on access like the chunks of a session.
+class SampleSpill
+{
+public:
+    // the chunks written so far, for another thread to read with its own file handle; they never change
+    struct View {
+        QString fileName;
+        QVector<SessionChunk> index;
+        size_t dropped;
+        std::shared_ptr<const QTemporaryFile> file; // not removed while viewed, null - not a spill
+
+        View() : dropped(0) {}
+    };
+
+public:
+    SampleSpill();
+    SampleSpill(const SampleSpill&) = delete;
+    SampleSpill& operator=(const SampleSpill&) = delete;
+
+    bool open(QString& error);                                // the file is removed when the spill is destroyed
+    bool append(const Sample* samples, int count, QString& error); // one chunk, count <= SessionWriter::CHUNK_SAMPLES
+    void clear();                                             // a viewed file is not truncated, chunks go after the old ones
+    void drop(size_t n);                                      // the first n are not visible any more
+    size_t size() const { return chunks.size() - dropped; }
+
+    const Sample& sample(size_t i) const { return chunks.sample(dropped + i); } // valid until the next read
+    size_t lowerBound(qint64 timestamp) const;                // index of the first sample not before timestamp
+    View view() const;
+
+    static bool readChunk(QFile& file, const SessionChunk& chunk, QByteArray& buf, QVector<Sample>& samples);
+
+private:
+    std::shared_ptr<QTemporaryFile> file;
+    SessionChunks chunks;         // including dropped samples
+    size_t dropped;
+    mutable QByteArray buf;
+};
+
+#endif // SAMPLESPILL_H
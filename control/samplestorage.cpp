@@ -1,59 +1,345 @@
 #include "samplestorage.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
 // =============================================================================================================
 
-const Sample& SampleStorage::sample(size_t i) const
+static quint16 toU16(double v)
+{
+    qint64 x = std::llround(v * 1000.0);
+    return (quint16)std::max<qint64>(0, std::min<qint64>(x, 0xFFFF));
+}
+
+static qint32 toI32(double v)
+{
+    qint64 x = std::llround(v * 1000.0);
+    return (qint32)std::max<qint64>(INT32_MIN, std::min<qint64>(x, INT32_MAX));
+}
+
+// in the order of the ring, in two parts if it wraps
+template<class T> static void copyColumn(const std::vector<T>& ring, size_t head, size_t count, std::vector<T>& out)
 {
-    return samples[i];
+    out.resize(count);
+    size_t first = std::min(count, ring.size() - head);
+    if(first) memcpy(out.data(), ring.data() + head, first * sizeof(T));
+    if(count > first) memcpy(out.data() + first, ring.data(), (count - first) * sizeof(T));
+}
+
+// =============================================================================================================
+
+SampleStorage::SampleStorage(size_t limit_, size_t fastLimit_) :
+    limit(limit_),
+    head(0),
+    count(0),
+    base(0),
+    archived(0),
+    archiveDropped(0),
+    spilled(0),
+    spillFailed(false),
+    fastLimit(fastLimit_),
+    enabled(false),
+    begin(0)
+{
+}
+
+Sample SampleStorage::sample(size_t i) const
+{
+    if(i < getCold()) return coldSample(i);
+    return ringSample(i - getCold());
+}
+
+Sample SampleStorage::decode(qint64 base, quint32 t, quint16 u, quint16 i, qint32 ah, qint32 wh)
+{
+    Sample s;
+    s.timestamp = base + t;
+    s.u  = u / 1000.0;
+    s.i  = i / 1000.0;
+    s.ah = ah / 1000.0;
+    s.wh = wh / 1000.0;
+    return s;
+}
+
+Sample SampleStorage::ringSample(size_t k) const
+{
+    k = at(k);
+    return decode(base, ts[k], uMv[k], iMa[k], ahMah[k], whMwh[k]);
+}
+
+void SampleStorage::copyRing(Columns& columns) const
+{
+    columns.base = base;
+    copyColumn(ts, head, count, columns.ts);
+    copyColumn(uMv, head, count, columns.uMv);
+    copyColumn(iMa, head, count, columns.iMa);
+    copyColumn(ahMah, head, count, columns.ahMah);
+    copyColumn(whMwh, head, count, columns.whMwh);
 }
 
 size_t SampleStorage::size() const
 {
-    return samples.size();
+    return archived + spilled + count;
+}
+
+size_t SampleStorage::lowerBound(qint64 timestamp) const
+{
+    if(count && ringTimestamp(0) < timestamp)
+        return getCold() + ringLowerBound(timestamp);
+
+    // the chunk summaries narrow it down to one chunk
+    if(spilled) {
+        size_t i = spill->lowerBound(timestamp);
+        if(i > 0) return archived + std::min(i, spilled);
+    }
+
+    if(archived) {
+        size_t i = archive->lowerBound(timestamp);
+        return i > archiveDropped ? std::min(i - archiveDropped, archived) : 0;
+    }
+    return 0;
+}
+
+size_t SampleStorage::ringLowerBound(qint64 timestamp) const
+{
+    size_t lo = 0, hi = count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(ringTimestamp(mid) < timestamp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+const FastSample& SampleStorage::fastSample(size_t i) const
+{
+    return fastSamples[i];
+}
+
+size_t SampleStorage::fastSize() const
+{
+    return fastSamples.size();
+}
+
+void SampleStorage::fit(qint64 first, qint64 last)
+{
+    if(count) {
+        qint64 lo = std::min(first, ringTimestamp(0));
+        qint64 hi = std::max(last, ringTimestamp(count - 1));
+        if(hi - lo > MAX_OFFSET) {
+            // out of the ring what is too old to be kept with the new samples
+            evict(first < ringTimestamp(0) ? count : ringLowerBound(hi - MAX_OFFSET));
+        }
+    }
+    if(!count) {
+        base = std::min(first, last);
+        return;
+    }
+
+    qint64 lo = std::min(first, ringTimestamp(0));
+    qint64 hi = std::max(last, ringTimestamp(count - 1));
+    if(lo >= base && hi - base <= MAX_OFFSET) return;
+
+    // rare: once per MAX_OFFSET or for samples older than all
+    qint64 shift = base - lo;
+    for(size_t k = 0; k < count; ++k) {
+        quint32& t = ts[at(k)];
+        t = (quint32)(t + shift);
+    }
+    base = lo;
+}
+
+void SampleStorage::put(const Sample &sample)
+{
+    if(ts.size() != limit) { // the first sample
+        ts.resize(limit);
+        uMv.resize(limit);
+        iMa.resize(limit);
+        ahMah.resize(limit);
+        whMwh.resize(limit);
+    }
+
+    size_t k = at(count++);
+    ts[k] = (quint32)std::max<qint64>(0, std::min<qint64>(sample.timestamp - base, (qint64)MAX_OFFSET));
+    uMv[k] = toU16(sample.u);
+    iMa[k] = toU16(sample.i);
+    ahMah[k] = toI32(sample.ah);
+    whMwh[k] = toI32(sample.wh);
 }
 
 void SampleStorage::append(const Sample & sample)
 {
-    if(!enabled) return;
+    if(!enabled || !limit) return;
 
     if(!begin) begin = sample.timestamp;
 
-    if(samples.size() >= limit)
-        del(samples.size() - limit + 1);
+    fit(sample.timestamp, sample.timestamp);
+    if(count >= limit)
+        evict(count - limit + 1);
+    if(count >= limit) return; // the spill failed
 
     emit beforeAppend(sample);
 
-    samples.push_back(sample);
+    put(sample);
 
     emit afterAppend(sample);
 }
 
 void SampleStorage::appendMultiple(const QVector<Sample> &list)
 {
-    if(!enabled) return;
+    if(!enabled || !limit || list.isEmpty()) return;
 
     if(!begin) begin = list.front().timestamp;
 
-    if(samples.size() >= limit)
-        del(samples.size() - limit + list.size());
+    if((size_t)list.size() > limit) {
+        if(spill) {
+            for(int k = 0; k < list.size(); k += (int)limit)
+                appendMultiple(list.mid(k, (int)limit));
+        }
+        else {
+            appendMultiple(list.mid(list.size() - (int)limit)); // only the latest ones are kept anyway
+        }
+        return;
+    }
+
+    fit(list.front().timestamp, list.back().timestamp);
+    if(count + (size_t)list.size() > limit)
+        evict(count + (size_t)list.size() - limit);
+    if(count + (size_t)list.size() > limit) return; // the spill failed
 
     emit beforeAppendMultiple(list);
 
-    // FIXME list.size() > limit
     for(auto i = list.begin(), e = list.end(); i != e; ++i)
-        samples.push_back(*i);
+        put(*i);
 
     emit afterAppendMultiple(list);
 }
 
+void SampleStorage::appendFast(const QVector<FastSample> &list)
+{
+    if(!enabled || list.isEmpty()) return;
+
+    if(fastSamples.size() + list.size() > fastLimit)
+        fastSamples.erase(fastSamples.begin(), fastSamples.begin() + std::min(fastSamples.size() + list.size() - fastLimit, fastSamples.size()));
+
+    for(auto i = list.begin(), e = list.end(); i != e; ++i)
+        fastSamples.push_back(*i);
+
+    emit afterAppendFast(list);
+}
+
+void SampleStorage::evict(size_t n)
+{
+    if(!n) return;
+    if(!spill) {
+        del(archived + spilled + n);
+        return;
+    }
+    if(spillFailed) return;
+
+    // whole chunks at once, indexes do not change
+    n = std::min(std::max(n, (size_t)SessionWriter::CHUNK_SAMPLES), count);
+    QVector<Sample> chunk;
+    QString error;
+    size_t done = 0;
+    while(done < n) {
+        int m = (int)std::min(n - done, (size_t)SessionWriter::CHUNK_SAMPLES);
+        chunk.resize(m);
+        for(int k = 0; k < m; ++k)
+            chunk[k] = ringSample(done + k);
+        if(!spill->append(chunk.constData(), m, error)) break;
+        done += m;
+    }
+    head = at(done);
+    count -= done;
+    spilled += done;
+
+    if(done < n) {
+        // the disk is full or so: the spilled samples stay readable, deleting ring samples behind them is not possible
+        spillFailed = true;
+        emit spillError(error);
+    }
+}
+
+bool SampleStorage::setSpilling(bool enable, QString& error)
+{
+    if(enable == (bool)spill) return true;
+
+    if(enable) {
+        std::unique_ptr<SampleSpill> s(new SampleSpill());
+        if(!s->open(error)) return false;
+        spill = std::move(s);
+    }
+    else {
+        if(spilled) del(archived + spilled);
+        spill.reset();
+        spillFailed = false;
+    }
+    return true;
+}
+
+bool SampleStorage::openSession(const QString& fileName, QString& error)
+{
+    std::unique_ptr<SessionReader> reader(new SessionReader());
+    if(!reader->open(fileName, error)) return false;
+
+    if(!reader->size()) {
+        error = "No samples";
+        return false;
+    }
+
+    clear();
+    archive = std::move(reader);
+    archived = archive->size();
+    begin = archive->getBegin() ? archive->getBegin() : archive->chunk(0).first;
+
+    // the views take the chunk summaries, the samples stay in the file until they are shown
+    emit afterOpenSession(archive->getIndex());
+    return true;
+}
+
+QVector<SampleSpill::View> SampleStorage::coldViews() const
+{
+    QVector<SampleSpill::View> views;
+    if(archive) {
+        SampleSpill::View v;
+        v.fileName = archive->getFileName();
+        v.index = archive->getIndex();
+        v.dropped = archiveDropped;
+        views.append(v);
+    }
+    if(spill)
+        views.append(spill->view());
+    return views;
+}
+
 void SampleStorage::del(size_t n)
 {
-    if(n > samples.size())
-        n = samples.size();
+    if(n > size())
+        n = size();
+    if(!n) return;
 
     emit beforeDelete(n);
 
-    samples.erase(samples.begin(), samples.begin() + n);
+    size_t a = std::min(n, archived);
+    if(a) {
+        archiveDropped += a;
+        archived -= a;
+        if(!archived) {
+            archive.reset();
+            archiveDropped = 0;
+        }
+    }
+    size_t s = std::min(n - a, spilled);
+    if(s) {
+        spill->drop(s);
+        spilled -= s;
+    }
+    head = at(n - a - s);
+    count -= n - a - s;
 
     emit afterDelete(n);
 }
@@ -62,7 +348,16 @@ void SampleStorage::clear()
 {
     emit beforeClear();
 
-    samples.clear();
+    head = 0;
+    count = 0;
+    base = 0;
+    archive.reset();
+    archived = 0;
+    archiveDropped = 0;
+    spilled = 0;
+    spillFailed = false;
+    if(spill) spill->clear();
+    fastSamples.clear();
     begin = 0;
 
     emit afterClear();
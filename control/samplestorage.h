@@ -2,29 +2,71 @@
 #define SAMPLESTORAGE_H
 
 #include "sample.h"
+#include "samplespill.h"
 
 #include <QObject>
 #include <QVector>
 
 #include <deque>
+#include <memory>
+#include <vector>
 
+// Samples are kept in a ring of columns quantized to the resolution of the device:
+// ms since base, mV, mA, mAh, mWh - 16 bytes per sample instead of 40, evicting is O(1).
+// With spilling enabled the oldest samples go from the full ring into a temporary file instead of being
+// deleted, indexes stay the same and sample(i) reads them back.
+// An opened session file is the archive in front of all: its samples are read from the mapped file on access.
 class SampleStorage : public QObject
 {
     Q_OBJECT
 
 public:
-    SampleStorage(size_t limit_) : limit(limit_), enabled(false), begin(0) {}
+    // the ring copied out column by column, decoded by the one who needs the samples
+    struct Columns {
+        qint64 base;
+        std::vector<quint32> ts;
+        std::vector<quint16> uMv;
+        std::vector<quint16> iMa;
+        std::vector<qint32> ahMah;
+        std::vector<qint32> whMwh;
 
-    const Sample &sample(size_t i) const;
+        Columns() : base(0) {}
+        size_t size() const { return ts.size(); }
+        Sample sample(size_t k) const { return decode(base, ts[k], uMv[k], iMa[k], ahMah[k], whMwh[k]); }
+    };
+
+public:
+    SampleStorage(size_t limit_, size_t fastLimit_);
+
+    static Sample decode(qint64 base, quint32 t, quint16 u, quint16 i, qint32 ah, qint32 wh);
+
+    Sample sample(size_t i) const;
+    // single columns, cheaper than sample(i)
+    qint64 timestamp(size_t i) const { return i < getCold() ? coldSample(i).timestamp : base + ts[at(i - getCold())]; }
+    double voltage(size_t i) const { return i < getCold() ? coldSample(i).u : uMv[at(i - getCold())] / 1000.0; }
+    double current(size_t i) const { return i < getCold() ? coldSample(i).i : iMa[at(i - getCold())] / 1000.0; }
+    double energy(size_t i) const { return i < getCold() ? coldSample(i).wh : whMwh[at(i - getCold())] / 1000.0; }
     size_t size() const;
+    size_t getLimit() const { return limit; }
+    size_t lowerBound(qint64 timestamp) const; // index of the first sample not before timestamp
+    const FastSample &fastSample(size_t i) const;
+    size_t fastSize() const;
     void clear();
     void del(size_t n); // delete first n samples
     bool isEnabled() const { return enabled; }
     qint64 getBegin() const { return begin; }
+    bool setSpilling(bool enable, QString& error); // disabling deletes the spilled samples and the archive before them
+    bool isSpilling() const { return (bool)spill; }
+    size_t getCold() const { return archived + spilled; } // the archived and spilled samples, before the ring
+    QVector<SampleSpill::View> coldViews() const;         // of the archive and the spill, in this order
+    bool openSession(const QString& fileName, QString& error); // clears the storage, the file becomes the archive
+    QString getSessionFileName() const { return archive ? archive->getFileName() : QString(); }
+    void copyRing(Columns& columns) const; // the samples after the cold ones, a memcpy per column
 
 public slots:
     void append(const Sample &sample);
     void appendMultiple(const QVector<Sample> &list);
+    void appendFast(const QVector<FastSample> &list);
     void setEnabled(bool enabled) { this->enabled = enabled; }
 
 signals:
@@ -36,10 +78,41 @@ signals:
     void afterClear();
     void beforeDelete(size_t n); // before deleting of first n samples
     void afterDelete(size_t n);  // after deleting of first n samples
+    void afterAppendFast(const QVector<FastSample> &list);
+    void spillError(QString msg); // the spilled samples are kept, new ones are not stored while the ring is full
+    void afterOpenSession(const QVector<SessionChunk>& chunks); // the samples of the archive, not decoded
 
 private:
+    // k - in the ring, after the archived and spilled samples
+    size_t at(size_t k) const { size_t r = head + k; return r < limit ? r : r - limit; }
+    const Sample& coldSample(size_t i) const { return i < archived ? archive->sample(archiveDropped + i) : spill->sample(i - archived); }
+    qint64 ringTimestamp(size_t k) const { return base + ts[at(k)]; }
+    Sample ringSample(size_t k) const;
+    size_t ringLowerBound(qint64 timestamp) const;
+    void fit(qint64 first, qint64 last); // rebase the timestamps so that [first, last] fits, evicts if needed
+    void put(const Sample &sample);      // there is a free place
+    void evict(size_t n);                // the oldest n of the ring, spilled or deleted with all before them
+
+private:
+    static const qint64 MAX_OFFSET = 0xFFFFFFFFLL; // ~49 days of timestamps in a ring
+
     size_t limit;
-    std::deque<Sample> samples;
+    std::vector<quint32> ts;   // ms since base
+    std::vector<quint16> uMv;
+    std::vector<quint16> iMa;
+    std::vector<qint32> ahMah;
+    std::vector<qint32> whMwh;
+    size_t head;               // the oldest sample
+    size_t count;
+    qint64 base;
+    std::unique_ptr<SessionReader> archive; // null - no session opened
+    size_t archived;
+    size_t archiveDropped;     // deleted from the front of the archive
+    std::unique_ptr<SampleSpill> spill; // null - not spilling
+    size_t spilled;
+    bool spillFailed;          // the spill takes no more until it is cleared or disabled
+    size_t fastLimit;
+    std::deque<FastSample> fastSamples;
     bool enabled;
     qint64 begin;
 };
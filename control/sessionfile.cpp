@@ -0,0 +1,391 @@
+#include "sessionfile.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// =============================================================================================================
+
+static const int COLUMNS = 1 + SessionChunk::VALUES;
+static const int CHUNK_HEADER_SIZE = COLUMNS * 4;
+
+static const char HEADER_MAGIC[] = "ELSS";
+static const char TRAILER_MAGIC[] = "ELSI";
+
+static quint64 zigzag(qint64 v)
+{
+    return ((quint64)v << 1) ^ (quint64)(v >> 63);
+}
+
+static qint64 unzigzag(quint64 v)
+{
+    return (qint64)(v >> 1) ^ -(qint64)(v & 1);
+}
+
+static void putVarint(QByteArray& out, quint64 v)
+{
+    while(v >= 0x80) {
+        out.append((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.append((char)v);
+}
+
+// false - truncated
+static bool getVarint(const uchar*& p, const uchar* end, quint64& v)
+{
+    v = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7) {
+        uchar b = *p++;
+        v |= (quint64)(b & 0x7F) << shift;
+        if(!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static qint64 quantize(double v)
+{
+    return (qint64)std::llround(v * 1000.0);
+}
+
+// =============================================================================================================
+
+bool SessionWriter::open(const QString& fileName, qint64 begin, QString& error)
+{
+    QString e;
+    close(e);
+
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        error = file.errorString();
+        return false;
+    }
+
+    this->begin = begin;
+    index.clear();
+    pending.clear();
+    pending.reserve(CHUNK_SAMPLES);
+
+    uchar header[HEADER_SIZE] = {};
+    memcpy(header, HEADER_MAGIC, 4);
+    qToLittleEndian<quint16>(VERSION, header + 4);
+    qToLittleEndian<quint16>(HEADER_SIZE, header + 6);
+    qToLittleEndian<quint32>(CHUNK_SAMPLES, header + 8);
+    qToLittleEndian<qint64>(begin, header + 12);
+    if(file.write((const char*)header, sizeof(header)) != (qint64)sizeof(header)) {
+        error = file.errorString();
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+void encodeSessionChunk(const Sample* samples, int count, QByteArray& out, SessionChunk& s)
+{
+    s.offset = 0;
+    s.count  = (quint32)count;
+    s.first  = samples[0].timestamp;
+    s.last   = samples[count - 1].timestamp;
+
+    QByteArray col[COLUMNS];
+    for(int c = 0; c < COLUMNS; ++c)
+        col[c].reserve(count * 2);
+
+    // timestamps: delta of delta, 0 for a steady interval
+    putVarint(col[0], zigzag(samples[0].timestamp));
+    qint64 lastDelta = 0;
+    for(int k = 1; k < count; ++k) {
+        qint64 delta = samples[k].timestamp - samples[k-1].timestamp;
+        putVarint(col[0], zigzag(delta - lastDelta));
+        lastDelta = delta;
+    }
+
+    for(int v = 0; v < SessionChunk::VALUES; ++v) {
+        qint64 prev = 0, mn = 0, mx = 0, sum = 0, first = 0;
+        for(int k = 0; k < count; ++k) {
+            const Sample& x = samples[k];
+            qint64 value = quantize(v == (int)SessionColumn::U ? x.u : v == (int)SessionColumn::I ? x.i
+                                    : v == (int)SessionColumn::Ah ? x.ah : x.wh);
+            putVarint(col[1 + v], zigzag(value - prev));
+            prev = value;
+            if(k == 0) first = value;
+            mn = (k == 0 ? value : std::min(mn, value));
+            mx = (k == 0 ? value : std::max(mx, value));
+            sum += value;
+        }
+        s.min[v] = mn;
+        s.max[v] = mx;
+        s.sum[v] = sum;
+        s.firstValue[v] = first;
+        s.lastValue[v] = prev;
+    }
+
+    uchar sizes[CHUNK_HEADER_SIZE];
+    int total = CHUNK_HEADER_SIZE;
+    for(int c = 0; c < COLUMNS; ++c) {
+        qToLittleEndian<quint32>((quint32)col[c].size(), sizes + c * 4);
+        total += col[c].size();
+    }
+    out.clear();
+    out.reserve(total);
+    out.append((const char*)sizes, sizeof(sizes));
+    for(int c = 0; c < COLUMNS; ++c)
+        out.append(col[c]);
+    s.size = (quint32)out.size();
+}
+
+bool decodeSessionChunk(const uchar* p, const SessionChunk& s, QVector<Sample>& samples)
+{
+    const uchar* end = p + s.size;
+    if(s.size < (quint32)CHUNK_HEADER_SIZE) return false;
+
+    const uchar* col[COLUMNS];
+    const uchar* colEnd[COLUMNS];
+    const uchar* c = p + CHUNK_HEADER_SIZE;
+    for(int k = 0; k < COLUMNS; ++k) {
+        quint32 size = qFromLittleEndian<quint32>(p + k * 4);
+        if(size > (quint32)(end - c)) return false;
+        col[k] = c;
+        colEnd[k] = c + size;
+        c += size;
+    }
+
+    samples.resize((int)s.count);
+    quint64 v;
+    qint64 t = 0, delta = 0;
+    for(quint32 k = 0; k < s.count; ++k) {
+        if(!getVarint(col[0], colEnd[0], v)) return false;
+        if(k == 0) {
+            t = unzigzag(v);
+        }
+        else {
+            delta += unzigzag(v);
+            t += delta;
+        }
+        samples[(int)k].timestamp = t;
+    }
+
+    for(int x = 0; x < SessionChunk::VALUES; ++x) {
+        qint64 value = 0;
+        for(quint32 k = 0; k < s.count; ++k) {
+            if(!getVarint(col[1 + x], colEnd[1 + x], v)) return false;
+            value += unzigzag(v);
+            double d = (double)value / 1000.0;
+            Sample& out = samples[(int)k];
+            switch((SessionColumn)x) {
+                case SessionColumn::U:  out.u  = d; break;
+                case SessionColumn::I:  out.i  = d; break;
+                case SessionColumn::Ah: out.ah = d; break;
+                case SessionColumn::Wh: out.wh = d; break;
+            }
+        }
+    }
+    return true;
+}
+
+// =============================================================================================================
+
+bool SessionWriter::append(const Sample& sample, QString& error)
+{
+    pending.append(sample);
+
+    if(pending.size() < CHUNK_SAMPLES) return true;
+    return writeChunk(error);
+}
+
+bool SessionWriter::writeChunk(QString& error)
+{
+    if(pending.isEmpty()) return true;
+
+    SessionChunk s;
+    QByteArray chunk;
+    encodeSessionChunk(pending.constData(), pending.size(), chunk, s);
+    s.offset = (quint64)file.pos();
+    pending.clear();
+
+    if(file.write(chunk) != chunk.size()) {
+        error = file.errorString();
+        return false;
+    }
+    index.append(s);
+    return true;
+}
+
+bool SessionWriter::close(QString& error)
+{
+    if(!file.isOpen()) return true;
+
+    bool ok = writeChunk(error);
+    if(ok) {
+        quint64 indexOffset = (quint64)file.pos();
+        QByteArray out;
+        out.resize(index.size() * INDEX_ENTRY_SIZE + TRAILER_SIZE);
+        uchar* p = (uchar*)out.data();
+        for(const SessionChunk& s : index) {
+            qToLittleEndian<quint64>(s.offset, p);
+            qToLittleEndian<quint32>(s.size, p + 8);
+            qToLittleEndian<quint32>(s.count, p + 12);
+            qToLittleEndian<qint64>(s.first, p + 16);
+            qToLittleEndian<qint64>(s.last, p + 24);
+            p += 32;
+            for(int v = 0; v < SessionChunk::VALUES; ++v, p += 40) {
+                qToLittleEndian<qint64>(s.min[v], p);
+                qToLittleEndian<qint64>(s.max[v], p + 8);
+                qToLittleEndian<qint64>(s.sum[v], p + 16);
+                qToLittleEndian<qint64>(s.firstValue[v], p + 24);
+                qToLittleEndian<qint64>(s.lastValue[v], p + 32);
+            }
+        }
+        qToLittleEndian<quint64>(indexOffset, p);
+        qToLittleEndian<quint32>((quint32)index.size(), p + 8);
+        memcpy(p + 12, TRAILER_MAGIC, 4);
+
+        ok = (file.write(out) == out.size()) && file.flush();
+        if(!ok) error = file.errorString();
+    }
+
+    file.close();
+    return ok;
+}
+
+// =============================================================================================================
+
+SessionReader::SessionReader() :
+    data(nullptr),
+    begin(0),
+    chunks([this](const SessionChunk& chunk, QVector<Sample>& samples) {
+        return decodeSessionChunk(data + chunk.offset, chunk, samples);
+    } )
+{
+}
+
+bool SessionReader::open(const QString& fileName, QString& error)
+{
+    close();
+
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    qint64 fileSize = file.size();
+    if(fileSize >= SessionWriter::HEADER_SIZE + SessionWriter::TRAILER_SIZE)
+        data = file.map(0, fileSize); // chunks are paged in by the system when they are decoded
+    if(!data) {
+        error = fileSize < SessionWriter::HEADER_SIZE + SessionWriter::TRAILER_SIZE ? "Not a session file" : file.errorString();
+        close();
+        return false;
+    }
+
+    const uchar* t = data + fileSize - SessionWriter::TRAILER_SIZE;
+    quint64 indexOffset = qFromLittleEndian<quint64>(t);
+    quint32 entries = qFromLittleEndian<quint32>(t + 8);
+    if(memcmp(data, HEADER_MAGIC, 4) != 0 || memcmp(t + 12, TRAILER_MAGIC, 4) != 0
+       || qFromLittleEndian<quint16>(data + 4) != SessionWriter::VERSION
+       || indexOffset + (quint64)entries * SessionWriter::INDEX_ENTRY_SIZE != (quint64)(fileSize - SessionWriter::TRAILER_SIZE)) {
+        error = "Not a session file or an unsupported version";
+        close();
+        return false;
+    }
+    begin = qFromLittleEndian<qint64>(data + 12);
+
+    const uchar* p = data + indexOffset;
+    for(quint32 k = 0; k < entries; ++k) {
+        SessionChunk s;
+        s.offset = qFromLittleEndian<quint64>(p);
+        s.size   = qFromLittleEndian<quint32>(p + 8);
+        s.count  = qFromLittleEndian<quint32>(p + 12);
+        s.first  = qFromLittleEndian<qint64>(p + 16);
+        s.last   = qFromLittleEndian<qint64>(p + 24);
+        p += 32;
+        for(int v = 0; v < SessionChunk::VALUES; ++v, p += 40) {
+            s.min[v] = qFromLittleEndian<qint64>(p);
+            s.max[v] = qFromLittleEndian<qint64>(p + 8);
+            s.sum[v] = qFromLittleEndian<qint64>(p + 16);
+            s.firstValue[v] = qFromLittleEndian<qint64>(p + 24);
+            s.lastValue[v] = qFromLittleEndian<qint64>(p + 32);
+        }
+        if(s.offset + s.size > indexOffset || s.count == 0) {
+            error = "Corrupted index";
+            close();
+            return false;
+        }
+        chunks.append(s);
+    }
+    return true;
+}
+
+void SessionReader::close()
+{
+    chunks.clear();
+    begin = 0;
+    if(data) file.unmap(const_cast<uchar*>(data));
+    data = nullptr;
+    file.close();
+}
+
+// =============================================================================================================
+
+void SessionChunks::clear()
+{
+    index.clear();
+    starts.clear();
+    total = 0;
+    cache.clear();
+}
+
+void SessionChunks::append(const SessionChunk& chunk)
+{
+    index.append(chunk);
+    starts.push_back(total);
+    total += chunk.count;
+}
+
+int SessionChunks::find(size_t i) const
+{
+    auto it = std::upper_bound(starts.begin(), starts.end(), i);
+    return (int)(it - starts.begin()) - 1;
+}
+
+size_t SessionChunks::lowerBound(qint64 timestamp) const
+{
+    auto it = std::lower_bound(index.begin(), index.end(), timestamp,
+        [](const SessionChunk& s, qint64 t) { return s.last < t; });
+    if(it == index.end()) return total;
+
+    int c = (int)(it - index.begin());
+    const QVector<Sample>& samples = read(c);
+    auto i = std::lower_bound(samples.begin(), samples.end(), timestamp,
+        [](const Sample& s, qint64 t) { return s.timestamp < t; });
+    return starts[c] + (size_t)(i - samples.begin());
+}
+
+const Sample& SessionChunks::sample(size_t i) const
+{
+    static const Sample none = {};
+
+    int c = find(i);
+    if(c < 0) return none;
+    const QVector<Sample>& samples = read(c);
+    size_t k = i - starts[c];
+    return k < (size_t)samples.size() ? samples[(int)k] : none;
+}
+
+const QVector<Sample>& SessionChunks::read(int c) const
+{
+    for(auto it = cache.begin(); it != cache.end(); ++it) {
+        if(it->chunk != c) continue;
+        if(it != cache.begin()) cache.splice(cache.begin(), cache, it);
+        return cache.front().samples;
+    }
+
+    if((int)cache.size() >= CACHE_CHUNKS) cache.pop_back();
+    cache.push_front(Cached());
+    cache.front().chunk = c;
+    if(!decode(index[c], cache.front().samples))
+        cache.front().samples.clear();
+    return cache.front().samples;
+}
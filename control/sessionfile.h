@@ -0,0 +1,149 @@
+#ifndef SESSIONFILE_H
+#define SESSIONFILE_H
+
+#include "sample.h"
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#include <list>
+#include <vector>
+#include <stdint.h>
+
+// Native session file, little-endian.
+// Samples are stored in chunks of CHUNK_SAMPLES as separate columns: timestamps as delta of delta,
+// u, i, ah and wh quantized to 1/1000 (mV, mA, mAh, mWh - the resolution of the device) as deltas,
+// all zigzag varints. The index at the end holds a summary of every chunk, so a reader gets the
+// overview of a file without decoding it and pages chunks in only when they are needed.
+//
+//   header:  "ELSS", u16 version, u16 header size, u32 chunk samples, i64 begin (ms since epoch), 12 bytes reserved
+//   chunk:   u32 column sizes x 5 (timestamp, u, i, ah, wh), the columns
+//   index:   SessionChunk x chunks, each INDEX_ENTRY_SIZE
+//   trailer: u64 index offset, u32 chunks, "ELSI"
+
+enum class SessionColumn { U = 0, I, Ah, Wh };
+
+struct SessionChunk {
+    static const int VALUES = 4;     // SessionColumn
+
+    quint64 offset;                  // in the file
+    quint32 size;
+    quint32 count;                   // samples
+    qint64 first;                    // timestamp
+    qint64 last;
+    qint64 min[VALUES];              // 1/1000
+    qint64 max[VALUES];
+    qint64 sum[VALUES];
+    qint64 firstValue[VALUES];       // of the first sample
+    qint64 lastValue[VALUES];
+
+    double mean(SessionColumn c) const { return count ? (double)sum[(int)c] / count / 1000.0 : 0.0; }
+};
+
+// a chunk of up to SessionWriter::CHUNK_SAMPLES, offset is not set; also used to spill the storage
+void encodeSessionChunk(const Sample* samples, int count, QByteArray& out, SessionChunk& summary);
+bool decodeSessionChunk(const uchar* data, const SessionChunk& summary, QVector<Sample>& samples); // false - corrupted
+
+class SessionWriter
+{
+public:
+    static const uint16_t VERSION = 2;   // 2 - first and last values in the index
+    static const int HEADER_SIZE = 32;
+    static const int TRAILER_SIZE = 16;
+    static const int INDEX_ENTRY_SIZE = 32 + 5 * SessionChunk::VALUES * 8;
+    static const int CHUNK_SAMPLES = 4096;
+
+public:
+    SessionWriter() : begin(0) {}
+    ~SessionWriter() { QString e; close(e); }
+
+    bool open(const QString& fileName, qint64 begin, QString& error);
+    bool append(const Sample& sample, QString& error);
+    bool close(QString& error);      // writes the last chunk and the index
+    bool isOpen() const { return file.isOpen(); }
+    const QVector<SessionChunk>& getIndex() const { return index; }
+
+private:
+    bool writeChunk(QString& error);
+
+private:
+    QFile file;
+    qint64 begin;
+    QVector<Sample> pending; // the chunk being collected
+    QVector<SessionChunk> index;
+};
+
+// Samples in chunks of the session format, wherever the chunks are: the index, lookup by sample number
+// and the latest CACHE_CHUNKS decoded chunks. A chunk is read and decoded by the given function.
+class SessionChunks
+{
+public:
+    static const int CACHE_CHUNKS = 8;
+
+    typedef std::function<bool(const SessionChunk& chunk, QVector<Sample>& samples)> Decode; // false - corrupted
+
+public:
+    explicit SessionChunks(const Decode& decode_) : decode(decode_), total(0) {}
+
+    void clear();
+    void append(const SessionChunk& chunk);   // after the last one
+
+    size_t size() const { return total; }
+    int count() const { return index.size(); }
+    const SessionChunk& chunk(int c) const { return index[c]; }
+    const QVector<SessionChunk>& getIndex() const { return index; }
+
+    // page the chunk in, valid until the next read; a corrupted chunk reads as no samples
+    const QVector<Sample>& read(int c) const;
+    const Sample& sample(size_t i) const;     // zeros if it can't be read
+    int find(size_t i) const;                 // chunk of sample i, -1 - none
+    size_t lowerBound(qint64 timestamp) const; // index of the first sample not before timestamp, reads one chunk
+
+private:
+    struct Cached {
+        int chunk;
+        QVector<Sample> samples;
+    };
+
+private:
+    Decode decode;
+    QVector<SessionChunk> index;
+    std::vector<size_t> starts;               // index of the first sample of each chunk
+    size_t total;
+    mutable std::list<Cached> cache;          // the most recent first
+};
+
+// Reads a session file lazily: the index on open, chunks on access
+class SessionReader
+{
+public:
+    SessionReader();
+    ~SessionReader() { close(); }
+
+    bool open(const QString& fileName, QString& error);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+    QString getFileName() const { return file.fileName(); }
+
+    size_t size() const { return chunks.size(); }
+    qint64 getBegin() const { return begin; }
+    int chunkCount() const { return chunks.count(); }
+    const SessionChunk& chunk(int i) const { return chunks.chunk(i); }
+    const QVector<SessionChunk>& getIndex() const { return chunks.getIndex(); }
+
+    // pages the chunk in, valid until the next read
+    const Sample& sample(size_t i) const { return chunks.sample(i); }
+    const QVector<Sample>& readChunk(int i) const { return chunks.read(i); }
+    int findChunk(size_t i) const { return chunks.find(i); }
+    size_t lowerBound(qint64 timestamp) const { return chunks.lowerBound(timestamp); }
+
+private:
+    QFile file;
+    const uchar* data;                        // mapped file
+    qint64 begin;
+    SessionChunks chunks;
+};
+
+#endif // SESSIONFILE_H
@@ -0,0 +1,87 @@
+#include "sessionmanager.h"
+#include "settings.h"
+
+#include <QDateTime>
+
+#include <algorithm>
+
+// =============================================================================================================
+
+SessionManager::SessionManager(QObject *parent) :
+    QObject(parent),
+    pool(std::min(QThread::idealThreadCount(), (int)Settings::commThreads)),
+    mergeInterval(0),
+    nextSlot(0)
+{
+    connect(&mergeTimer, &QTimer::timeout, this, &SessionManager::merge);
+}
+
+SessionManager::~SessionManager()
+{
+    // before the pool of their comms
+    for(const Device& d : devices) {
+        delete d.session;
+        delete d.storage;
+    }
+}
+
+int SessionManager::add(const QString& port, size_t limit, size_t fastLimit)
+{
+    Device d;
+    d.port    = port;
+    d.session = new DeviceSession(pool);
+    d.storage = new SampleStorage(limit, fastLimit);
+
+    connect(d.session, &DeviceSession::sample, d.storage, &SampleStorage::append);
+    connect(d.session, &DeviceSession::sampleMultiple, d.storage, &SampleStorage::appendMultiple);
+    connect(d.session, &DeviceSession::fastSamples, d.storage, &SampleStorage::appendFast);
+
+    devices.append(d);
+    return devices.size() - 1;
+}
+
+void SessionManager::startMerge(int intervalMs)
+{
+    mergeInterval = std::max(intervalMs, 1);
+    nextSlot = 0;
+    mergeTimer.start(mergeInterval);
+}
+
+void SessionManager::stopMerge()
+{
+    mergeTimer.stop();
+}
+
+void SessionManager::merge()
+{
+    // the devices deliver in batches and over different links - wait until all have sent a time
+    qint64 horizon = QDateTime::currentMSecsSinceEpoch() - Settings::mergeDelayMs;
+
+    if(!nextSlot) {
+        qint64 first = 0;
+        for(const Device& d : devices) {
+            if(d.storage->size() == 0) continue;
+            qint64 t = d.storage->timestamp(0);
+            if(!first || t < first) first = t;
+        }
+        if(!first) return;
+        nextSlot = ((first + mergeInterval - 1) / mergeInterval) * mergeInterval;
+    }
+
+    QVector<Sample> row(devices.size());
+    for(; nextSlot <= horizon; nextSlot += mergeInterval) {
+        bool any = false;
+        for(int i = 0; i < devices.size(); ++i) {
+            const SampleStorage* storage = devices[i].storage;
+            size_t n = storage->lowerBound(nextSlot + 1); // the last one at or before the slot is n-1
+            if(n > 0 && storage->timestamp(n - 1) > nextSlot - mergeInterval) {
+                row[i] = storage->sample(n - 1);
+                any = true;
+            }
+            else {
+                row[i] = Sample();
+            }
+        }
+        if(any) emit aligned(nextSlot, row);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+#include "commpool.h"
+#include "devicesession.h"
+#include "samplestorage.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+// Several devices in one process: a session and a storage per port, the comms share a thread pool.
+// Samples of all devices are merged into rows on a common time grid.
+class SessionManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SessionManager(QObject *parent = 0);
+    ~SessionManager();
+
+    int add(const QString& port, size_t limit, size_t fastLimit); // index of the device
+    int size() const { return devices.size(); }
+    const QString& port(int i) const { return devices[i].port; }
+    DeviceSession* session(int i) const { return devices[i].session; }
+    SampleStorage* storage(int i) const { return devices[i].storage; }
+
+    void startMerge(int intervalMs);
+    void stopMerge();
+
+signals:
+    // one sample per device, timestamp 0 - no sample of the device in (timestamp - interval, timestamp]
+    void aligned(qint64 timestamp, const QVector<Sample>& row);
+
+private:
+    void merge();
+
+private:
+    struct Device {
+        QString port;
+        DeviceSession* session;
+        SampleStorage* storage;
+    };
+
+private:
+    CommPool pool;
+    QVector<Device> devices;
+    QTimer mergeTimer;
+    int mergeInterval;
+    qint64 nextSlot;          // 0 - no samples yet
+};
+
+#endif // SESSIONMANAGER_H
@@ -3,7 +3,21 @@
 
 struct Settings
 {
-    static const size_t maxSamples = 1000 * 1000;
+    static const size_t maxSamples = 2500 * 1000; // 16 bytes each
+    static const size_t maxFastSamples = 4 * 1000 * 1000; // ~16 hours of the fast stream
+
+    static const int commandWindow    = 4;   // requests sent without waiting for responses
+    static const int commandTimeoutMs = 500;
+    static const int commandRetries   = 2;
+
+    static const int flowBatchDelayMs = 500; // max delay of samples collected into one StateBatch event
+    static const int mergeDelayMs = 2 * flowBatchDelayMs; // samples of all devices for a time are there after this
+
+    static const int commThreads = 4; // shared by all connected devices
+
+    static const int baudRate = 460800; // negotiated after connect; 115200 - don't negotiate
+
+    static constexpr const char* simulatorPort = "/tmp/ttyELOAD"; // default link of electronic_load_sim
 };
 
 
@@ -0,0 +1,76 @@
+#include "loadmodel.h"
+
+#include <algorithm>
+
+static const double LEAD_RESISTANCE = 0.05; // Ohm, both power leads together
+static const double HEAT_CAPACITY   = 60;   // J/K
+static const double FAN_RTH[4]      = { 3.0, 1.6, 1.1, 0.8 }; // K/W, off .. full
+
+LoadModel::LoadModel(const Params& params_)
+  : params(params_), rnd(1)
+{
+    reset();
+}
+
+void LoadModel::reset()
+{
+    u    = params.voltage;
+    i    = 0;
+    temp = params.ambient;
+    mAh  = 0;
+    mWh  = 0;
+    fan  = 0;
+}
+
+void LoadModel::step(int ms, bool running, uint16_t iSet, uint32_t powLimit)
+{
+    double discharged = std::min(mAh / params.capacity, 1.0);
+    double voc = params.voltage - (params.voltage - params.endVoltage) * discharged;
+
+    i = running ? (double)iSet / 1000 : 0;
+    if(i > voc / params.resistance) i = voc / params.resistance;
+    u = voc - i * params.resistance;
+    if(u * i * 1000 > powLimit) {
+        i = (double)powLimit / 1000 / u;
+        u = voc - i * params.resistance;
+    }
+
+    double p = u * i;
+    mAh += i * 1000 * ms / 3600000;
+    mWh += p * 1000 * ms / 3600000;
+
+    double rth = FAN_RTH[std::max(0, std::min(fan, 3))];
+    temp += (p - (temp - params.ambient) / rth) / HEAT_CAPACITY * ms / 1000;
+}
+
+uint16_t LoadModel::uMain() const
+{
+    double v = u - i * LEAD_RESISTANCE;
+    return (uint16_t)std::max(0.0, v * 1000 + noise());
+}
+
+uint16_t LoadModel::uSense() const
+{
+    if(!params.fourWire) return 0;
+    return (uint16_t)std::max(0.0, u * 1000 + noise());
+}
+
+uint16_t LoadModel::tempRaw() const
+{
+    return tempToRaw(temp);
+}
+
+uint16_t LoadModel::tempToRaw(double t)
+{
+    // close enough to the NTC divider around the device thresholds: 52 C - fan low, 84 C - limit
+    // below 0x0600 (sensor defect) down to ~5 C
+    double raw = 1600 - 16 * t;
+    return (uint16_t)std::max(1.0, std::min(raw, 1520.0));
+}
+
+double LoadModel::noise() const
+{
+    if(params.noise <= 0) return 0;
+    rnd = rnd * 1103515245 + 12345;
+    return ((double)((rnd >> 16) & 0x7FFF) / 0x7FFF * 2 - 1) * params.noise;
+}
@@ -0,0 +1,51 @@
+#ifndef LOADMODEL_H
+#define LOADMODEL_H
+
+#include <stdint.h>
+
+// Battery on a constant-current load with a heat sink and a fan,
+// values are in the units of the device protocol
+class LoadModel
+{
+public:
+    struct Params {
+        double voltage;     // V, open circuit, charged
+        double endVoltage;  // V, open circuit, discharged
+        double capacity;    // mAh
+        double resistance;  // Ohm, internal
+        double ambient;     // degree C
+        bool   fourWire;    // sense wires connected
+        double noise;       // mV, peak
+    };
+
+public:
+    LoadModel(const Params& params_);
+
+    void reset();
+    void step(int ms, bool running, uint16_t iSet, uint32_t powLimit); // iSet in mA, powLimit in mW
+
+    uint16_t uMain() const;     // mV
+    uint16_t uSense() const;    // mV
+    uint16_t tempRaw() const;   // NTC, lower - hotter
+    uint32_t ah() const { return (uint32_t)mAh; }
+    uint32_t wh() const { return (uint32_t)mWh; }
+    void resetEnergy() { mAh = 0; mWh = 0; }
+
+    void setFan(int level) { fan = level; } // 0..3
+    static uint16_t tempToRaw(double t);
+
+private:
+    double noise() const;
+
+private:
+    Params params;
+    double u;       // V, at the battery terminals
+    double i;       // A
+    double temp;    // degree C
+    double mAh;
+    double mWh;
+    int fan;
+    mutable uint32_t rnd;
+};
+
+#endif // LOADMODEL_H
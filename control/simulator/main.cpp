@@ -0,0 +1,95 @@
+#include "simdevice.h"
+#include "ptyport.h"
+#include "../settings.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QDebug>
+
+#include <algorithm>
+
+// Virtual electronic load on a pseudo-terminal.
+// The control program connects to the printed (or linked) port like to a real device.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("electronic_load_sim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulator of the electronic load on a pseudo-terminal");
+    parser.addHelpOption();
+    QCommandLineOption linkOption(QStringList() << "l" << "link", "Symlink to the port, empty - none.", "path", Settings::simulatorPort);
+    QCommandLineOption tickOption(QStringList() << "t" << "tick", "Main loop and model step.", "ms", "10");
+    QCommandLineOption intervalOption(QStringList() << "i" << "interval", "Force the flow interval, 0 - as requested by the host.", "ms", "0");
+    QCommandLineOption dropOption(QStringList() << "d" << "drop", "Not send this part of flow and stream events.", "percent", "0");
+    QCommandLineOption idleOption("idle", "Don't start the load after boot.");
+    QCommandLineOption fun2Option("fun2", "Battery test instead of constant current.");
+    QCommandLineOption twoWireOption("two-wire", "Sense wires not connected.");
+    QCommandLineOption voltageOption("voltage", "Battery voltage, charged.", "V", "12.6");
+    QCommandLineOption endVoltageOption("end-voltage", "Battery voltage, discharged.", "V", "10.5");
+    QCommandLineOption capacityOption("capacity", "Battery capacity.", "mAh", "2000");
+    QCommandLineOption resistanceOption("resistance", "Battery internal resistance.", "Ohm", "0.1");
+    QCommandLineOption ambientOption("ambient", "Ambient temperature.", "C", "25");
+    QCommandLineOption noiseOption("noise", "Measurement noise, peak.", "mV", "5");
+    parser.addOptions({ linkOption, tickOption, intervalOption, dropOption, idleOption, fun2Option, twoWireOption,
+                        voltageOption, endVoltageOption, capacityOption, resistanceOption, ambientOption, noiseOption });
+    parser.process(a);
+
+    LoadModel::Params params;
+    params.voltage    = parser.value(voltageOption).toDouble();
+    params.endVoltage = parser.value(endVoltageOption).toDouble();
+    params.capacity   = parser.value(capacityOption).toDouble();
+    params.resistance = parser.value(resistanceOption).toDouble();
+    params.ambient    = parser.value(ambientOption).toDouble();
+    params.fourWire   = !parser.isSet(twoWireOption);
+    params.noise      = parser.value(noiseOption).toDouble();
+
+    SimDevice::Options options;
+    options.tickMs        = std::max(1, parser.value(tickOption).toInt());
+    options.forceInterval = parser.value(intervalOption).toInt();
+    options.dropPercent   = parser.value(dropOption).toInt();
+    options.autoRun       = !parser.isSet(idleOption);
+    options.fun2          = parser.isSet(fun2Option);
+
+    if(params.capacity <= 0 || params.resistance <= 0) {
+        qCritical() << "capacity and resistance must be positive";
+        return 1;
+    }
+
+    PtyPort pty;
+    QString error;
+    if(!pty.open(error)) {
+        qCritical() << "cannot open pty:" << error;
+        return 1;
+    }
+    QString slaveName = pty.getName();
+
+    QString link = parser.value(linkOption);
+    if(!link.isEmpty()) {
+        QFile::remove(link);
+        if(!QFile::link(slaveName, link)) {
+            qCritical() << "cannot create link" << link;
+            return 1;
+        }
+    }
+    qDebug().noquote() << "port" << slaveName << (link.isEmpty() ? QString() : "linked as " + link);
+
+    SimDevice device(params, options);
+
+    QObject::connect(&device, &SimDevice::send, [&pty](const QByteArray& data) {
+        if(!pty.write(data)) {
+            static bool warned = false;
+            if(!warned) qWarning() << "output dropped, nobody reads the port";
+            warned = true;
+        }
+    });
+    QObject::connect(&pty, &PtyPort::received, &device, &SimDevice::receive);
+
+    device.boot();
+    int res = a.exec();
+
+    if(!link.isEmpty()) QFile::remove(link);
+    return res;
+}
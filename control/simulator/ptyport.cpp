@@ -0,0 +1,100 @@
+#include "ptyport.h"
+
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+// =============================================================================================================
+
+PtyPort::PtyPort()
+    : master(-1), slave(-1), notifier(nullptr)
+{
+}
+
+PtyPort::~PtyPort()
+{
+    close();
+}
+
+bool PtyPort::open(QString& error)
+{
+    close();
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0) {
+        error = strerror(errno);
+        return false;
+    }
+
+    if(grantpt(master) != 0 || unlockpt(master) != 0) {
+        error = strerror(errno);
+        close();
+        return false;
+    }
+    name = QString::fromLocal8Bit(ptsname(master));
+
+    // no echo, no line editing - the same as a serial port in raw mode
+    struct termios t;
+    if(tcgetattr(master, &t) == 0) {
+        cfmakeraw(&t);
+        tcsetattr(master, TCSANOW, &t);
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    slave = ::open(name.toLocal8Bit().constData(), O_RDWR | O_NOCTTY);
+
+    notifier = new QSocketNotifier(master, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &PtyPort::on_activated);
+    return true;
+}
+
+void PtyPort::close()
+{
+    delete notifier;
+    notifier = nullptr;
+    if(slave >= 0) ::close(slave);
+    if(master >= 0) ::close(master);
+    slave = -1;
+    master = -1;
+    name.clear();
+}
+
+bool PtyPort::write(const QByteArray& data)
+{
+    if(master < 0) return false;
+    return ::write(master, data.constData(), data.size()) == data.size();
+}
+
+bool PtyPort::writeAll(const QByteArray& data, int timeoutMs)
+{
+    if(master < 0) return false;
+
+    const char* p = data.constData();
+    const char* end = p + data.size();
+    while(p < end) {
+        ssize_t n = ::write(master, p, end - p);
+        if(n > 0) {
+            p += n;
+            continue;
+        }
+        if(n < 0 && errno != EAGAIN && errno != EINTR) return false;
+
+        struct pollfd fd = { master, POLLOUT, 0 };
+        if(poll(&fd, 1, timeoutMs) <= 0) return false; // the peer doesn't read
+    }
+    return true;
+}
+
+void PtyPort::on_activated()
+{
+    char buf[4096];
+    ssize_t n;
+    while((n = ::read(master, buf, sizeof(buf))) > 0)
+        emit received(QByteArray(buf, (int)n));
+}
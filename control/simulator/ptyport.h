@@ -0,0 +1,41 @@
+#ifndef PTYPORT_H
+#define PTYPORT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+
+class QSocketNotifier;
+
+// Master side of a pseudo-terminal in raw mode, the slave is used like a serial port
+class PtyPort : public QObject
+{
+    Q_OBJECT
+
+public:
+    PtyPort();
+    ~PtyPort();
+
+    bool open(QString& error);
+    void close();
+    QString getName() const { return name; } // of the slave
+
+    bool write(const QByteArray& data);                   // what doesn't fit is lost, like an UART without listener
+    bool writeAll(const QByteArray& data, int timeoutMs); // waits until the peer reads
+
+signals:
+    void received(QByteArray data);
+
+private slots:
+    void on_activated();
+
+private:
+    Q_DISABLE_COPY(PtyPort)
+
+    int master;
+    int slave;      // kept open, otherwise the master gets EIO while no client is connected
+    QString name;
+    QSocketNotifier *notifier;
+};
+
+#endif // PTYPORT_H
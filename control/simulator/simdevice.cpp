@@ -0,0 +1,609 @@
+#include "simdevice.h"
+#include "../crc.h"
+
+#include <QTimer>
+#include <QTimerEvent>
+
+static const uint8_t SLIP_END     = 0xC0;
+static const uint8_t SLIP_ESC     = 0xDB;
+static const uint8_t SLIP_ESC_END = 0xDC;
+static const uint8_t SLIP_ESC_ESC = 0xDD;
+
+static const int RXBUF_SIZE        = 250;
+static const int BOOT_MS           = 100;
+static const int FLOW_BATCH_SAMPLE = 15;
+static const int STREAM_SAMPLES    = 8;
+static const uint16_t U_SUP_RAW    = 0x0600; // ~12V, above uSupMin
+
+// big-endian, like the device
+struct FrameWriter {
+    QByteArray& buf;
+
+    FrameWriter(QByteArray& buf_) : buf(buf_) {}
+
+    void u8(uint8_t v) {
+        buf.append((char)v);
+    }
+
+    void u16(uint16_t v) {
+        u8(v >> 8);
+        u8(v);
+    }
+
+    void u32(uint32_t v) {
+        u16(v >> 16);
+        u16(v);
+    }
+
+    void varint(uint16_t v) {
+        while(v >= 0x80) {
+            u8((uint8_t)v | 0x80);
+            v >>= 7;
+        }
+        u8(v);
+    }
+};
+
+static QByteArray defaultConfig()
+{
+    // the same values as the commented out defaults in the firmware
+    CmdConfigData c(Cmd::WriteConfig, CmdState::Request);
+    c.iSetCoef   = { 86, 2700, 10 };
+    c.uCurCoef   = { 8630, 5117, 16 };
+    c.uSenseCoef = { 9790, 4495, 16 };
+    c.uSupMin       = 0x052A;
+    c.tempThreshold = 0x0020;
+    c.tempFanLow    = 0x0300;
+    c.tempFanMid    = 0x0280;
+    c.tempFanFull   = 0x0200;
+    c.tempLimit     = 0x0100;
+    c.tempDefect    = 0x0600;
+    c.iSetMin       = 100;
+    c.iSetMax       = 10000;
+    c.uSetMin       = 100;
+    c.uSetMax       = 25000;
+    c.uSenseMin     = 50;
+    c.uNegative     = 6000;
+    c.uMainLimit    = 31000;
+    c.powLimit      = 60000;
+    c.ahMax         = 999900;
+    c.whMax         = 9999000;
+    c.fun           = 0;
+    c.beepOn        = 1;
+    c.uSet          = 10000;
+    c.iSet          = 1000;
+    c.curUnit       = 0;
+    return formCmdData(c).mid(1);
+}
+
+// =============================================================================================================
+
+SimDevice::SimDevice(const LoadModel::Params& params, const Options& options_)
+  : options(options_), model(params), timerId(0), booting(true), rnd(1),
+    rxState(RxState::Start), rxHigh(0), hasChecksum(false),
+    config(defaultConfig()), cfg(Cmd::ReadConfig, CmdState::Response)
+{
+    parseCmdData(QByteArray(1, (char)((uint8_t)Cmd::ReadConfig | (uint8_t)CmdState::Response)) + config, cfg);
+    clock.start();
+}
+
+void SimDevice::boot()
+{
+    booting       = false;
+    mode          = options.autoRun ? (options.fun2 ? DeviceMode::Fun2Run : DeviceMode::Fun1Run)
+                                    : (options.fun2 ? DeviceMode::Fun2 : DeviceMode::Fun1);
+    error         = 0;
+    uSet          = cfg.uSet;
+    iSet          = cfg.iSet;
+    fanOverride   = -1;
+    rawCurrent    = -1;
+    binaryFraming = false;
+    uartBaud      = 115200;
+
+    flowInterval   = 1000;
+    lastFlow       = now() - flowInterval;
+    flowFlags      = 0;
+    flowSeq        = 0;
+    flowBatch      = 1;
+    flowBatchCount = 0;
+    flowBatchBuf.clear();
+
+    streamOn  = false;
+    streamSeq = 0;
+    streamMs.clear();
+    streamValues.clear();
+
+    model.resetEnergy();
+    resetRx();
+
+    if(!timerId) timerId = startTimer(options.tickMs, Qt::PreciseTimer);
+    sendCommand((uint8_t)Cmd::Reboot | (uint8_t)CmdState::Event);
+}
+
+bool SimDevice::dropEvent()
+{
+    if(options.dropPercent <= 0) return false;
+    rnd = rnd * 1103515245 + 12345;
+    return (int)((rnd >> 16) % 100) < options.dropPercent;
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// receiver, the same state machine as in uart.c
+
+void SimDevice::resetRx()
+{
+    rxState = RxState::Start;
+    rxBuf.resize(0);
+}
+
+void SimDevice::addRx(uint8_t c)
+{
+    rxBuf.append((char)c);
+    rxState = RxState::Bin;
+    if(rxBuf.size() >= RXBUF_SIZE) resetRx();
+}
+
+void SimDevice::receive(const QByteArray& data)
+{
+    if(booting) return;
+
+    for(auto i = data.begin(), e = data.end(); i != e; ++i) {
+        uint8_t b = (uint8_t)*i;
+
+        if(b == SLIP_END) {
+            if(rxState == RxState::Bin && !rxBuf.isEmpty()) {
+                processRx();
+            }
+            else {
+                resetRx();
+                rxState = RxState::Bin;
+                hasChecksum = true;
+            }
+            continue;
+        }
+
+        if(rxState != RxState::Bin && rxState != RxState::BinEsc && (b == 'S' || b == 's')) {
+            resetRx();
+            rxState = RxState::H;
+            hasChecksum = (b == 'S');
+            continue;
+        }
+
+        switch(rxState) {
+            case RxState::Start:
+                break;
+
+            case RxState::H:
+            case RxState::L:
+                {
+                    uint8_t v;
+                    if(b >= '0' && b <= '9') {
+                        v = b - '0';
+                    }
+                    else if(b >= 'A' && b <= 'F') {
+                        v = b - 'A' + 10;
+                    }
+                    else if(b == '\n') {
+                        break;
+                    }
+                    else if(b == '\r') {
+                        if(rxState == RxState::L)
+                            resetRx();
+                        else
+                            processRx();
+                        break;
+                    }
+                    else {
+                        resetRx();
+                        break;
+                    }
+
+                    if(rxState == RxState::H) {
+                        rxHigh = (v << 4);
+                        rxState = RxState::L;
+                    }
+                    else {
+                        rxBuf.append((char)(rxHigh | v));
+                        rxState = RxState::H;
+                        if(rxBuf.size() >= RXBUF_SIZE) resetRx();
+                    }
+                }
+                break;
+
+            case RxState::Bin:
+                if(b == SLIP_ESC)
+                    rxState = RxState::BinEsc;
+                else
+                    addRx(b);
+                break;
+
+            case RxState::BinEsc:
+                if(b == SLIP_ESC_END)
+                    addRx(SLIP_END);
+                else if(b == SLIP_ESC_ESC)
+                    addRx(SLIP_ESC);
+                else
+                    resetRx();
+                break;
+        }
+    }
+}
+
+void SimDevice::processRx()
+{
+    QByteArray buf = rxBuf;
+    resetRx();
+
+    if(hasChecksum) {
+        if(buf.isEmpty() || crc8(0, buf.constData(), buf.size()) != 0) {
+            emit send("checksum mismatch\r\n");
+            return;
+        }
+        buf.chop(1);
+    }
+    if(!buf.isEmpty()) processCommand(buf);
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// transmitter
+
+void SimDevice::sendCommand(uint8_t cmd, const QByteArray& data)
+{
+    QByteArray frame;
+    frame.append((char)cmd);
+    frame.append(data);
+    frame.append(crc8(0, frame.constData(), frame.size()));
+
+    QByteArray buf;
+    if(binaryFraming) {
+        buf.append((char)SLIP_END);
+        for(auto i = frame.begin(), e = frame.end(); i != e; ++i) {
+            if((uint8_t)*i == SLIP_END) {
+                buf.append((char)SLIP_ESC);
+                buf.append((char)SLIP_ESC_END);
+            }
+            else if((uint8_t)*i == SLIP_ESC) {
+                buf.append((char)SLIP_ESC);
+                buf.append((char)SLIP_ESC_ESC);
+            }
+            else {
+                buf.append(*i);
+            }
+        }
+        buf.append((char)SLIP_END);
+    }
+    else {
+        buf.append('S');
+        buf.append(frame.toHex().toUpper());
+        buf.append("\r\n");
+    }
+    emit send(buf);
+}
+
+void SimDevice::commit(uint8_t cmd)
+{
+    sendCommand(cmd | (uint8_t)CmdState::Response);
+}
+
+QByteArray SimDevice::prepareState() const
+{
+    QByteArray res;
+    FrameWriter w(res);
+    w.u8((uint8_t)mode);
+    w.u8(error);
+    w.u16(model.uMain());
+    w.u16(model.uSense());
+    w.u16(model.tempRaw());
+    w.u16(U_SUP_RAW);
+    w.u32(model.ah());
+    w.u32(model.wh());
+    return res;
+}
+
+uint32_t SimDevice::toRaw(uint16_t mV, const ValueCoef& coef) const
+{
+    // inverse of recalcValue
+    return (((uint32_t)mV << coef.div) / coef.mul) + coef.offset;
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// commands
+
+void SimDevice::processCommand(const QByteArray& buf)
+{
+    const uint8_t* b = (const uint8_t*)buf.constData();
+    int size = buf.size();
+    uint8_t cmd = b[0];
+    QByteArray reply;
+    FrameWriter w(reply);
+
+    switch((Cmd)cmd) {
+        case Cmd::Reboot:
+            if(size == 1) {
+                commit(cmd);
+                booting = true;
+                QTimer::singleShot(BOOT_MS, this, &SimDevice::boot);
+            }
+            break;
+
+        case Cmd::GetVersion:
+            if(size == 1) {
+                w.u32(VERSION);
+                sendCommand(cmd | (uint8_t)CmdState::Response, reply);
+            }
+            break;
+
+        case Cmd::ReadConfig:
+            if(size == 1)
+                sendCommand(cmd | (uint8_t)CmdState::Response, config);
+            break;
+
+        case Cmd::WriteConfig:
+            if(size == CMD_SIZE_CONFIG) {
+                config = buf.mid(1);
+                parseCmdData(QByteArray(1, (char)((uint8_t)Cmd::ReadConfig | (uint8_t)CmdState::Response)) + config, cfg);
+                commit(cmd);
+            }
+            break;
+
+        case Cmd::Display:
+            if(size == 10) commit(cmd);
+            break;
+
+        case Cmd::Beep:
+            if(size == 3) commit(cmd);
+            break;
+
+        case Cmd::Fan:
+            if(size == 2) {
+                fanOverride = (b[1] == 0xFF ? -1 : (b[1] > 66 ? 3 : b[1] > 33 ? 2 : b[1] > 0 ? 1 : 0));
+                commit(cmd);
+            }
+            break;
+
+        case Cmd::InputDisable:
+            if(size == 2) commit(cmd);
+            break;
+
+        case Cmd::ReadSettings:
+            if(size == 1) {
+                w.u16(uSet);
+                w.u16(iSet);
+                sendCommand(cmd | (uint8_t)CmdState::Response, reply);
+            }
+            break;
+
+        case Cmd::WriteSettings:
+            if(size == 5) {
+                uSet = ((uint16_t)b[1] << 8) | b[2];
+                iSet = ((uint16_t)b[3] << 8) | b[4];
+                commit(cmd);
+            }
+            break;
+
+        case Cmd::SetMode:     // FIXME in the firmware too
+            if(size == 2) commit(cmd);
+            break;
+
+        case Cmd::GetState:
+            if(size == 1)
+                sendCommand(cmd | (uint8_t)CmdState::Response, prepareState());
+            break;
+
+        case Cmd::ResetState:
+            if(size == 1) {
+                model.resetEnergy();
+                commit(cmd);
+            }
+            break;
+
+        case Cmd::FlowState:
+            if(size >= 3 && size <= 5) {
+                if(flowBatchCount > 0) sendFlowBatch(); // already counted in flowSeq, not to be lost
+                flowInterval = ((uint16_t)b[1] << 8) | b[2];
+                flowFlags = (size >= 4 ? b[3] : 0);
+                flowBatch = (size == 5 ? b[4] : 1);
+                if(flowBatch == 0) flowBatch = 1;
+                if(flowBatch > FLOW_BATCH_MAX) flowBatch = FLOW_BATCH_MAX;
+                lastFlow = now() - flowInterval;
+                commit(cmd);
+            }
+            break;
+
+        case Cmd::ReadRaw:
+            if(size == 1) {
+                w.u32(toRaw(model.uMain(), cfg.uCurCoef));
+                w.u32(toRaw(model.uSense(), cfg.uSenseCoef));
+                sendCommand(cmd | (uint8_t)CmdState::Response, reply);
+            }
+            break;
+
+        case Cmd::WriteRaw:
+            if(size == 3) {
+                uint16_t raw = ((uint16_t)b[1] << 8) | b[2];
+                if(raw == 0xFFFF)
+                    rawCurrent = -1;
+                else
+                    rawCurrent = raw <= cfg.iSetCoef.offset ? 0 : (((uint32_t)(raw - cfg.iSetCoef.offset) * cfg.iSetCoef.mul) >> cfg.iSetCoef.div);
+                commit(cmd);
+            }
+            break;
+
+        case Cmd::Bootloader:
+            if(size == 2) commit(cmd); // there is no bootloader to start
+            break;
+
+        case Cmd::Framing:
+            if(size == 2 && b[1] <= 1) {
+                commit(cmd);
+                if(flowBatchCount > 0) sendFlowBatch(); // the same
+                binaryFraming = b[1];
+            }
+            break;
+
+        case Cmd::Baud:
+            if(size == 5) {
+                uint32_t baud = ((uint32_t)b[1] << 24) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 8) | b[4];
+                if(baud == 115200 || baud == 230400 || baud == 460800) {
+                    w.u32(baud);
+                    sendCommand(cmd | (uint8_t)CmdState::Response, reply);
+                    uartBaud = baud; // a pty has no baud rate, nothing to confirm
+                }
+                else {
+                    sendCommand(cmd | (uint8_t)CmdState::Error);
+                }
+            }
+            break;
+
+        case Cmd::Stream:
+            if(size == 2 && b[1] <= 1) {
+                streamOn = b[1];
+                streamMs.clear();
+                streamValues.clear();
+                nextStreamMs = now();
+                commit(cmd);
+            }
+            break;
+
+        default:
+            emit send("->" + buf.toHex().toUpper());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// main loop
+
+void SimDevice::timerEvent(QTimerEvent *event)
+{
+    if(event->timerId() != timerId) return;
+    if(booting) return;
+
+    step();
+    processFlow();
+    processStream();
+}
+
+void SimDevice::step()
+{
+    uint16_t temp = model.tempRaw();
+
+    if(temp < cfg.tempLimit) {
+        error |= DEVICE_ERROR_OTP;
+        if(mode == DeviceMode::Fun1Run) mode = DeviceMode::Fun1;
+        if(mode == DeviceMode::Fun2Run) mode = DeviceMode::Fun2Res;
+    }
+    else {
+        error &= ~DEVICE_ERROR_OTP;
+    }
+
+    if(fanOverride >= 0)                                  model.setFan(fanOverride);
+    else if(temp < cfg.tempFanFull)                       model.setFan(3);
+    else if(temp < cfg.tempFanMid)                        model.setFan(2);
+    else if(temp < cfg.tempFanLow)                        model.setFan(1);
+    else if(temp >= cfg.tempFanLow + cfg.tempThreshold)   model.setFan(0);
+
+    bool running = isRunning() || rawCurrent >= 0;
+    uint16_t current = (rawCurrent >= 0 ? (uint16_t)rawCurrent : iSet);
+    model.step(options.tickMs, running, current, cfg.powLimit);
+
+    if(mode == DeviceMode::Fun2Run) {
+        uint16_t u = (model.uSense() + 100 >= model.uMain() ? model.uSense() : model.uMain());
+        if(u < uSet) mode = DeviceMode::Fun2Res;
+    }
+}
+
+void SimDevice::sendFlowBatch()
+{
+    QByteArray reply;
+    FrameWriter w(reply);
+    w.u8((uint8_t)mode);
+    w.u8(error);
+    w.u16(model.tempRaw());
+    w.u16(U_SUP_RAW);
+    w.u16(flowSeq - flowBatchCount);
+    w.u32(flowBatchMs);
+    w.u8(flowBatchCount);
+    reply.append(flowBatchBuf);
+
+    if(!dropEvent())
+        sendCommand((uint8_t)Cmd::StateBatch | (uint8_t)CmdState::Event, reply);
+    flowBatchCount = 0;
+    flowBatchBuf.resize(0);
+}
+
+void SimDevice::processFlow()
+{
+    uint32_t ms = now();
+    uint16_t interval = (options.forceInterval > 0 ? options.forceInterval : flowInterval);
+
+    if(flowInterval == 0xFFFF) return;
+    if(ms - lastFlow < interval) return;
+
+    // batches in binary framing only, as the firmware does
+    if(flowBatch > 1 && binaryFraming) {
+        if(flowBatchCount > 0 && flowBatchLastMode != (uint8_t)mode)
+            sendFlowBatch();
+
+        if(flowBatchCount == 0) flowBatchMs = ms;
+        FrameWriter w(flowBatchBuf);
+        w.u16((uint16_t)(ms - flowBatchMs));
+        w.u8((uint8_t)mode);
+        w.u16(model.uMain());
+        w.u16(model.uSense());
+        w.u32(model.ah());
+        w.u32(model.wh());
+        flowBatchLastMode = (uint8_t)mode;
+        ++flowBatchCount;
+        ++flowSeq;
+        if(flowBatchCount >= flowBatch) sendFlowBatch();
+    }
+    else {
+        QByteArray reply = prepareState();
+        if(flowFlags & FLOW_EXTENDED) {
+            FrameWriter w(reply);
+            w.u16(flowSeq);
+            w.u32(ms);
+        }
+        if(!dropEvent())
+            sendCommand((uint8_t)Cmd::GetState | (uint8_t)CmdState::Event, reply);
+        ++flowSeq;
+    }
+    lastFlow += interval;
+    if(ms - lastFlow > interval) lastFlow = ms;
+}
+
+void SimDevice::processStream()
+{
+    if(!streamOn) return;
+
+    // single fast measurements every 10 ms, but not during the precise ones at the begin of each 100 ms
+    uint32_t ms = now();
+    for(; nextStreamMs <= ms; nextStreamMs += 10) {
+        if((nextStreamMs / 10) % 10 < 3) continue;
+        streamMs.append(nextStreamMs);
+        streamValues.append(model.uSense() + 100 >= model.uMain() ? model.uSense() : model.uMain());
+    }
+
+    while(streamMs.size() >= STREAM_SAMPLES) {
+        QByteArray reply;
+        FrameWriter w(reply);
+        w.u16(streamSeq);
+        w.u32(streamMs[0]);
+        w.u8(STREAM_SAMPLES);
+        uint32_t lastMs = streamMs[0];
+        uint16_t last = 0;
+        for(int i = 0; i < STREAM_SAMPLES; ++i) {
+            int16_t d = (int16_t)(streamValues[i] - last);
+            w.varint((uint16_t)(streamMs[i] - lastMs));
+            w.varint(((uint16_t)d << 1) ^ (d < 0 ? 0xFFFF : 0));
+            last   = streamValues[i];
+            lastMs = streamMs[i];
+        }
+        streamMs.remove(0, STREAM_SAMPLES);
+        streamValues.remove(0, STREAM_SAMPLES);
+
+        if(!dropEvent())
+            sendCommand((uint8_t)Cmd::Stream | (uint8_t)CmdState::Event, reply);
+        streamSeq += STREAM_SAMPLES;
+    }
+}
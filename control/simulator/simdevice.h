@@ -0,0 +1,112 @@
+#ifndef SIMDEVICE_H
+#define SIMDEVICE_H
+
+#include "loadmodel.h"
+#include "../decoder.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QVector>
+
+// The device side of the UART protocol, as implemented in processUartCommand of the firmware
+class SimDevice : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        int  tickMs;        // main loop and model step
+        int  forceInterval; // ms, flow interval regardless of FlowState; 0 - as requested
+        int  dropPercent;   // flow and stream events silently not sent, to test gap detection
+        bool autoRun;       // start the load after boot
+        bool fun2;          // battery test instead of constant current
+    };
+
+    static const uint32_t VERSION = 0x00010500;
+
+public:
+    SimDevice(const LoadModel::Params& params, const Options& options_);
+
+public slots:
+    void boot();
+    void receive(const QByteArray& data);
+
+signals:
+    void send(const QByteArray& data);
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private:
+    enum class RxState {
+        Start,
+        H,
+        L,
+        Bin,
+        BinEsc
+    };
+
+private:
+    uint32_t now() const { return (uint32_t)clock.elapsed(); }
+    bool isRunning() const { return mode == DeviceMode::Fun1Run || mode == DeviceMode::Fun2Run; }
+    bool dropEvent();
+    void resetRx();
+    void addRx(uint8_t c);
+    void processRx();
+    void processCommand(const QByteArray& buf);
+    void sendCommand(uint8_t cmd, const QByteArray& data = QByteArray());
+    void commit(uint8_t cmd);
+    void step();
+    void processFlow();
+    void processStream();
+    void sendFlowBatch();
+    QByteArray prepareState() const;
+    uint32_t toRaw(uint16_t mV, const ValueCoef& coef) const;
+
+private:
+    Options options;
+    LoadModel model;
+    QElapsedTimer clock;
+    int timerId;
+    bool booting;
+    uint32_t rnd;
+
+    // receiver
+    RxState rxState;
+    QByteArray rxBuf;
+    uint8_t rxHigh;
+    bool hasChecksum;
+
+    // device state
+    QByteArray config;      // as stored in the EEPROM, big-endian
+    CmdConfigData cfg;      // the same, decoded
+    DeviceMode mode;
+    uint8_t error;
+    uint16_t uSet;          // mV
+    uint16_t iSet;          // mA
+    int fanOverride;        // -1 - automatic
+    int rawCurrent;         // mA, WriteRaw; -1 - not used
+    bool binaryFraming;
+    uint32_t uartBaud;
+
+    // flow
+    uint16_t flowInterval;
+    uint32_t lastFlow;
+    uint8_t flowFlags;
+    uint16_t flowSeq;
+    uint8_t flowBatch;
+    QByteArray flowBatchBuf;    // samples only
+    int flowBatchCount;
+    uint32_t flowBatchMs;
+    uint8_t flowBatchLastMode;
+
+    // stream
+    bool streamOn;
+    uint16_t streamSeq;
+    uint32_t nextStreamMs;
+    QVector<uint32_t> streamMs;
+    QVector<uint16_t> streamValues;
+};
+
+#endif // SIMDEVICE_H
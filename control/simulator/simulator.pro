@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Virtual device for the control program, Linux only
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core
+QT       -= gui
+
+TARGET = electronic_load_sim
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    simdevice.cpp \
+    loadmodel.cpp \
+    ptyport.cpp \
+    ../decoder.cpp \
+    ../crc.cpp
+
+HEADERS  += simdevice.h \
+    loadmodel.h \
+    ptyport.h \
+    ../decoder.h \
+    ../crc.h \
+    ../settings.h
@@ -3,6 +3,8 @@
 
 #include <QDateTime>
 
+#include <algorithm>
+
 // =============================================================================================================
 
 QVariant TableModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -31,7 +33,7 @@ QVariant TableModel::headerData(int section, Qt::Orientation orientation, int ro
 int TableModel::rowCount(const QModelIndex & parent) const
 {
     (void)parent;
-    return storage.size();
+    return rows;
 }
 
 int TableModel::columnCount(const QModelIndex & parent) const
@@ -45,7 +47,8 @@ QVariant TableModel::data(const QModelIndex & index, int role) const
     static const QString dateTimeFormat("dd.MM.yyyy hh:mm.ss.zzz");
 
     if(Qt::DisplayRole == role) {
-        const Sample& sample = storage.sample(index.row());
+        if((size_t)index.row() < removed) return QVariant(); // deleted, not synced yet
+        const Sample& sample = storage.sample(index.row() - removed);
         switch(index.column()) {
             case 0: // full time stamp
                 return QVariant(QDateTime::fromMSecsSinceEpoch(sample.timestamp).toString(dateTimeFormat));
@@ -83,28 +86,6 @@ bool TableModel::insertRows(int row, int count, const QModelIndex & parent)
     return true;
 }
 
-void TableModel::beforeAppend(const Sample& sample)
-{
-    (void)sample;
-
-    beginInsertRows(QModelIndex(), storage.size(), storage.size());
-}
-
-void TableModel::beforeAppendMultiple(const QVector<Sample> &list)
-{
-    beginInsertRows(QModelIndex(), storage.size(), storage.size() + list.size() - 1);
-}
-
-void TableModel::afterAppend()
-{
-    endInsertRows();
-}
-
-void TableModel::afterAppendMultiple()
-{
-    endInsertRows();
-}
-
 void TableModel::beforeClear()
 {
     beginResetModel();
@@ -112,15 +93,33 @@ void TableModel::beforeClear()
 
 void TableModel::afterClear()
 {
+    rows = 0;
+    removed = 0;
     endResetModel();
 }
 
-void TableModel::beforeDelete(size_t n)
+void TableModel::afterDelete(size_t n)
 {
-    beginRemoveRows(QModelIndex(), 0, n-1);
+    removed += n;
 }
 
-void TableModel::afterDelete()
+void TableModel::sync()
 {
-    endRemoveRows();
+    if(removed) {
+        // rows appended and deleted since the last sync were never published
+        int n = (int)std::min(removed, (size_t)rows);
+        removed = 0;
+        if(n) {
+            beginRemoveRows(QModelIndex(), 0, n - 1);
+            rows -= n;
+            endRemoveRows();
+        }
+    }
+
+    int size = (int)storage.size();
+    if(size > rows) {
+        beginInsertRows(QModelIndex(), rows, size - 1);
+        rows = size;
+        endInsertRows();
+    }
 }
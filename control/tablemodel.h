@@ -5,10 +5,12 @@
 
 #include <QAbstractTableModel>
 
+// Appended and deleted rows are published by sync(), so the view is updated at most once a frame.
+// Until then rows keep their numbers and the deleted ones are empty.
 class TableModel : public QAbstractTableModel
 {
 public:
-    TableModel(SampleStorage& storage_) : storage(storage_) {}
+    TableModel(SampleStorage& storage_) : storage(storage_), rows(0), removed(0) {}
 
     int rowCount(const QModelIndex & parent = QModelIndex()) const override;
     int columnCount(const QModelIndex & parent = QModelIndex()) const override;
@@ -16,17 +18,15 @@ public:
     bool insertRows(int row, int count, const QModelIndex & parent = QModelIndex()) override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
-    void beforeAppend(const Sample &sample);
-    void beforeAppendMultiple(const QVector<Sample> &list);
-    void afterAppend();
-    void afterAppendMultiple();
     void beforeClear();
     void afterClear();
-    void beforeDelete(size_t n);
-    void afterDelete();
+    void afterDelete(size_t n);
+    void sync();
 
 private:
     SampleStorage& storage;
+    int rows;          // published
+    size_t removed;    // deleted from the storage since the last sync
 };
 
 #endif // TABLEMODEL_H
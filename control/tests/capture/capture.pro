@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Capture files: blocks, Sync records and replay
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_capture
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_capture.cpp \
+    ../../capture.cpp
+
+HEADERS  += ../../capture.h
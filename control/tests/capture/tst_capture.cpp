@@ -0,0 +1,133 @@
+#include "../../capture.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <random>
+
+// =============================================================================================================
+
+struct Written {
+    qint64 timestamp;
+    bool tx;
+    QByteArray data;
+};
+
+// frames of the sizes on the link, several blocks of them
+static QVector<Written> writeCapture(const QString& fileName, int count)
+{
+    std::mt19937 rnd(5);
+    QVector<Written> frames;
+    CaptureWriter writer;
+    QString error;
+    if(!writer.open(fileName, error)) return frames;
+
+    qint64 t = 1500000000000LL;
+    for(int n = 0; n < count; ++n) {
+        Written w;
+        t += rnd() % 20;
+        w.timestamp = t;
+        w.tx = (rnd() % 4 == 0);
+        w.data = QByteArray(1 + (int)(rnd() % 250), 0);
+        for(int k = 0; k < w.data.size(); ++k)
+            w.data[k] = (char)rnd();
+        writer.append(w.data, w.timestamp, w.tx);
+        frames.append(w);
+    }
+    writer.close();
+    return frames;
+}
+
+// =============================================================================================================
+
+class TestCapture : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void replayBySync();
+    void findBlock();
+    void notCapture();
+
+private:
+    QTemporaryDir dir;
+};
+
+// every block starts with a Sync record at block * BLOCK_SIZE, parsed on its own it continues the frames before it
+void TestCapture::replayBySync()
+{
+    QString fileName = dir.filePath("replay.elcp");
+    QVector<Written> written = writeCapture(fileName, 20000);
+    QCOMPARE(written.size(), 20000);
+
+    CaptureReader reader;
+    QString error;
+    QVERIFY2(reader.open(fileName, error), qPrintable(error));
+    QVERIFY(reader.blockCount() > 10);
+    QCOMPARE(reader.blockCount(), (int)((QFileInfo(fileName).size() + CaptureWriter::BLOCK_SIZE - 1) / CaptureWriter::BLOCK_SIZE));
+
+    // backwards, so that no block relies on the one before it
+    QVector<CaptureReader::Frame> all;
+    for(int b = reader.blockCount() - 1; b >= 0; --b) {
+        CaptureReader::Sync s;
+        QVERIFY(reader.sync(b, s));
+        QCOMPARE((int)s.block, b);
+
+        QVector<CaptureReader::Frame> frames;
+        QVERIFY(reader.readBlock(b, frames));
+        QVERIFY(!frames.isEmpty());
+        QCOMPARE(s.timestamp, frames.front().timestamp);
+        QVERIFY(s.frames + frames.size() <= (quint64)written.size());
+        for(int k = 0; k < frames.size(); ++k) {
+            const Written& w = written[(int)s.frames + k];
+            QCOMPARE(frames[k].timestamp, w.timestamp);
+            QCOMPARE(frames[k].tx, w.tx);
+            QCOMPARE(frames[k].data, w.data);
+        }
+        all = frames + all;
+    }
+    QCOMPARE(all.size(), written.size());
+}
+
+void TestCapture::findBlock()
+{
+    QString fileName = dir.filePath("find.elcp");
+    QVector<Written> written = writeCapture(fileName, 20000);
+
+    CaptureReader reader;
+    QString error;
+    QVERIFY2(reader.open(fileName, error), qPrintable(error));
+
+    QCOMPARE(reader.findBlock(written.front().timestamp - 1), 0);
+    QCOMPARE(reader.findBlock(written.back().timestamp + 1), reader.blockCount() - 1);
+
+    // the frame is in the block found or, with equal timestamps at a border, in the one before
+    for(int n = 0; n < written.size(); n += 997) {
+        int b = reader.findBlock(written[n].timestamp);
+        QVector<CaptureReader::Frame> frames;
+        QVERIFY(reader.readBlock(b, frames));
+        if(b > 0) QVERIFY(reader.readBlock(b - 1, frames));
+        bool found = false;
+        for(const CaptureReader::Frame& f : frames)
+            found = found || (f.timestamp == written[n].timestamp && f.data == written[n].data);
+        QVERIFY(found);
+    }
+}
+
+void TestCapture::notCapture()
+{
+    QString fileName = dir.filePath("not.elcp");
+    QFile f(fileName);
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(100, 'x'));
+    f.close();
+
+    CaptureReader reader;
+    QString error;
+    QVERIFY(!reader.open(fileName, error));
+    QVERIFY(!error.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestCapture)
+
+#include "tst_capture.moc"
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Receive path of Comm over a pseudo-terminal, Linux only
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core serialport testlib
+QT       -= gui
+
+TARGET = tst_comm
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_comm.cpp \
+    ../../simulator/ptyport.cpp \
+    ../../comm.cpp \
+    ../../commpool.cpp \
+    ../../portbackend.cpp \
+    ../../nativeportbackend.cpp \
+    ../../capture.cpp \
+    ../../crc.cpp \
+    ../../logging.cpp
+
+HEADERS  += ../../simulator/ptyport.h \
+    ../../comm.h \
+    ../../commpool.h \
+    ../../portbackend.h \
+    ../../nativeportbackend.h \
+    ../../capture.h \
+    ../../crc.h \
+    ../../decoder.h \
+    ../../logging.h
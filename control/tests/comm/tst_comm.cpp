@@ -0,0 +1,168 @@
+#include "../../simulator/ptyport.h"
+#include "../../comm.h"
+#include "../../commpool.h"
+#include "../../crc.h"
+#include "../../decoder.h"
+
+#include <QtTest>
+
+#include <atomic>
+
+#include <time.h>
+
+Q_DECLARE_METATYPE(Comm::State)
+Q_DECLARE_METATYPE(Comm::Framing)
+Q_DECLARE_METATYPE(Comm::Backend)
+
+// =============================================================================================================
+
+static qint64 nsecs(clockid_t id)
+{
+    struct timespec t;
+    clock_gettime(id, &t);
+    return (qint64)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// the same as the device sends
+static QByteArray encode(const QByteArray& data, Comm::Framing framing)
+{
+    QByteArray frame = data;
+    frame.append(crc8(0, data.constData(), data.size()));
+
+    QByteArray buf;
+    if(framing == Comm::Framing::Hex) {
+        buf.append('S');
+        buf.append(frame.toHex().toUpper());
+        buf.append('\r');
+        return buf;
+    }
+
+    buf.append(Comm::SLIP_END);
+    for(auto i = frame.begin(), e = frame.end(); i != e; ++i) {
+        if(*i == Comm::SLIP_END || *i == Comm::SLIP_ESC) {
+            buf.append(Comm::SLIP_ESC);
+            buf.append(*i == Comm::SLIP_END ? Comm::SLIP_ESC_END : Comm::SLIP_ESC_ESC);
+        }
+        else {
+            buf.append(*i);
+        }
+    }
+    buf.append(Comm::SLIP_END);
+    return buf;
+}
+
+// a state event with extended flow, the most frequent frame on the link
+static QByteArray stateEvent(int n)
+{
+    QByteArray data(CMD_SIZE_STATE_EXT, 0);
+    data[0] = (char)((int)Cmd::GetState | (int)CmdState::Event);
+    for(int i = 1; i < data.size(); ++i)
+        data[i] = (char)(n * 31 + i * 7); // escapes in the binary framing too
+    return data;
+}
+
+// =============================================================================================================
+
+// queued to the comm thread, like DeviceSession does
+class Driver : public QObject
+{
+    Q_OBJECT
+
+signals:
+    void setBackend(Comm::Backend backend);
+    void portConnect(QString portName);
+    void setFraming(Comm::Framing framing);
+};
+
+class TestComm : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void receive_data();
+    void receive();
+};
+
+void TestComm::initTestCase()
+{
+    qRegisterMetaType<Comm::State>();
+    qRegisterMetaType<Comm::Framing>();
+    qRegisterMetaType<Comm::Backend>();
+}
+
+void TestComm::receive_data()
+{
+    QTest::addColumn<Comm::Backend>("backend");
+    QTest::addColumn<Comm::Framing>("framing");
+
+    QTest::newRow("qt hex")        << Comm::Backend::Qt     << Comm::Framing::Hex;
+    QTest::newRow("qt binary")     << Comm::Backend::Qt     << Comm::Framing::Binary;
+    QTest::newRow("native hex")    << Comm::Backend::Native << Comm::Framing::Hex;
+    QTest::newRow("native binary") << Comm::Backend::Native << Comm::Framing::Binary;
+}
+
+// frames per second through the receiver and CPU time of the comm thread per frame;
+// the reader thread of the native backend is not counted
+void TestComm::receive()
+{
+    QFETCH(Comm::Backend, backend);
+    QFETCH(Comm::Framing, framing);
+
+    static const int FRAMES = 20000;
+    static const int CHUNK  = 4096; // bytes per write, frames are split between reads
+
+    QByteArray stream;
+    for(int i = 0; i < FRAMES; ++i)
+        stream.append(encode(stateEvent(i), framing));
+
+    PtyPort pty;
+    QString error;
+    QVERIFY2(pty.open(error), qPrintable(error));
+
+    // written by the comm thread only, read after all frames are counted
+    std::atomic<int> frames(0);
+    std::atomic<int> connected(0);
+    qint64 wallStart = 0, wallEnd = 0;
+    qint64 cpuStart = 0, cpuEnd = 0;
+
+    CommPool pool(1);
+    Comm* comm = pool.create();
+    QObject::connect(comm, &Comm::stateChanged, comm, [&](Comm::State state) {
+        connected = (state == Comm::State::Connected);
+    }, Qt::DirectConnection);
+    QObject::connect(comm, &Comm::data, comm, [&](QByteArray, qint64) {
+        int n = frames.load() + 1;
+        if(n == 1 || n == FRAMES) {
+            qint64& wall = (n == 1 ? wallStart : wallEnd);
+            qint64& cpu  = (n == 1 ? cpuStart  : cpuEnd);
+            wall = nsecs(CLOCK_MONOTONIC);
+            cpu  = nsecs(CLOCK_THREAD_CPUTIME_ID);
+        }
+        frames = n;
+    }, Qt::DirectConnection);
+
+    Driver driver;
+    QObject::connect(&driver, &Driver::setBackend, comm, &Comm::setBackend);
+    QObject::connect(&driver, &Driver::portConnect, comm, &Comm::portConnect);
+    QObject::connect(&driver, &Driver::setFraming, comm, &Comm::setFraming);
+    emit driver.setBackend(backend);
+    emit driver.portConnect(pty.getName());
+    emit driver.setFraming(framing);
+    QTRY_VERIFY(connected.load());
+
+    for(int pos = 0; pos < stream.size(); pos += CHUNK)
+        QVERIFY(pty.writeAll(stream.mid(pos, CHUNK), 5000));
+    QTRY_COMPARE_WITH_TIMEOUT(frames.load(), FRAMES, 10000);
+
+    double seconds = (double)(wallEnd - wallStart) / 1e9;
+    double cpuUs   = (double)(cpuEnd - cpuStart) / 1e3 / (FRAMES - 1);
+    qInfo("%s: %.0f frames/s, %.2f us CPU per frame", QTest::currentDataTag(),
+          seconds > 0 ? (FRAMES - 1) / seconds : 0.0, cpuUs);
+
+    pool.release(comm);
+}
+
+QTEST_GUILESS_MAIN(TestComm)
+
+#include "tst_comm.moc"
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# CRC-8 of the link against the firmware routine
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_crc
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_crc.cpp \
+    ../../crc.cpp
+
+HEADERS  += ../../crc.h
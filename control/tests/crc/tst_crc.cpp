@@ -0,0 +1,129 @@
+#include "../../crc.h"
+
+#include <QtTest>
+
+#include <random>
+#include <stdint.h>
+
+// =============================================================================================================
+
+// crc8 of main.c, as described there: poly 0x07, no reflection, bit by bit
+static uint8_t crc8Bitwise(uint8_t crc, const uint8_t* data, size_t size)
+{
+    for(; size > 0; --size, ++data) {
+        crc ^= *data;
+        for(uint8_t i = 0; i < 8; ++i)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static QByteArray randomBytes(std::mt19937& rnd, int size)
+{
+    QByteArray buf(size, 0);
+    for(int i = 0; i < size; ++i)
+        buf[i] = (char)rnd();
+    return buf;
+}
+
+// =============================================================================================================
+
+class TestCrc : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void knownAnswer_data();
+    void knownAnswer();
+    void frameCheck();
+    void tableEqualsBitwise();
+    void benchmarkTable();
+    void benchmarkBitwise();
+};
+
+void TestCrc::knownAnswer_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("crc");
+
+    QByteArray all;
+    for(int i = 0; i < 256; ++i) all.append((char)i);
+
+    QTest::newRow("empty")           << QByteArray()                            << 0x00;
+    QTest::newRow("check")           << QByteArray("123456789")                 << 0xF4; // CRC-8/SMBUS
+    QTest::newRow("GetState")        << QByteArray::fromHex("0C")               << 0x24;
+    QTest::newRow("GetState resp")   << QByteArray::fromHex("4C01")             << 0xA0;
+    QTest::newRow("all bytes")       << all                                     << 0x14;
+    QTest::newRow("ones")            << QByteArray(32, (char)0xFF)              << 0x09;
+}
+
+void TestCrc::knownAnswer()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, crc);
+
+    QCOMPARE((int)(uint8_t)crc8(0, data.constData(), (size_t)data.size()), crc);
+
+    char c = 0;
+    for(int i = 0; i < data.size(); ++i) c = crc8(c, data.at(i));
+    QCOMPARE((int)(uint8_t)c, crc);
+}
+
+// the receiver checks a frame by the CRC over data and CRC being zero
+void TestCrc::frameCheck()
+{
+    std::mt19937 rnd(1);
+    for(int size = 1; size <= 64; ++size) {
+        QByteArray frame = randomBytes(rnd, size);
+        frame.append(crc8(0, frame.constData(), (size_t)frame.size()));
+        QCOMPARE((int)crc8(0, frame.constData(), (size_t)frame.size()), 0);
+
+        frame[size / 2] = (char)(frame.at(size / 2) ^ 0x01);
+        QVERIFY(crc8(0, frame.constData(), (size_t)frame.size()) != 0);
+    }
+}
+
+// every length around the 4-byte step and every alignment of the start
+void TestCrc::tableEqualsBitwise()
+{
+    std::mt19937 rnd(2);
+    for(int round = 0; round < 16; ++round) {
+        QByteArray buf = randomBytes(rnd, 300);
+        uint8_t init = (uint8_t)rnd();
+        for(int offset = 0; offset < 4; ++offset) {
+            for(int size = 0; size <= 260; ++size) {
+                const char* p = buf.constData() + offset;
+                uint8_t expected = crc8Bitwise(init, (const uint8_t*)p, (size_t)size);
+                uint8_t actual = (uint8_t)crc8((char)init, p, (size_t)size);
+                if(actual != expected)
+                    QFAIL(qPrintable(QString("offset %1 size %2 init %3").arg(offset).arg(size).arg(init)));
+            }
+        }
+    }
+}
+
+// a full receive buffer, the same data for both
+void TestCrc::benchmarkTable()
+{
+    std::mt19937 rnd(3);
+    QByteArray buf = randomBytes(rnd, 250);
+    volatile char res = 0;
+    QBENCHMARK {
+        res = crc8(res, buf.constData(), (size_t)buf.size());
+    }
+}
+
+// the bit by bit loop the table replaced
+void TestCrc::benchmarkBitwise()
+{
+    std::mt19937 rnd(3);
+    QByteArray buf = randomBytes(rnd, 250);
+    volatile uint8_t res = 0;
+    QBENCHMARK {
+        res = crc8Bitwise(res, (const uint8_t*)buf.constData(), (size_t)buf.size());
+    }
+}
+
+QTEST_GUILESS_MAIN(TestCrc)
+
+#include "tst_crc.moc"
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# Decoding of state, batch and stream events
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_decoder
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_decoder.cpp \
+    ../../decoder.cpp
+
+HEADERS  += ../../decoder.h
@@ -0,0 +1,222 @@
+#include "../../decoder.h"
+
+#include <QtTest>
+
+// =============================================================================================================
+
+// big-endian, as the device sends
+struct FrameWriter {
+    QByteArray data;
+
+    explicit FrameWriter(Cmd cmd) {
+        data.append((char)((int)cmd | (int)CmdState::Event));
+    }
+
+    void u8(uint8_t v) {
+        data.append((char)v);
+    }
+
+    void u16(uint16_t v) {
+        u8(v >> 8);
+        u8(v & 0xFF);
+    }
+
+    void u32(uint32_t v) {
+        u16(v >> 16);
+        u16(v & 0xFFFF);
+    }
+
+    void varint(uint16_t v) {
+        for(; v >= 0x80; v >>= 7) u8((v & 0x7F) | 0x80);
+        u8(v);
+    }
+};
+
+static QByteArray stateEvent(uint16_t seq)
+{
+    FrameWriter w(Cmd::GetState);
+    w.u8((uint8_t)DeviceMode::Fun1Run);
+    w.u8(0);            // error
+    w.u16(12000);       // uMain
+    w.u16(11950);       // uSense
+    w.u16(512);         // tempRaw
+    w.u16(700);         // uSupRaw
+    w.u32(1500);        // ah
+    w.u32(18000);       // wh
+    w.u16(seq);
+    w.u32(100000);      // ms
+    return w.data;
+}
+
+static QByteArray batchEvent(uint16_t seq, int count)
+{
+    FrameWriter w(Cmd::StateBatch);
+    w.u8((uint8_t)DeviceMode::Fun1Run);
+    w.u8(0);            // error
+    w.u16(512);         // tempRaw
+    w.u16(700);         // uSupRaw
+    w.u16(seq);
+    w.u32(100000);      // ms of the first sample
+    w.u8(count);
+    for(int i = 0; i < count; ++i) {
+        w.u16(i * 100); // ms, from the first sample
+        w.u8((uint8_t)DeviceMode::Fun1Run);
+        w.u16(12000 - i);
+        w.u16(11950 - i);
+        w.u32(1500 + i);
+        w.u32(18000 + i);
+    }
+    return w.data;
+}
+
+static QByteArray streamEvent(uint16_t seq, int count)
+{
+    FrameWriter w(Cmd::Stream);
+    w.u16(seq);
+    w.u32(100000);      // ms
+    w.u8(count);
+    for(int i = 0; i < count; ++i) {
+        int16_t du = (i & 1) ? -3 : 5;
+        w.varint(10);   // dt, ms
+        w.varint((uint16_t)((du << 1) ^ (du >> 15))); // zigzag
+    }
+    return w.data;
+}
+
+// =============================================================================================================
+
+class TestDecoder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void state();
+    void batch();
+    void batchReused();
+    void stream();
+    void streamReused();
+    void benchmarkState();
+    void benchmarkBatchNew();
+    void benchmarkBatchReused();
+    void benchmarkStreamNew();
+    void benchmarkStreamReused();
+};
+
+void TestDecoder::state()
+{
+    CmdStateData c(Cmd::GetState, CmdState::Event);
+    QVERIFY(parseCmdData(stateEvent(7), c));
+    QVERIFY(c.extended);
+    QCOMPARE((int)c.seq, 7);
+    QCOMPARE(c.ms, (uint32_t)100000);
+    QCOMPARE((int)c.uSense, 11950);
+    QCOMPARE(c.wh, (uint32_t)18000);
+}
+
+void TestDecoder::batch()
+{
+    CmdStateBatchData c(Cmd::StateBatch, CmdState::Event);
+    QVERIFY(parseCmdData(batchEvent(0xFFFE, FLOW_BATCH_MAX), c));
+    QCOMPARE(c.states.size(), FLOW_BATCH_MAX);
+    QCOMPARE((int)c.states[0].seq, 0xFFFE);
+    QCOMPARE((int)c.states[2].seq, 0);      // wraps
+    QCOMPARE(c.states[3].ms, (uint32_t)100300);
+    QCOMPARE((int)c.states[3].uMain, 11997);
+    QCOMPARE((int)c.states[3].tempRaw, 512); // from the header
+}
+
+// the way DeviceSession decodes: one object, the vector is never reallocated
+void TestDecoder::batchReused()
+{
+    CmdStateBatchData c(Cmd::StateBatch, CmdState::Event);
+    c.states.reserve(FLOW_BATCH_MAX);
+    const CmdStateData* buf = c.states.constData();
+    int capacity = c.states.capacity();
+
+    const int counts[] = { FLOW_BATCH_MAX, 1, 3, FLOW_BATCH_MAX, 2 };
+    for(int count : counts) {
+        QVERIFY(parseCmdData(batchEvent(100, count), c));
+        QCOMPARE(c.states.size(), count);
+        QCOMPARE(c.states.constData(), buf);
+        QCOMPARE(c.states.capacity(), capacity);
+    }
+}
+
+void TestDecoder::stream()
+{
+    CmdStreamData c(Cmd::Stream, CmdState::Event);
+    QVERIFY(parseCmdData(streamEvent(5, STREAM_POINTS_MAX), c));
+    QCOMPARE((int)c.seq, 5);
+    QCOMPARE(c.points.size(), STREAM_POINTS_MAX);
+    QCOMPARE(c.points[0].ms, (uint32_t)100010);
+    QCOMPARE((int)c.points[0].u, 5);
+    QCOMPARE((int)c.points[1].u, 2);
+}
+
+void TestDecoder::streamReused()
+{
+    CmdStreamData c(Cmd::Stream, CmdState::Event);
+    c.points.reserve(STREAM_POINTS_MAX);
+    const CmdStreamData::Point* buf = c.points.constData();
+    int capacity = c.points.capacity();
+
+    const int counts[] = { STREAM_POINTS_MAX, 1, 4, STREAM_POINTS_MAX };
+    for(int count : counts) {
+        QVERIFY(parseCmdData(streamEvent(100, count), c));
+        QCOMPARE(c.points.size(), count);
+        QCOMPARE(c.points.constData(), buf);
+        QCOMPARE(c.points.capacity(), capacity);
+    }
+}
+
+void TestDecoder::benchmarkState()
+{
+    QByteArray d = stateEvent(1);
+    CmdStateData c(Cmd::GetState, CmdState::Event);
+    QBENCHMARK {
+        parseCmdData(d, c);
+    }
+}
+
+// as before: a new object and a new vector per event
+void TestDecoder::benchmarkBatchNew()
+{
+    QByteArray d = batchEvent(1, FLOW_BATCH_MAX);
+    QBENCHMARK {
+        CmdStateBatchData c(Cmd::StateBatch, CmdState::Event);
+        parseCmdData(d, c);
+    }
+}
+
+void TestDecoder::benchmarkBatchReused()
+{
+    QByteArray d = batchEvent(1, FLOW_BATCH_MAX);
+    CmdStateBatchData c(Cmd::StateBatch, CmdState::Event);
+    c.states.reserve(FLOW_BATCH_MAX);
+    QBENCHMARK {
+        parseCmdData(d, c);
+    }
+}
+
+void TestDecoder::benchmarkStreamNew()
+{
+    QByteArray d = streamEvent(1, STREAM_POINTS_MAX);
+    QBENCHMARK {
+        CmdStreamData c(Cmd::Stream, CmdState::Event);
+        parseCmdData(d, c);
+    }
+}
+
+void TestDecoder::benchmarkStreamReused()
+{
+    QByteArray d = streamEvent(1, STREAM_POINTS_MAX);
+    CmdStreamData c(Cmd::Stream, CmdState::Event);
+    c.points.reserve(STREAM_POINTS_MAX);
+    QBENCHMARK {
+        parseCmdData(d, c);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestDecoder)
+
+#include "tst_decoder.moc"
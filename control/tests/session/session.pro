@@ -0,0 +1,45 @@
+#-------------------------------------------------
+#
+# DeviceSession against the simulator over a pseudo-terminal, Linux only
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core serialport testlib
+QT       -= gui
+
+TARGET = tst_session
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_session.cpp \
+    ../../simulator/ptyport.cpp \
+    ../../simulator/simdevice.cpp \
+    ../../simulator/loadmodel.cpp \
+    ../../devicesession.cpp \
+    ../../commpool.cpp \
+    ../../comm.cpp \
+    ../../portbackend.cpp \
+    ../../nativeportbackend.cpp \
+    ../../capture.cpp \
+    ../../decoder.cpp \
+    ../../crc.cpp \
+    ../../deviceclock.cpp \
+    ../../logging.cpp
+
+HEADERS  += ../../simulator/ptyport.h \
+    ../../simulator/simdevice.h \
+    ../../simulator/loadmodel.h \
+    ../../devicesession.h \
+    ../../commpool.h \
+    ../../comm.h \
+    ../../portbackend.h \
+    ../../nativeportbackend.h \
+    ../../capture.h \
+    ../../decoder.h \
+    ../../crc.h \
+    ../../deviceclock.h \
+    ../../logging.h \
+    ../../sample.h \
+    ../../settings.h
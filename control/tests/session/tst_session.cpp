@@ -0,0 +1,82 @@
+#include "../../simulator/ptyport.h"
+#include "../../simulator/simdevice.h"
+#include "../../devicesession.h"
+#include "../../commpool.h"
+
+#include <QtTest>
+
+// =============================================================================================================
+
+class TestSession : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fullDuplex();
+};
+
+// requests go out while state and stream events come in, nothing may be lost on the way
+void TestSession::fullDuplex()
+{
+    PtyPort pty;
+    QString error;
+    QVERIFY2(pty.open(error), qPrintable(error));
+
+    LoadModel::Params params = { 12.6, 10.5, 2000, 0.1, 25, true, 5 };
+    SimDevice::Options options = { 2, 10, 0, true, false }; // 2 ms tick, state events every 10 ms, no drops, running
+    SimDevice device(params, options);
+    QObject::connect(&device, &SimDevice::send, [&pty](const QByteArray& data) { pty.write(data); });
+    QObject::connect(&pty, &PtyPort::received, &device, &SimDevice::receive);
+
+    CommPool pool(1);
+    DeviceSession session(pool);
+    session.setInterval(DeviceSession::MIN_INTERVAL_BINARY_MS);
+    session.setFastStream(true);
+
+    quint64 lostStates = 0, lostFast = 0;
+    int samples = 0, fastSamples = 0, settings = 0;
+    uint32_t version = 0;
+    QObject::connect(&session, &DeviceSession::lost, [&](quint64 states, quint64 fast) {
+        lostStates = states;
+        lostFast = fast;
+    });
+    QObject::connect(&session, &DeviceSession::sample, [&](Sample) { ++samples; });
+    QObject::connect(&session, &DeviceSession::sampleMultiple, [&](const QVector<Sample>& list) { samples += list.size(); });
+    QObject::connect(&session, &DeviceSession::fastSamples, [&](const QVector<FastSample>& list) { fastSamples += list.size(); });
+    QObject::connect(&session, &DeviceSession::settings, [&](uint16_t, uint16_t) { ++settings; });
+    QObject::connect(&session, &DeviceSession::version, [&](uint32_t v) { version = v; });
+
+    device.boot();
+    session.connectPort(pty.getName());
+    QTRY_COMPARE(version, (uint32_t)SimDevice::VERSION);
+    QTRY_VERIFY(samples > 0);
+    int settingsBefore = settings;
+
+    // the flow goes on at full rate, requests of all sizes in between
+    int sent = 0;
+    QTimer requests;
+    requests.setInterval(15);
+    QObject::connect(&requests, &QTimer::timeout, [&]() {
+        session.request(formCmdData(Cmd::ReadSettings));
+        session.request(formCmdData(Cmd::GetState));
+        session.request(formCmdData(Cmd::ReadConfig));
+        ++sent;
+    });
+    int samplesBefore = samples;
+    requests.start();
+    QTest::qWait(3000);
+    requests.stop();
+
+    QTRY_VERIFY_WITH_TIMEOUT(settings - settingsBefore >= sent, 5000); // every request answered
+    QVERIFY(samples - samplesBefore > 100);
+    QVERIFY(fastSamples > 0);
+    QCOMPARE(lostStates, (quint64)0);
+    QCOMPARE(lostFast, (quint64)0);
+
+    session.disconnectPort();
+    QTRY_VERIFY(!session.isRunning());
+}
+
+QTEST_GUILESS_MAIN(TestSession)
+
+#include "tst_session.moc"
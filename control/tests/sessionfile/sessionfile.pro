@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Session files: chunk coding, the writer and the reader
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_sessionfile
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_sessionfile.cpp \
+    ../../sessionfile.cpp
+
+HEADERS  += ../../sessionfile.h \
+    ../../sample.h \
+    ../../decoder.h
@@ -0,0 +1,284 @@
+#include "../../sessionfile.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// =============================================================================================================
+
+// in the resolution of the format, so that they read back the same
+static QVector<Sample> makeSamples(int count, unsigned seed)
+{
+    std::mt19937 rnd(seed);
+    QVector<Sample> samples;
+    qint64 t = 1500000000000LL;
+    qint64 ah = 0, wh = 0;
+    for(int n = 0; n < count; ++n) {
+        Sample s;
+        t += (rnd() % 8 == 0) ? 1 + rnd() % 3000 : 100; // mostly steady
+        ah += rnd() % 5;
+        wh += rnd() % 60;
+        s.timestamp = t;
+        s.u  = (int)(rnd() % 65536) / 1000.0;
+        s.i  = (int)(rnd() % 20000) / 1000.0;
+        s.ah = ah / 1000.0;
+        s.wh = (n % 100 == 0 ? -wh : wh) / 1000.0;
+        samples.append(s);
+    }
+    return samples;
+}
+
+static bool same(const Sample& a, const Sample& b)
+{
+    return a.timestamp == b.timestamp && a.u == b.u && a.i == b.i && a.ah == b.ah && a.wh == b.wh;
+}
+
+static qint64 column(const Sample& s, int v)
+{
+    double d = v == (int)SessionColumn::U ? s.u : v == (int)SessionColumn::I ? s.i : v == (int)SessionColumn::Ah ? s.ah : s.wh;
+    return (qint64)std::llround(d * 1000.0);
+}
+
+static bool writeSession(const QString& fileName, const QVector<Sample>& samples, QString& error)
+{
+    SessionWriter writer;
+    if(!writer.open(fileName, samples.front().timestamp, error)) return false;
+    for(const Sample& s : samples)
+        if(!writer.append(s, error)) return false;
+    return writer.close(error);
+}
+
+// the index offset of the file, from the trailer
+static qint64 indexOffset(const QByteArray& file)
+{
+    return (qint64)qFromLittleEndian<quint64>((const uchar*)file.constData() + file.size() - SessionWriter::TRAILER_SIZE);
+}
+
+static QByteArray readFile(const QString& fileName)
+{
+    QFile f(fileName);
+    return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+}
+
+static bool writeFile(const QString& fileName, const QByteArray& data)
+{
+    QFile f(fileName);
+    return f.open(QIODevice::WriteOnly | QIODevice::Truncate) && f.write(data) == data.size();
+}
+
+// =============================================================================================================
+
+class TestSessionFile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void encodeDecode_data();
+    void encodeDecode();
+    void truncatedChunk();
+    void writeRead();
+    void corruptedIndex();
+    void corruptedChunk();
+
+private:
+    QTemporaryDir dir;
+    QString fileName;
+};
+
+void TestSessionFile::init()
+{
+    QVERIFY(dir.isValid());
+    fileName = dir.filePath(QString("%1.elss").arg(QTest::currentTestFunction()));
+}
+
+void TestSessionFile::encodeDecode_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("one") << 1;
+    QTest::newRow("two") << 2;
+    QTest::newRow("odd") << 1001;
+    QTest::newRow("full") << (int)SessionWriter::CHUNK_SAMPLES;
+}
+
+// the samples and the summary of a chunk
+void TestSessionFile::encodeDecode()
+{
+    QFETCH(int, count);
+    QVector<Sample> samples = makeSamples(count, (unsigned)count);
+
+    QByteArray out;
+    SessionChunk s;
+    encodeSessionChunk(samples.constData(), samples.size(), out, s);
+    QCOMPARE(s.count, (quint32)count);
+    QCOMPARE(s.size, (quint32)out.size());
+    QCOMPARE(s.first, samples.front().timestamp);
+    QCOMPARE(s.last, samples.back().timestamp);
+    for(int v = 0; v < SessionChunk::VALUES; ++v) {
+        qint64 mn = column(samples[0], v), mx = mn, sum = 0;
+        for(const Sample& x : samples) {
+            mn = std::min(mn, column(x, v));
+            mx = std::max(mx, column(x, v));
+            sum += column(x, v);
+        }
+        QCOMPARE(s.min[v], mn);
+        QCOMPARE(s.max[v], mx);
+        QCOMPARE(s.sum[v], sum);
+        QCOMPARE(s.firstValue[v], column(samples.front(), v));
+        QCOMPARE(s.lastValue[v], column(samples.back(), v));
+    }
+
+    QVector<Sample> decoded;
+    QVERIFY(decodeSessionChunk((const uchar*)out.constData(), s, decoded));
+    QCOMPARE(decoded.size(), samples.size());
+    for(int k = 0; k < count; ++k)
+        QVERIFY2(same(decoded[k], samples[k]), qPrintable(QString::number(k)));
+}
+
+// any cut of a chunk is told apart, never read past its end
+void TestSessionFile::truncatedChunk()
+{
+    QVector<Sample> samples = makeSamples(300, 7);
+    QByteArray out;
+    SessionChunk s;
+    encodeSessionChunk(samples.constData(), samples.size(), out, s);
+
+    QVector<Sample> decoded;
+    for(int size = 0; size < out.size(); size += (size < 64 ? 1 : 37)) {
+        SessionChunk cut = s;
+        cut.size = (quint32)size;
+        QByteArray copy = out.left(size); // nothing after it to read by mistake
+        QVERIFY2(!decodeSessionChunk((const uchar*)copy.constData(), cut, decoded), qPrintable(QString::number(size)));
+    }
+
+    // more samples than in the columns
+    SessionChunk more = s;
+    more.count += 1;
+    QVERIFY(!decodeSessionChunk((const uchar*)out.constData(), more, decoded));
+}
+
+// 2.5 chunks through the file and back, chunk by chunk and by sample
+void TestSessionFile::writeRead()
+{
+    const int count = SessionWriter::CHUNK_SAMPLES * 5 / 2;
+    QVector<Sample> samples = makeSamples(count, 11);
+    QString error;
+    QVERIFY2(writeSession(fileName, samples, error), qPrintable(error));
+
+    SessionReader reader;
+    QVERIFY2(reader.open(fileName, error), qPrintable(error));
+    QCOMPARE(reader.size(), (size_t)count);
+    QCOMPARE(reader.getBegin(), samples.front().timestamp);
+    QCOMPARE(reader.chunkCount(), 3);
+    QCOMPARE(reader.chunk(2).count, (quint32)(count - 2 * SessionWriter::CHUNK_SAMPLES));
+
+    int k = 0;
+    for(int c = 0; c < reader.chunkCount(); ++c) {
+        const SessionChunk& s = reader.chunk(c);
+        QCOMPARE(s.first, samples[k].timestamp);
+        QCOMPARE(s.firstValue[(int)SessionColumn::U], column(samples[k], (int)SessionColumn::U));
+        const QVector<Sample>& chunk = reader.readChunk(c);
+        QCOMPARE(chunk.size(), (int)s.count);
+        for(const Sample& x : chunk)
+            QVERIFY(same(x, samples[k++]));
+        QCOMPARE(s.last, samples[k - 1].timestamp);
+        QCOMPARE(s.lastValue[(int)SessionColumn::Wh], column(samples[k - 1], (int)SessionColumn::Wh));
+    }
+    QCOMPARE(k, count);
+
+    // back and forth over more chunks than cached
+    for(int n = 0; n < 2000; ++n) {
+        size_t i = (size_t)((n * 7919LL) % count);
+        QVERIFY(same(reader.sample(i), samples[(int)i]));
+        QCOMPARE(reader.findChunk(i), (int)(i / SessionWriter::CHUNK_SAMPLES));
+    }
+
+    for(int i = 0; i < count; i += 333) {
+        QCOMPARE(reader.lowerBound(samples[i].timestamp), (size_t)i);
+        QCOMPARE(reader.lowerBound(samples[i].timestamp + 1), (size_t)i + 1);
+    }
+    QCOMPARE(reader.lowerBound(samples.front().timestamp - 1), (size_t)0);
+    QCOMPARE(reader.lowerBound(samples.back().timestamp + 1), (size_t)count);
+}
+
+// a broken index or trailer is not opened
+void TestSessionFile::corruptedIndex()
+{
+    QVector<Sample> samples = makeSamples(SessionWriter::CHUNK_SAMPLES + 10, 13);
+    QString error;
+    QVERIFY2(writeSession(fileName, samples, error), qPrintable(error));
+    const QByteArray good = readFile(fileName);
+    QVERIFY(!good.isEmpty());
+    const qint64 index = indexOffset(good);
+
+    SessionReader reader;
+    QVERIFY2(reader.open(fileName, error), qPrintable(error));
+    reader.close();
+
+    // a chunk past the index
+    QByteArray bad = good;
+    qToLittleEndian<quint64>((quint64)index, (uchar*)bad.data() + index + SessionWriter::INDEX_ENTRY_SIZE);
+    QVERIFY(writeFile(fileName, bad));
+    QVERIFY(!reader.open(fileName, error));
+    QVERIFY(!reader.isOpen());
+
+    // a chunk without samples
+    bad = good;
+    qToLittleEndian<quint32>(0, (uchar*)bad.data() + index + 12);
+    QVERIFY(writeFile(fileName, bad));
+    QVERIFY(!reader.open(fileName, error));
+
+    // the trailer
+    bad = good;
+    bad[bad.size() - 1] = 'X';
+    QVERIFY(writeFile(fileName, bad));
+    QVERIFY(!reader.open(fileName, error));
+
+    // the number of chunks does not match the index
+    bad = good;
+    qToLittleEndian<quint32>(3, (uchar*)bad.data() + bad.size() - SessionWriter::TRAILER_SIZE + 8);
+    QVERIFY(writeFile(fileName, bad));
+    QVERIFY(!reader.open(fileName, error));
+
+    // cut anywhere
+    for(int size : { 0, SessionWriter::HEADER_SIZE, (int)index, good.size() - 1 }) {
+        QVERIFY(writeFile(fileName, good.left(size)));
+        QVERIFY2(!reader.open(fileName, error), qPrintable(QString::number(size)));
+    }
+
+    // another version
+    bad = good;
+    qToLittleEndian<quint16>(SessionWriter::VERSION + 1, (uchar*)bad.data() + 4);
+    QVERIFY(writeFile(fileName, bad));
+    QVERIFY(!reader.open(fileName, error));
+}
+
+// a chunk broken inside reads as no samples, the others as they are
+void TestSessionFile::corruptedChunk()
+{
+    QVector<Sample> samples = makeSamples(SessionWriter::CHUNK_SAMPLES * 2, 17);
+    QString error;
+    QVERIFY2(writeSession(fileName, samples, error), qPrintable(error));
+    QByteArray bad = readFile(fileName);
+
+    // the size of the timestamp column of the first chunk past the chunk
+    qToLittleEndian<quint32>(0xFFFFFFFFu, (uchar*)bad.data() + SessionWriter::HEADER_SIZE);
+    QVERIFY(writeFile(fileName, bad));
+
+    SessionReader reader;
+    QVERIFY2(reader.open(fileName, error), qPrintable(error));
+    QCOMPARE(reader.size(), (size_t)samples.size());
+    QVERIFY(reader.readChunk(0).isEmpty());
+    QCOMPARE(reader.sample(5).timestamp, (qint64)0);
+    QCOMPARE(reader.readChunk(1).size(), (int)SessionWriter::CHUNK_SAMPLES);
+    QVERIFY(same(reader.sample(SessionWriter::CHUNK_SAMPLES), samples[SessionWriter::CHUNK_SAMPLES]));
+}
+
+QTEST_GUILESS_MAIN(TestSessionFile)
+
+#include "tst_sessionfile.moc"
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# SampleStorage: the ring, the spill and the archive
+#
+#-------------------------------------------------
+
+QMAKE_CXXFLAGS += -std=c++11
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_storage
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+SOURCES += tst_storage.cpp \
+    ../../samplestorage.cpp \
+    ../../samplespill.cpp \
+    ../../sessionfile.cpp
+
+HEADERS  += ../../samplestorage.h \
+    ../../samplespill.h \
+    ../../sessionfile.h \
+    ../../sample.h \
+    ../../decoder.h
@@ -0,0 +1,267 @@
+#include "../../samplestorage.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <cstdint>
+
+// =============================================================================================================
+
+static const qint64 T0 = 1500000000000LL;
+static const qint64 MAX_OFFSET = 0xFFFFFFFFLL; // of the ring timestamps, ~49 days
+
+// values exact in the quantization of the storage
+static Sample makeSample(qint64 n)
+{
+    Sample s;
+    s.timestamp = T0 + n * 10;
+    s.u  = (n % 1000) / 100.0;
+    s.i  = (n % 500) / 1000.0;
+    s.ah = n / 1000.0;
+    s.wh = -n / 1000.0;
+    return s;
+}
+
+static void appendBatches(SampleStorage& storage, qint64 from, qint64 to, int batch)
+{
+    for(qint64 n = from; n < to; n += batch) {
+        QVector<Sample> list;
+        for(qint64 k = n; k < std::min(n + batch, to); ++k)
+            list.append(makeSample(k));
+        if(list.size() == 1)
+            storage.append(list.front());
+        else
+            storage.appendMultiple(list);
+    }
+}
+
+// the samples are makeSample(first) and on
+static bool samplesFrom(const SampleStorage& storage, qint64 first)
+{
+    for(size_t k = 0; k < storage.size(); ++k) {
+        Sample s = storage.sample(k), e = makeSample(first + (qint64)k);
+        if(s.timestamp != e.timestamp || s.u != e.u || s.i != e.i || s.ah != e.ah || s.wh != e.wh) {
+            qWarning("sample %d: %lld, expected %lld", (int)k, s.timestamp, e.timestamp);
+            return false;
+        }
+        if(storage.timestamp(k) != e.timestamp) return false;
+    }
+    return true;
+}
+
+// =============================================================================================================
+
+class TestStorage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void wraparound_data();
+    void wraparound();
+    void oversizedBatch();
+    void evictAtLimit();
+    void rebase();
+    void lowerBound();
+    void quantization();
+};
+
+void TestStorage::wraparound_data()
+{
+    QTest::addColumn<int>("batch");
+    for(int batch : { 1, 2, 3, 7, 10, 16 })
+        QTest::newRow(qPrintable(QString::number(batch))) << batch;
+}
+
+// the ring keeps the latest limit samples in order whatever the batches are
+void TestStorage::wraparound()
+{
+    QFETCH(int, batch);
+    const size_t limit = 16;
+    SampleStorage storage(limit, 0);
+    storage.setEnabled(true);
+
+    appendBatches(storage, 0, 100, batch);
+    QCOMPARE(storage.size(), limit);
+    QVERIFY(samplesFrom(storage, 100 - (qint64)limit));
+
+    SampleStorage::Columns ring;
+    storage.copyRing(ring);
+    QCOMPARE(ring.size(), limit);
+    QCOMPARE(ring.sample(0).timestamp, makeSample(100 - (qint64)limit).timestamp);
+    QCOMPARE(ring.sample(limit - 1).timestamp, makeSample(99).timestamp);
+}
+
+// more than the ring takes at once: only the latest ones, no spill involved
+void TestStorage::oversizedBatch()
+{
+    SampleStorage storage(10, 0);
+    storage.setEnabled(true);
+    int deleted = 0;
+    QObject::connect(&storage, &SampleStorage::afterDelete, [&deleted](size_t n) { deleted += (int)n; });
+
+    appendBatches(storage, 0, 5, 5);
+    appendBatches(storage, 5, 30, 25);
+    QCOMPARE(storage.size(), (size_t)10);
+    QCOMPARE(storage.getCold(), (size_t)0);
+    QVERIFY(samplesFrom(storage, 20));
+    QCOMPARE(deleted, 5);
+}
+
+// at the limit the oldest go: deleted without the spill, kept with the same indexes with it
+void TestStorage::evictAtLimit()
+{
+    SampleStorage deleting(8, 0);
+    deleting.setEnabled(true);
+    appendBatches(deleting, 0, 9, 1);
+    QCOMPARE(deleting.size(), (size_t)8);
+    QVERIFY(samplesFrom(deleting, 1));
+
+    SampleStorage spilling(8, 0);
+    spilling.setEnabled(true);
+    QString error;
+    QVERIFY2(spilling.setSpilling(true, error), qPrintable(error));
+    appendBatches(spilling, 0, 50, 3);
+    QCOMPARE(spilling.size(), (size_t)50);
+    QVERIFY(spilling.getCold() > 0);
+    QVERIFY(spilling.getCold() <= 50 - 1);
+    QVERIFY(samplesFrom(spilling, 0));
+
+    spilling.del(20);
+    QCOMPARE(spilling.size(), (size_t)30);
+    QVERIFY(samplesFrom(spilling, 20));
+
+    QVERIFY(spilling.setSpilling(false, error)); // the spilled samples go with it
+    QCOMPARE(spilling.getCold(), (size_t)0);
+    QVERIFY(spilling.size() > 0);
+    QCOMPARE(spilling.sample(spilling.size() - 1).timestamp, makeSample(49).timestamp);
+}
+
+// the timestamps of the ring are 32-bit offsets from a base moved by fit()
+void TestStorage::rebase()
+{
+    SampleStorage storage(100, 0);
+    storage.setEnabled(true);
+
+    // older than all: the base moves back, the kept ones stay the same
+    Sample s = makeSample(1000);
+    storage.append(s);
+    s.timestamp = T0 - 5000;
+    storage.append(s);
+    QCOMPARE(storage.size(), (size_t)2);
+    QCOMPARE(storage.timestamp(0), makeSample(1000).timestamp);
+    QCOMPARE(storage.timestamp(1), T0 - 5000);
+
+    // the span up to MAX_OFFSET fits
+    storage.clear();
+    s.timestamp = T0;
+    storage.append(s);
+    s.timestamp = T0 + MAX_OFFSET;
+    storage.append(s);
+    QCOMPARE(storage.size(), (size_t)2);
+    QCOMPARE(storage.timestamp(0), T0);
+    QCOMPARE(storage.timestamp(1), T0 + MAX_OFFSET);
+
+    // beyond it what is too old goes, 49 days later
+    s.timestamp = T0 + MAX_OFFSET + 1000;
+    storage.append(s);
+    QCOMPARE(storage.size(), (size_t)2);
+    QCOMPARE(storage.timestamp(0), T0 + MAX_OFFSET);
+    QCOMPARE(storage.timestamp(1), T0 + MAX_OFFSET + 1000);
+
+    // and again, from another base
+    s.timestamp = T0 + 3 * MAX_OFFSET;
+    storage.append(s);
+    QCOMPARE(storage.size(), (size_t)1);
+    QCOMPARE(storage.timestamp(0), T0 + 3 * MAX_OFFSET);
+}
+
+// an archive of 2.5 chunks, a spill and the ring behind it, against a linear search
+void TestStorage::lowerBound()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString fileName = dir.filePath("archive.elss");
+
+    const qint64 archived = SessionWriter::CHUNK_SAMPLES * 5 / 2;
+    SessionWriter writer;
+    QString error;
+    QVERIFY2(writer.open(fileName, T0, error), qPrintable(error));
+    for(qint64 n = 0; n < archived; ++n)
+        QVERIFY2(writer.append(makeSample(n), error), qPrintable(error));
+    QVERIFY2(writer.close(error), qPrintable(error));
+
+    SampleStorage storage(1000, 0);
+    storage.setEnabled(true);
+    QVERIFY2(storage.setSpilling(true, error), qPrintable(error));
+    QVERIFY2(storage.openSession(fileName, error), qPrintable(error));
+    QCOMPARE(storage.size(), (size_t)archived);
+
+    appendBatches(storage, archived, archived + 3500, 7);
+    QCOMPARE(storage.size(), (size_t)archived + 3500);
+    QVERIFY(storage.getCold() > (size_t)archived);
+    QVERIFY(storage.getCold() < storage.size());
+    QVERIFY(samplesFrom(storage, 0));
+
+    std::vector<qint64> all(storage.size());
+    for(size_t k = 0; k < all.size(); ++k)
+        all[k] = storage.timestamp(k);
+
+    std::vector<qint64> probes = { T0 - 1, T0, T0 + 5, all.back(), all.back() + 1 };
+    for(size_t k = 0; k < all.size(); k += 97)
+        probes.push_back(all[k] - 3);
+    probes.push_back(all[archived - 1] + 1);                 // the archive to the spill
+    probes.push_back(all[storage.getCold() - 1] + 1);        // the spill to the ring
+    for(qint64 t : probes) {
+        size_t expected = (size_t)(std::lower_bound(all.begin(), all.end(), t) - all.begin());
+        QCOMPARE(storage.lowerBound(t), expected);
+    }
+
+    // with the front of the archive deleted
+    storage.del(100);
+    all.erase(all.begin(), all.begin() + 100);
+    for(qint64 t : probes) {
+        size_t expected = (size_t)(std::lower_bound(all.begin(), all.end(), t) - all.begin());
+        QCOMPARE(storage.lowerBound(t), expected);
+    }
+}
+
+// mV and mA in u16, mAh and mWh in i32, clamped to the bounds
+void TestStorage::quantization()
+{
+    SampleStorage storage(10, 0);
+    storage.setEnabled(true);
+
+    Sample s = { T0, 65.535, 0.0, INT32_MAX / 1000.0, INT32_MIN / 1000.0 };
+    storage.append(s);
+    s = { T0 + 1, 70.0, -1.0, 1e7, -1e7 };
+    storage.append(s);
+    s = { T0 + 2, 1.2344, 0.0006, -0.0004, 0.0016 };
+    storage.append(s);
+
+    Sample a = storage.sample(0);
+    QCOMPARE(a.u, 65535 / 1000.0);
+    QCOMPARE(a.i, 0.0);
+    QCOMPARE(a.ah, INT32_MAX / 1000.0);
+    QCOMPARE(a.wh, INT32_MIN / 1000.0);
+
+    Sample b = storage.sample(1);
+    QCOMPARE(b.u, 65535 / 1000.0);
+    QCOMPARE(b.i, 0.0);
+    QCOMPARE(b.ah, INT32_MAX / 1000.0);
+    QCOMPARE(b.wh, INT32_MIN / 1000.0);
+
+    // rounded to the nearest
+    Sample c = storage.sample(2);
+    QCOMPARE(c.u, 1234 / 1000.0);
+    QCOMPARE(c.i, 1 / 1000.0);
+    QCOMPARE(c.ah, 0.0);
+    QCOMPARE(c.wh, 2 / 1000.0);
+    QCOMPARE(storage.voltage(2), c.u);
+    QCOMPARE(storage.current(2), c.i);
+    QCOMPARE(storage.energy(2), c.wh);
+}
+
+QTEST_GUILESS_MAIN(TestStorage)
+
+#include "tst_storage.moc"
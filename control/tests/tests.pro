@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Unit tests and benchmarks, run with "make check"
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += crc \
+    decoder \
+    capture \
+    storage \
+    sessionfile
+
+linux {
+    SUBDIRS += comm \
+        session
+}
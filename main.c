@@ -21,7 +21,7 @@
 
 // --------------------------------------------------------------------------------------------------------------------
 
-#define VERSION 0x00010000
+#define VERSION 0x00010500
 
 #define LED_V   0x01
 #define LED_AH  0x02
@@ -102,6 +102,18 @@ static          uint8_t  sCountCopy;
 static volatile uint32_t sSum;       // raw
 static          uint32_t sSumCopy;   // raw
 
+// fast stream, filled in interrupt context
+#define STREAM_BUF_SIZE      16 // power of 2
+#define STREAM_FRAME_SAMPLES 8
+#define STREAM_SENSE         0x8000 // flag in streamValues
+static volatile bool     streamOn;
+static volatile uint16_t streamValues[STREAM_BUF_SIZE]; // raw, channel flag
+static volatile uint32_t streamMs[STREAM_BUF_SIZE];
+static volatile uint8_t  streamHead;
+static          uint8_t  streamTail;
+static volatile uint8_t  streamDropped; // buffer overflow
+static          uint16_t streamSeq;
+
 static uint16_t cal1Disp;
 static uint32_t cal1First;
 static uint32_t cal1Sec;
@@ -200,7 +212,22 @@ static uint8_t display[8];
 static uint8_t inputDisable;
 static uint16_t flowInterval = 1000; // ms
 static uint32_t lastFlow;
-static uint8_t commReply[18];
+#define FLOW_EXTENDED 0x01 // add sequence number and timestamp to state events
+static uint8_t flowFlags;
+static uint16_t flowSeq; // wraps, lets the host detect lost events
+#define FLOW_BATCH_MAX    8
+#define FLOW_BATCH_HEADER 13 // mode, error, tempRaw, uSupRaw, seq, ms, count
+#define FLOW_BATCH_SAMPLE 15 // dt, mode, uMain, uSense, ah, wh
+static uint8_t flowBatch = 1; // samples per event, StateBatch events if > 1
+static uint8_t flowBatchCount;
+static uint32_t flowBatchMs;
+static uint8_t flowBatchBuf[FLOW_BATCH_HEADER + FLOW_BATCH_MAX * FLOW_BATCH_SAMPLE];
+static uint8_t commReply[24];
+static bool binaryFraming;
+#define BAUD_CONFIRM_MS 1000 // fall back to BAUD if nothing valid is received at the new rate
+static uint32_t uartBaud = BAUD;
+static bool uartBaudConfirming;
+static uint32_t uartBaudChangedMs;
 
 enum Command {
     Command_Reboot            = 0x01,
@@ -220,6 +247,10 @@ enum Command {
     Command_ReadRaw,
     Command_WriteRaw,
     Command_Bootloader,
+    Command_Framing,
+    Command_StateBatch,     // event only
+    Command_Stream,
+    Command_Baud,
 };
 
 enum CommandState {
@@ -298,6 +329,20 @@ static void onResult_senseFast(const uint8_t* counts, uint8_t countMax, uint16_t
     ADC_start(ADC_CH_TEMP, ADC_N_FAST, &onResult_temp);
 }
 
+static void onResult_stream(const uint8_t* counts, uint8_t countMax, uint16_t countValue) {
+    uint8_t i;
+    (void)counts; (void)countMax;
+
+    if((uint8_t)(streamHead - streamTail) >= STREAM_BUF_SIZE) {
+        ++streamDropped;
+        return;
+    }
+    i = streamHead & (STREAM_BUF_SIZE - 1);
+    streamValues[i] = countValue | (conn4 ? STREAM_SENSE : 0);
+    streamMs[i]     = SYSTEMTIMER_ms;
+    ++streamHead;
+}
+
 static void onResult_main(const uint8_t* counts, uint8_t countMax, uint16_t countValue) {
     uMainRaw = (uMainRaw + 1) / 2 + countsToValue(counts, countMax, countValue);
     ADC_start(ADC_CH_SENSE, ADC_N_FAST, &onResult_senseFast);
@@ -386,6 +431,10 @@ void SYSTEMTIMER_onTack(void) {
         }
         //GPIOD->ODR &= ~GPIO_ODR_2;
     }
+    else if(streamOn && AdcMode_Normal == adcMode && tickCount >= 15 && tickCount % 5 == 0) {
+        // the chain is done after ~25 ms, use the rest of the cycle for single fast measurements
+        ADC_start(conn4 ? ADC_CH_SENSE : ADC_CH_MAIN, ADC_N_FAST, &onResult_stream);
+    }
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -1518,17 +1567,31 @@ static uint8_t crc8(uint8_t crc, uint8_t b) __naked {
 
 static void sendUartCommand(uint8_t cmd, const uint8_t* data, uint8_t size) {
     uint8_t crc;
-    UART_send('S');
     crc = crc8(0, cmd);
-    UART_writeHexU8(cmd);
 
-    for(; size > 0; --size, ++data) {
-        crc = crc8(crc, *data);
-        UART_writeHexU8(*data);
+    if(binaryFraming) {
+        UART_send(UART_SLIP_END);
+        UART_writeSlipU8(cmd);
+
+        for(; size > 0; --size, ++data) {
+            crc = crc8(crc, *data);
+            UART_writeSlipU8(*data);
+        }
+        UART_writeSlipU8(crc);
+        UART_send(UART_SLIP_END);
+    }
+    else {
+        UART_send('S');
+        UART_writeHexU8(cmd);
+
+        for(; size > 0; --size, ++data) {
+            crc = crc8(crc, *data);
+            UART_writeHexU8(*data);
+        }
+        UART_writeHexU8(crc);
+        UART_send('\r');
+        UART_send('\n');
     }
-    UART_writeHexU8(crc);
-    UART_send('\r');
-    UART_send('\n');
 }
 
 static void commitUartCommand(uint8_t cmd) {
@@ -1572,6 +1635,21 @@ static void resetDevice(void) {
     while(true) {}
 }
 
+static void sendFlowBatch(void) {
+    uint8_t* buf = flowBatchBuf;
+
+    *(buf + 0) = (uint8_t)mode;
+    *(buf + 1) = error;
+    *(uint16_t*)(buf + 2) = tempRaw;
+    *(uint16_t*)(buf + 4) = uSupRaw;
+    *(uint16_t*)(buf + 6) = flowSeq - flowBatchCount;
+    *(uint32_t*)(buf + 8) = flowBatchMs;
+    *(buf + 12) = flowBatchCount;
+    sendUartCommand(Command_StateBatch | CommandState_Event, flowBatchBuf,
+        FLOW_BATCH_HEADER + flowBatchCount * FLOW_BATCH_SAMPLE);
+    flowBatchCount = 0;
+}
+
 static void processUartCommand(const uint8_t* buf, uint8_t size) {
     switch(buf[0]) {
         case Command_Reboot:
@@ -1686,8 +1764,13 @@ static void processUartCommand(const uint8_t* buf, uint8_t size) {
             break;
 
         case Command_FlowState:
-            if(size == 3) {
+            if(size >= 3 && size <= 5) {
+                if(flowBatchCount > 0) sendFlowBatch(); // already counted in flowSeq, not to be lost
                 flowInterval = ((uint16_t)buf[1] << 8) | buf[2];
+                flowFlags = (size >= 4 ? buf[3] : 0);
+                flowBatch = (size == 5 ? buf[4] : 1);
+                if(flowBatch == 0) flowBatch = 1;
+                if(flowBatch > FLOW_BATCH_MAX) flowBatch = FLOW_BATCH_MAX;
                 lastFlow = cycleBeginMs - flowInterval; // first output - right now
                 commitUartCommand(buf[0]);
             }
@@ -1730,6 +1813,48 @@ static void processUartCommand(const uint8_t* buf, uint8_t size) {
             }
             break;
 
+        case Command_Framing:
+            if(size == 2 && buf[1] <= 1) {
+                commitUartCommand(buf[0]); // reply still in the old framing
+                if(flowBatchCount > 0) sendFlowBatch(); // the same
+                binaryFraming = buf[1];
+            }
+            break;
+
+        case Command_Baud:
+            if(size == 5) {
+                uint32_t baud = ((uint32_t)buf[1] << 24) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 8) | buf[4];
+                uint32_t* reply32 = commReply;
+                *reply32 = baud;
+                if(baud == uartBaud) { // ping at the current rate
+                    sendUartCommand(Command_Baud | CommandState_Response, commReply, 4);
+                }
+                // 12 MHz / 921600 is below the minimal divider 16
+                else if(baud == 115200 || baud == 230400 || baud == 460800) {
+                    sendUartCommand(Command_Baud | CommandState_Response, commReply, 4); // still the old rate
+                    UART_setBaud(baud);
+                    uartBaud = baud;
+                    uartBaudConfirming = (baud != BAUD);
+                    uartBaudChangedMs = cycleBeginMs;
+                }
+                else {
+                    sendUartCommand(Command_Baud | CommandState_Error, NULL, 0);
+                }
+            }
+            break;
+
+        case Command_Stream:
+            if(size == 2 && buf[1] <= 1) {
+                disable_irq();
+                streamOn      = buf[1];
+                streamHead    = 0;
+                streamTail    = 0;
+                streamDropped = 0;
+                enable_irq();
+                commitUartCommand(buf[0]);
+            }
+            break;
+
         default:
             UART_write("->");
             for(; size > 0; --size, ++buf) UART_writeHexU8(*buf);
@@ -1743,8 +1868,10 @@ static void processUartRx(void) {
     const uint8_t* rx;
     const uint8_t* p;
 
-    UART_process();
-    rx = UART_getRx(&rxSize);
+    // take all received bytes until a frame is complete - requests may come back-to-back
+    do {
+        rx = UART_getRx(&rxSize);
+    } while(!rx && UART_process());
     if(!rx) return;
 
     crc = 0;
@@ -1753,25 +1880,116 @@ static void processUartRx(void) {
         --rxSize;
     }
 
-    if(crc == 0 && rxSize > 0)
+    if(crc == 0 && rxSize > 0) {
+        uartBaudConfirming = false; // the host hears us at this rate
         processUartCommand(rx, rxSize);
+    }
     else
         UART_write("checksum mismatch\r\n");
     UART_rxDone();
 }
 
+static void addFlowBatch(void) {
+    uint8_t* buf = flowBatchBuf + FLOW_BATCH_HEADER + flowBatchCount * FLOW_BATCH_SAMPLE;
+
+    if(flowBatchCount == 0) flowBatchMs = cycleBeginMs;
+    *(uint16_t*)(buf + 0) = (uint16_t)(cycleBeginMs - flowBatchMs);
+    *(buf + 2) = (uint8_t)mode;
+    *(uint16_t*)(buf + 3) = uMain;
+    *(uint16_t*)(buf + 5) = uSense;
+    *(uint32_t*)(buf + 7) = fun2State.ah;
+    *(uint32_t*)(buf + 11) = fun2State.wh;
+    ++flowBatchCount;
+}
+
 static void processFlow(void) {
-    static_assert(sizeof(commReply) >= 18, "Buffer too small");
+    static_assert(sizeof(commReply) >= 24, "Buffer too small");
 
     if(flowInterval == 0xFFFF) return;
     if(cycleBeginMs - lastFlow < flowInterval) return;
 
-    prepareActualState(commReply);
-    sendUartCommand(Command_GetState | CommandState_Event, commReply, 18);
+    // batches in binary framing only: in hex a full one holds the line for ~23 ms at 115200
+    if(flowBatch > 1 && binaryFraming) {
+        // don't hold mode changes back
+        if(flowBatchCount > 0 && flowBatchBuf[FLOW_BATCH_HEADER + (flowBatchCount - 1) * FLOW_BATCH_SAMPLE + 2] != (uint8_t)mode)
+            sendFlowBatch();
+        addFlowBatch();
+        ++flowSeq;
+        if(flowBatchCount >= flowBatch) sendFlowBatch();
+    }
+    else {
+        prepareActualState(commReply);
+        if(flowFlags & FLOW_EXTENDED) {
+            *(uint16_t*)(commReply + 18) = flowSeq;
+            *(uint32_t*)(commReply + 20) = cycleBeginMs;
+            sendUartCommand(Command_GetState | CommandState_Event, commReply, 24);
+        }
+        else {
+            sendUartCommand(Command_GetState | CommandState_Event, commReply, 18);
+        }
+        ++flowSeq;
+    }
     lastFlow += flowInterval;
     if(cycleBeginMs - lastFlow > flowInterval) lastFlow = cycleBeginMs; // a big gap for some reason? - jump
 }
 
+static uint8_t writeVarint(uint8_t* buf, uint16_t v) {
+    uint8_t n = 0;
+    while(v >= 0x80) {
+        buf[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    buf[n++] = (uint8_t)v;
+    return n;
+}
+
+// seq, ms of the first sample, count, then per sample: varint ms delta, varint zigzag mV delta
+static void processStream(void) {
+    static uint8_t buf[7 + STREAM_FRAME_SAMPLES * 6];
+    uint8_t n, i, size = 7;
+    uint16_t raw, v, last = 0;
+    uint32_t ms, lastMs = 0;
+    int16_t d;
+
+    if(!streamOn) return;
+    if((uint8_t)(streamHead - streamTail) < STREAM_FRAME_SAMPLES) return;
+
+    for(n = 0; n < STREAM_FRAME_SAMPLES; ++n, ++streamTail) {
+        i   = streamTail & (STREAM_BUF_SIZE - 1);
+        raw = streamValues[i];
+        ms  = streamMs[i];
+        // the same scale as the filtered uMainRaw/uSenseRaw
+        v = recalcValue((uint32_t)(raw & ~STREAM_SENSE) << 9, (raw & STREAM_SENSE) ? &CFG->uSenseCoef : &CFG->uMainCoef);
+
+        if(n == 0) {
+            *(uint32_t*)(buf + 2) = ms;
+            lastMs = ms;
+        }
+        size += writeVarint(buf + size, (uint16_t)(ms - lastMs));
+        d = (int16_t)(v - last);
+        size += writeVarint(buf + size, ((uint16_t)d << 1) ^ (d < 0 ? 0xFFFF : 0));
+        last   = v;
+        lastMs = ms;
+    }
+    *(uint16_t*)(buf + 0) = streamSeq;
+    *(buf + 6) = n;
+    sendUartCommand(Command_Stream | CommandState_Event, buf, size);
+
+    streamSeq += n;
+    disable_irq();
+    streamSeq += streamDropped; // let the host see the gap
+    streamDropped = 0;
+    enable_irq();
+}
+
+static void processBaud(void) {
+    if(uartBaudConfirming && cycleBeginMs - uartBaudChangedMs >= BAUD_CONFIRM_MS) {
+        uartBaudConfirming = false;
+        uartBaud = BAUD;
+        UART_setBaud(BAUD);
+    }
+}
+
 static void processUiEvent(void) {
     if(uiSetModified) {
         prepareActualSettings(commReply);
@@ -1859,6 +2077,8 @@ int main(void) {
 
             processUartRx();
             processFlow();
+            processStream();
+            processBaud();
             processUiEvent();
             if(cycleBeginMs - lastUpdate >= 100) {
                 updateDisplays();
@@ -12,6 +12,8 @@ enum RxState {
     RxState_Start,
     RxState_H,       // waiting for high byte half
     RxState_L,       // waiting low byte half
+    RxState_Bin,     // binary frame, waiting for next byte
+    RxState_BinEsc,  // binary frame, waiting for escaped byte
     RxState_Stop     // '\n' received, but buffer not read yet
 };
 static enum RxState rxState = RxState_Start;
@@ -20,6 +22,14 @@ static uint8_t rxBuf[UART_RXBUF_SIZE];
 static uint8_t rxBufPos;
 static bool hasChecksum;
 
+void UART_setBaud(uint32_t baud) {
+    uint16_t div = (CPU_F + baud/2) / baud;
+
+    while(!(UART2->SR & UART_SR_TC));
+    UART2->BRR2 = (div & 0x000F) | ((div & 0xF000) >> 8); // BRR2 first
+    UART2->BRR1 = (div & 0x0FF0) >> 4;
+}
+
 void UART_write(const char *str) {
     for(; *str; ++str)
         UART_send((uint8_t)*str);
@@ -42,6 +52,20 @@ void UART_writeHexU32(uint32_t v) {
     UART_writeHexU8(v & 0xFF);
 }
 
+void UART_writeSlipU8(uint8_t v) {
+    if(v == UART_SLIP_END) {
+        UART_send(UART_SLIP_ESC);
+        UART_send(UART_SLIP_ESC_END);
+    }
+    else if(v == UART_SLIP_ESC) {
+        UART_send(UART_SLIP_ESC);
+        UART_send(UART_SLIP_ESC_ESC);
+    }
+    else {
+        UART_send(v);
+    }
+}
+
 void UART_writeDecU16(uint16_t v) {
     UART_writeDecU64(v, 5);
 }
@@ -90,18 +114,37 @@ void UART_rxDone(void) {
     resetRx();
 }
 
+static inline void addRx(uint8_t v) {
+    rxBuf[rxBufPos] = v;
+    rxState = RxState_Bin;
+    ++rxBufPos;
+    if(rxBufPos >= UART_RXBUF_SIZE) resetRx();
+}
+
 // 2-5.3 us
-void UART_process(void) {
+bool UART_process(void) {
     uint8_t v;
     uint8_t b;
-    if(!RINGBUFFER_takeIfNotEmpty(&b)) return;
+    if(!RINGBUFFER_takeIfNotEmpty(&b)) return false;
 
     if(rxState != RxState_Stop) {
-        if(b == 'S' || b == 's') {            // start
+        if(b == UART_SLIP_END) {
+            if(rxState == RxState_Bin && rxBufPos > 0) {  // stop
+                rxState = RxState_Stop;
+            }
+            else {                                         // start
+                resetRx();
+                rxState = RxState_Bin;
+                hasChecksum = true;
+            }
+            return true;
+        }
+
+        if(rxState != RxState_Bin && rxState != RxState_BinEsc && (b == 'S' || b == 's')) { // start
             resetRx();
             rxState = RxState_H;
             hasChecksum = (b == 'S');
-            return;
+            return true;
         }
     }
 
@@ -142,11 +185,29 @@ void UART_process(void) {
 
             break;
 
+        case RxState_Bin:
+            if(b == UART_SLIP_ESC)
+                rxState = RxState_BinEsc;
+            else
+                addRx(b);
+            break;
+
+        case RxState_BinEsc:
+            if(b == UART_SLIP_ESC_END)
+                addRx(UART_SLIP_END);
+            else if(b == UART_SLIP_ESC_ESC)
+                addRx(UART_SLIP_ESC);
+            else    // unexpected symbol, reset
+                resetRx();
+            break;
+
         case RxState_Start:
         case RxState_Stop:
             nop();  // who are the EVELYN and the DOG?
             break; // ignore all
     }
+
+    return true;
 }
 
 // ~ 5.5us
@@ -9,10 +9,17 @@
 
 #define UART_RXBUF_SIZE 250
 
+// SLIP-like binary framing: END + escaped(cmd, data, crc) + END
+#define UART_SLIP_END     0xC0
+#define UART_SLIP_ESC     0xDB
+#define UART_SLIP_ESC_END 0xDC
+#define UART_SLIP_ESC_ESC 0xDD
+
 const uint8_t* UART_getRx(uint8_t* size);
 bool UART_hasChecksum(void);
 void UART_rxDone(void);
-void UART_process(void);
+bool UART_process(void); // false if nothing to process
+void UART_setBaud(uint32_t baud); // waits until the last byte is sent
 
 inline void UART_init(void) {
     UART2->BRR2 = (((CPU_F + BAUD/2) / BAUD) & 0x000F) | ((((CPU_F + BAUD/2) / BAUD) & 0xF000) >> 8);
@@ -33,6 +40,8 @@ void UART_writeHexU16(uint16_t v);
 
 void UART_writeHexU32(uint32_t v);
 
+void UART_writeSlipU8(uint8_t v);
+
 void UART_writeDecU16(uint16_t v);
 
 void UART_writeDecU32(uint32_t v);